@@ -23,18 +23,26 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include "ply-array.h"
+#include "ply-buffer.h"
 #include "ply-event-loop.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-utils.h"
 
+#ifndef PLY_BOOT_CLIENT_MAX_PIPELINED_WRITE_SIZE
+#define PLY_BOOT_CLIENT_MAX_PIPELINED_WRITE_SIZE 16384
+#endif
+
 struct _ply_boot_client
 {
         ply_event_loop_t                    *loop;
@@ -42,7 +50,12 @@ struct _ply_boot_client
         ply_fd_watch_t                      *daemon_has_reply_watch;
         ply_list_t                          *requests_to_send;
         ply_list_t                          *requests_waiting_for_replies;
+        ply_buffer_t                        *reply_buffer;
+        ply_list_t                          *coalesced_updates;
+        double                               update_coalescing_window;
         int                                  socket_fd;
+        int                                  protocol_version;
+        uint32_t                             next_request_id;
 
         ply_boot_client_disconnect_handler_t disconnect_handler;
         void                                *disconnect_handler_user_data;
@@ -53,8 +66,10 @@ struct _ply_boot_client
 typedef struct
 {
         ply_boot_client_t                 *client;
+        uint32_t                           id;
         char                              *command;
         char                              *argument;
+        int                                fd;
         ply_boot_client_response_handler_t handler;
         ply_boot_client_response_handler_t failed_handler;
         void                              *user_data;
@@ -73,6 +88,9 @@ ply_boot_client_new (void)
         client->daemon_has_reply_watch = NULL;
         client->requests_to_send = ply_list_new ();
         client->requests_waiting_for_replies = ply_list_new ();
+        client->reply_buffer = ply_buffer_new ();
+        client->coalesced_updates = ply_list_new ();
+        client->protocol_version = 1;
         client->loop = NULL;
         client->is_connected = false;
         client->disconnect_handler = NULL;
@@ -143,9 +161,35 @@ ply_boot_client_cancel_requests_waiting_for_replies (ply_boot_client_t *client)
         }
 }
 
+static void ply_boot_client_on_update_coalescing_timeout (ply_boot_client_t *client);
+
+static void
+ply_boot_client_cancel_coalesced_updates (ply_boot_client_t *client)
+{
+        ply_list_node_t *node;
+
+        if (ply_list_get_length (client->coalesced_updates) == 0)
+                return;
+
+        if (client->loop != NULL)
+                ply_event_loop_stop_watching_for_timeout (client->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          ply_boot_client_on_update_coalescing_timeout,
+                                                          client);
+
+        while ((node = ply_list_get_first_node (client->coalesced_updates)) != NULL) {
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+                ply_list_remove_node (client->coalesced_updates, node);
+                ply_boot_client_cancel_request (client, request);
+        }
+}
+
 static void
 ply_boot_client_cancel_requests (ply_boot_client_t *client)
 {
+        ply_boot_client_cancel_coalesced_updates (client);
         ply_boot_client_cancel_unsent_requests (client);
         ply_boot_client_cancel_requests_waiting_for_replies (client);
 }
@@ -160,6 +204,8 @@ ply_boot_client_free (ply_boot_client_t *client)
 
         ply_list_free (client->requests_to_send);
         ply_list_free (client->requests_waiting_for_replies);
+        ply_buffer_free (client->reply_buffer);
+        ply_list_free (client->coalesced_updates);
 
         free (client);
 }
@@ -213,9 +259,11 @@ ply_boot_client_request_new (ply_boot_client_t                 *client,
 
         request = calloc (1, sizeof(ply_boot_client_request_t));
         request->client = client;
+        request->id = client->next_request_id++;
         request->command = strdup (request_command);
         if (request_argument != NULL)
                 request->argument = strdup (request_argument);
+        request->fd = -1;
         request->handler = handler;
         request->failed_handler = failed_handler;
         request->user_data = user_data;
@@ -231,6 +279,8 @@ ply_boot_client_request_free (ply_boot_client_request_t *request)
         free (request->command);
         if (request->argument != NULL)
                 free (request->argument);
+        if (request->fd >= 0)
+                close (request->fd);
         free (request);
 }
 
@@ -244,87 +294,66 @@ ply_boot_client_cancel_request (ply_boot_client_t         *client,
         ply_boot_client_request_free (request);
 }
 
-static void
-ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
+static uint32_t
+read_uint32_from_bytes (const uint8_t *bytes)
 {
-        ply_list_node_t *request_node;
-        ply_boot_client_request_t *request;
-        bool processed_reply;
-        uint8_t byte[2] = "";
-        uint32_t size;
-
-        assert (client != NULL);
-
-        processed_reply = false;
-        if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
-                ply_error ("received unexpected response from boot status daemon");
-                return;
-        }
-
-        request_node = ply_list_get_first_node (client->requests_waiting_for_replies);
-        assert (request_node != NULL);
-
-        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
-        assert (request != NULL);
+        return (bytes[0] << 0) |
+               (bytes[1] << 8) |
+               (bytes[2] << 16) |
+               ((uint32_t) bytes[3] << 24);
+}
 
-        if (!ply_read (client->socket_fd, byte, sizeof(uint8_t)))
-                goto out;
+static void
+write_uint32_to_bytes (uint8_t *bytes,
+                       uint32_t value)
+{
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
+}
 
-        if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK, sizeof(uint8_t)) == 0) {
+static bool
+ply_boot_client_handle_reply (ply_boot_client_t         *client,
+                              ply_boot_client_request_t *request,
+                              uint8_t                    response_type,
+                              const char                *payload,
+                              size_t                     payload_size)
+{
+        if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK[0]) {
                 if (request->handler != NULL)
                         request->handler (request->user_data, client);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER[0]) {
                 char *answer;
 
-                if (!ply_read_uint32 (client->socket_fd, &size))
-                        goto out;
+                answer = malloc ((payload_size + 1) * sizeof(char));
+                if (payload_size > 0)
+                        memcpy (answer, payload, payload_size);
+                answer[payload_size] = '\0';
 
-                answer = malloc ((size + 1) * sizeof(char));
-                if (size > 0) {
-                        if (!ply_read (client->socket_fd, answer, size)) {
-                                free (answer);
-                                goto out;
-                        }
-                }
-
-                answer[size] = '\0';
                 if (request->handler != NULL)
                         ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, answer, client);
                 free (answer);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS[0]) {
                 ply_array_t *array;
                 char **answers;
-                char *answer;
-                char *p;
-                char *q;
-                uint8_t i;
-
-                array = NULL;
-                answers = NULL;
-
-                if (!ply_read_uint32 (client->socket_fd, &size))
-                        goto out;
-
-                assert (size > 0);
+                const char *p;
+                const char *q;
+                size_t i;
 
-                answer = malloc (size);
-
-                if (!ply_read (client->socket_fd, answer, size)) {
-                        free (answer);
-                        goto out;
-                }
+                if (payload_size == 0)
+                        return false;
 
                 array = ply_array_new (PLY_ARRAY_ELEMENT_TYPE_POINTER);
 
-                p = answer;
+                p = payload;
                 q = p;
-                for (i = 0; i < size; i++, q++) {
+                for (i = 0; i < payload_size; i++, q++) {
                         if (*q == '\0') {
                                 ply_array_add_pointer_element (array, strdup (p));
                                 p = q + 1;
                         }
                 }
-                free (answer);
 
                 answers = (char **) ply_array_steal_pointer_elements (array);
                 ply_array_free (array);
@@ -333,21 +362,31 @@ ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
                         ((ply_boot_client_multiple_answers_handler_t) request->handler)(request->user_data, (const char *const *) answers, client);
 
                 ply_free_string_array (answers);
-        } else if (memcmp (byte, PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER, sizeof(uint8_t)) == 0) {
+        } else if (response_type == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER[0]) {
                 if (request->handler != NULL)
                         ((ply_boot_client_answer_handler_t) request->handler)(request->user_data, NULL, client);
         } else {
-                goto out;
+                return false;
         }
 
-        processed_reply = true;
+        return true;
+}
+
+static void
+ply_boot_client_finish_request (ply_boot_client_t *client,
+                                ply_list_node_t   *request_node,
+                                bool               processed_reply)
+{
+        ply_boot_client_request_t *request;
+
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
 
-out:
         if (!processed_reply)
                 if (request->failed_handler != NULL)
                         request->failed_handler (request->user_data, client);
 
         ply_list_remove_node (client->requests_waiting_for_replies, request_node);
+        ply_boot_client_request_free (request);
 
         if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
                 if (client->daemon_has_reply_watch != NULL) {
@@ -359,53 +398,239 @@ out:
         }
 }
 
-static char *
-ply_boot_client_get_request_string (ply_boot_client_t         *client,
-                                    ply_boot_client_request_t *request,
-                                    size_t                    *request_size)
+static void
+ply_boot_client_process_incoming_reply (ply_boot_client_t *client)
+{
+        ply_list_node_t *request_node;
+        ply_boot_client_request_t *request;
+        bool processed_reply;
+        uint8_t byte[2] = "";
+        char *payload = NULL;
+        uint32_t size = 0;
+
+        request_node = ply_list_get_first_node (client->requests_waiting_for_replies);
+        assert (request_node != NULL);
+
+        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+        assert (request != NULL);
+
+        processed_reply = false;
+
+        if (!ply_read (client->socket_fd, byte, sizeof(uint8_t)))
+                goto out;
+
+        if (byte[0] == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER[0] ||
+            byte[0] == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS[0]) {
+                if (!ply_read_uint32 (client->socket_fd, &size))
+                        goto out;
+
+                payload = malloc (size + 1);
+                if (size > 0) {
+                        if (!ply_read (client->socket_fd, payload, size))
+                                goto out;
+                }
+        }
+
+        processed_reply = ply_boot_client_handle_reply (client, request, byte[0], payload, size);
+
+out:
+        free (payload);
+        ply_boot_client_finish_request (client, request_node, processed_reply);
+}
+
+static ply_list_node_t *
+ply_boot_client_find_request_waiting_for_reply (ply_boot_client_t *client,
+                                                uint32_t           id)
+{
+        ply_list_node_t *node;
+
+        ply_list_foreach (client->requests_waiting_for_replies, node) {
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+
+                if (request->id == id)
+                        return node;
+        }
+
+        return NULL;
+}
+
+static void
+ply_boot_client_process_pipelined_replies (ply_boot_client_t *client)
+{
+        char bytes[4096];
+        ssize_t bytes_read;
+        size_t offset = 0;
+
+        do {
+                bytes_read = recv (client->socket_fd, bytes, sizeof(bytes), MSG_DONTWAIT);
+
+                if (bytes_read > 0)
+                        ply_buffer_append_bytes (client->reply_buffer, bytes, bytes_read);
+        } while (bytes_read == sizeof(bytes) || (bytes_read < 0 && errno == EINTR));
+
+        while (ply_buffer_get_size (client->reply_buffer) - offset >= PLY_BOOT_PROTOCOL_V2_REPLY_HEADER_SIZE) {
+                const uint8_t *reply;
+                ply_list_node_t *request_node;
+                uint32_t id, size;
+                bool processed_reply;
+
+                reply = (const uint8_t *) ply_buffer_get_bytes (client->reply_buffer) + offset;
+                id = read_uint32_from_bytes (reply + 1);
+                size = read_uint32_from_bytes (reply + 5);
+
+                if (size > PLY_BOOT_PROTOCOL_V2_MAX_PAYLOAD_SIZE) {
+                        ply_error ("received oversized reply from boot status daemon");
+                        ply_buffer_clear (client->reply_buffer);
+                        ply_boot_client_cancel_requests_waiting_for_replies (client);
+                        return;
+                }
+
+                if (ply_buffer_get_size (client->reply_buffer) - offset < PLY_BOOT_PROTOCOL_V2_REPLY_HEADER_SIZE + size)
+                        break;
+
+                offset += PLY_BOOT_PROTOCOL_V2_REPLY_HEADER_SIZE + size;
+
+                request_node = ply_boot_client_find_request_waiting_for_reply (client, id);
+
+                if (request_node == NULL) {
+                        ply_error ("received response to unknown request %u from boot status daemon", id);
+                        continue;
+                }
+
+                processed_reply = ply_boot_client_handle_reply (client,
+                                                                ply_list_node_get_data (request_node),
+                                                                reply[0],
+                                                                (const char *) reply + PLY_BOOT_PROTOCOL_V2_REPLY_HEADER_SIZE,
+                                                                size);
+                ply_boot_client_finish_request (client, request_node, processed_reply);
+        }
+
+        ply_buffer_remove_bytes (client->reply_buffer, offset);
+}
+
+static void
+ply_boot_client_process_incoming_replies (ply_boot_client_t *client)
 {
-        char *request_string;
+        assert (client != NULL);
+
+        if (ply_list_get_length (client->requests_waiting_for_replies) == 0) {
+                ply_error ("received unexpected response from boot status daemon");
+                return;
+        }
+
+        if (client->protocol_version >= 2)
+                ply_boot_client_process_pipelined_replies (client);
+        else
+                ply_boot_client_process_incoming_reply (client);
+}
 
+static void
+ply_boot_client_append_request (ply_boot_client_t         *client,
+                                ply_boot_client_request_t *request,
+                                ply_buffer_t              *buffer)
+{
         assert (client != NULL);
         assert (request != NULL);
-        assert (request_size != NULL);
+        assert (buffer != NULL);
 
         assert (request->command != NULL);
 
+        if (client->protocol_version >= 2) {
+                uint8_t header[PLY_BOOT_PROTOCOL_V2_REQUEST_HEADER_SIZE];
+                size_t argument_size = 0;
+
+                header[0] = request->command[0];
+                header[1] = 0;
+                if (request->argument != NULL) {
+                        header[1] |= PLY_BOOT_PROTOCOL_V2_REQUEST_FLAG_HAS_ARGUMENT;
+                        argument_size = strlen (request->argument);
+                }
+                write_uint32_to_bytes (header + 2, request->id);
+                write_uint32_to_bytes (header + 6, argument_size);
+
+                ply_buffer_append_bytes (buffer, header, sizeof(header));
+                if (argument_size > 0)
+                        ply_buffer_append_bytes (buffer, request->argument, argument_size);
+                return;
+        }
+
         if (request->argument == NULL) {
-                request_string = strdup (request->command);
-                *request_size = strlen (request_string) + 1;
-                return request_string;
+                ply_buffer_append_bytes (buffer, request->command, strlen (request->command) + 1);
+                return;
         }
 
-        assert (strlen (request->argument) <= UCHAR_MAX);
+        assert (strlen (request->argument) + 1 <= UCHAR_MAX);
 
-        request_string = NULL;
-        asprintf (&request_string, "%s\002%c%s", request->command,
-                  (char) (strlen (request->argument) + 1), request->argument);
-        *request_size = strlen (request_string) + 1;
+        ply_buffer_append (buffer, "%s\002%c%s", request->command,
+                           (char) (strlen (request->argument) + 1), request->argument);
+        ply_buffer_append_bytes (buffer, "", 1);
+}
 
-        return request_string;
+/* Sends fd along with the first bytes of the buffer, so the daemon
+ * has it in hand by the time it gets to the request that refers to it
+ */
+static bool
+ply_boot_client_send_fd (ply_boot_client_t *client,
+                         const char        *bytes,
+                         size_t             size,
+                         int                fd,
+                         size_t            *bytes_sent)
+{
+        union
+        {
+                struct cmsghdr header;
+                char           buffer[CMSG_SPACE (sizeof(int))];
+        } control;
+        struct iovec vector = { .iov_base = (void *) bytes, .iov_len = size };
+        struct msghdr message = { 0 };
+        struct cmsghdr *control_message;
+        ssize_t bytes_written;
+
+        memset (&control, 0, sizeof(control));
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        control_message = CMSG_FIRSTHDR (&message);
+        control_message->cmsg_level = SOL_SOCKET;
+        control_message->cmsg_type = SCM_RIGHTS;
+        control_message->cmsg_len = CMSG_LEN (sizeof(int));
+        memcpy (CMSG_DATA (control_message), &fd, sizeof(int));
+
+        do {
+                bytes_written = sendmsg (client->socket_fd, &message, MSG_NOSIGNAL);
+        } while (bytes_written < 0 && errno == EINTR);
+
+        if (bytes_written <= 0)
+                return false;
+
+        *bytes_sent = bytes_written;
+        return true;
 }
 
 static bool
-ply_boot_client_send_request (ply_boot_client_t         *client,
-                              ply_boot_client_request_t *request)
+ply_boot_client_send_buffer (ply_boot_client_t *client,
+                             ply_buffer_t      *buffer,
+                             int                fd)
 {
-        char *request_string;
-        size_t request_size;
+        const char *bytes = ply_buffer_get_bytes (buffer);
+        size_t size = ply_buffer_get_size (buffer);
 
-        assert (client != NULL);
-        assert (request != NULL);
+        if (fd >= 0) {
+                size_t bytes_sent;
 
-        request_string = ply_boot_client_get_request_string (client, request,
-                                                             &request_size);
-        if (!ply_write (client->socket_fd, request_string, request_size)) {
-                free (request_string);
-                ply_boot_client_cancel_request (client, request);
-                return false;
+                if (!ply_boot_client_send_fd (client, bytes, size, fd, &bytes_sent))
+                        return false;
+
+                bytes += bytes_sent;
+                size -= bytes_sent;
         }
-        free (request_string);
+
+        if (size > 0 && !ply_write (client->socket_fd, bytes, size))
+                return false;
 
         if (client->daemon_has_reply_watch == NULL) {
                 assert (ply_list_get_length (client->requests_waiting_for_replies) == 0);
@@ -424,20 +649,70 @@ ply_boot_client_process_pending_requests (ply_boot_client_t *client)
 {
         ply_list_node_t *request_node;
         ply_boot_client_request_t *request;
+        ply_buffer_t *buffer;
+        int fd = -1;
 
         assert (ply_list_get_length (client->requests_to_send) != 0);
         assert (client->daemon_can_take_request_watch != NULL);
 
-        request_node = ply_list_get_first_node (client->requests_to_send);
-        assert (request_node != NULL);
+        buffer = ply_buffer_new ();
 
-        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
-        assert (request != NULL);
+        if (client->protocol_version >= 2) {
+                ply_list_t *requests_sent;
+
+                /* Queued requests go out together, and the replies are matched
+                 * back up by request id. Writes are kept small enough that the
+                 * daemon's replies can't fill up the socket while we block.
+                 * A request carrying a file descriptor always starts a write
+                 * of its own, since the descriptor rides on its first byte.
+                 */
+                requests_sent = ply_list_new ();
+                while (ply_buffer_get_size (buffer) < PLY_BOOT_CLIENT_MAX_PIPELINED_WRITE_SIZE &&
+                       (request_node = ply_list_get_first_node (client->requests_to_send)) != NULL) {
+                        request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+
+                        if (request->fd >= 0 && ply_list_get_length (requests_sent) > 0)
+                                break;
+
+                        ply_boot_client_append_request (client, request, buffer);
+                        ply_list_append_data (requests_sent, request);
+                        ply_list_remove_node (client->requests_to_send, request_node);
+
+                        if (request->fd >= 0) {
+                                fd = request->fd;
+                                break;
+                        }
+                }
 
-        ply_list_remove_node (client->requests_to_send, request_node);
+                if (ply_boot_client_send_buffer (client, buffer, fd)) {
+                        ply_list_foreach (requests_sent, request_node) {
+                                ply_list_append_data (client->requests_waiting_for_replies,
+                                                      ply_list_node_get_data (request_node));
+                        }
+                } else {
+                        ply_list_foreach (requests_sent, request_node) {
+                                ply_boot_client_cancel_request (client,
+                                                                ply_list_node_get_data (request_node));
+                        }
+                }
+                ply_list_free (requests_sent);
+        } else {
+                request_node = ply_list_get_first_node (client->requests_to_send);
+                assert (request_node != NULL);
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (request_node);
+                assert (request != NULL);
 
-        if (ply_boot_client_send_request (client, request))
-                ply_list_append_data (client->requests_waiting_for_replies, request);
+                ply_list_remove_node (client->requests_to_send, request_node);
+
+                ply_boot_client_append_request (client, request, buffer);
+                if (ply_boot_client_send_buffer (client, buffer, request->fd))
+                        ply_list_append_data (client->requests_waiting_for_replies, request);
+                else
+                        ply_boot_client_cancel_request (client, request);
+        }
+
+        ply_buffer_free (buffer);
 
         if (ply_list_get_length (client->requests_to_send) == 0) {
                 if (client->daemon_has_reply_watch != NULL) {
@@ -451,17 +726,19 @@ ply_boot_client_process_pending_requests (ply_boot_client_t *client)
 }
 
 static void
-ply_boot_client_queue_request (ply_boot_client_t                 *client,
-                               const char                        *request_command,
-                               const char                        *request_argument,
-                               ply_boot_client_response_handler_t handler,
-                               ply_boot_client_response_handler_t failed_handler,
-                               void                              *user_data)
+ply_boot_client_queue_request_with_fd (ply_boot_client_t                 *client,
+                                       const char                        *request_command,
+                                       const char                        *request_argument,
+                                       int                                fd,
+                                       ply_boot_client_response_handler_t handler,
+                                       ply_boot_client_response_handler_t failed_handler,
+                                       void                              *user_data)
 {
         assert (client != NULL);
         assert (client->loop != NULL);
         assert (request_command != NULL);
-        assert (request_argument == NULL || strlen (request_argument) <= UCHAR_MAX);
+        assert (request_argument == NULL || client->protocol_version >= 2 ||
+                strlen (request_argument) + 1 <= UCHAR_MAX);
 
         if (client->daemon_can_take_request_watch == NULL &&
             client->socket_fd >= 0) {
@@ -483,10 +760,84 @@ ply_boot_client_queue_request (ply_boot_client_t                 *client,
                 request = ply_boot_client_request_new (client, request_command,
                                                        request_argument,
                                                        handler, failed_handler, user_data);
+
+                if (fd >= 0) {
+                        request->fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+
+                        if (request->fd < 0) {
+                                ply_boot_client_cancel_request (client, request);
+                                return;
+                        }
+                }
+
                 ply_list_append_data (client->requests_to_send, request);
         }
 }
 
+static void
+ply_boot_client_queue_request (ply_boot_client_t                 *client,
+                               const char                        *request_command,
+                               const char                        *request_argument,
+                               ply_boot_client_response_handler_t handler,
+                               ply_boot_client_response_handler_t failed_handler,
+                               void                              *user_data)
+{
+        ply_boot_client_queue_request_with_fd (client, request_command,
+                                               request_argument, -1,
+                                               handler, failed_handler,
+                                               user_data);
+}
+
+bool
+ply_boot_client_upgrade_protocol (ply_boot_client_t *client)
+{
+        ply_boot_client_request_t *request;
+        ply_buffer_t *buffer;
+        uint8_t byte[2] = "";
+        bool is_acknowledged = false;
+
+        assert (client != NULL);
+        assert (client->is_connected);
+        assert (ply_list_get_length (client->requests_to_send) == 0);
+        assert (ply_list_get_length (client->requests_waiting_for_replies) == 0);
+
+        if (client->protocol_version >= 2)
+                return true;
+
+        request = ply_boot_client_request_new (client,
+                                               PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION,
+                                               PLY_BOOT_PROTOCOL_VERSION_2,
+                                               NULL, NULL, NULL);
+        buffer = ply_buffer_new ();
+        ply_boot_client_append_request (client, request, buffer);
+
+        if (ply_write (client->socket_fd,
+                       ply_buffer_get_bytes (buffer),
+                       ply_buffer_get_size (buffer)) &&
+            ply_read (client->socket_fd, byte, sizeof(uint8_t)))
+                is_acknowledged = byte[0] == PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK[0];
+
+        ply_buffer_free (buffer);
+        ply_boot_client_request_free (request);
+
+        if (!is_acknowledged) {
+                ply_trace ("boot status daemon doesn't support protocol version 2");
+                return false;
+        }
+
+        ply_trace ("using protocol version 2");
+        client->protocol_version = 2;
+        return true;
+}
+
+int
+ply_boot_client_get_protocol_version (ply_boot_client_t *client)
+{
+        assert (client != NULL);
+
+        return client->protocol_version;
+}
+
 void
 ply_boot_client_ping_daemon (ply_boot_client_t                 *client,
                              ply_boot_client_response_handler_t handler,
@@ -499,6 +850,95 @@ ply_boot_client_ping_daemon (ply_boot_client_t                 *client,
                                        NULL, handler, failed_handler, user_data);
 }
 
+static void
+ply_boot_client_on_coalesced_update_sent (ply_list_t        *updates,
+                                          ply_boot_client_t *client)
+{
+        ply_list_node_t *node;
+
+        ply_list_foreach (updates, node) {
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+
+                if (request->handler != NULL)
+                        request->handler (request->user_data, client);
+                ply_boot_client_request_free (request);
+        }
+        ply_list_free (updates);
+}
+
+static void
+ply_boot_client_on_coalesced_update_failed (ply_list_t        *updates,
+                                            ply_boot_client_t *client)
+{
+        ply_list_node_t *node;
+
+        ply_list_foreach (updates, node) {
+                ply_boot_client_request_t *request;
+
+                request = (ply_boot_client_request_t *) ply_list_node_get_data (node);
+
+                if (request->failed_handler != NULL)
+                        request->failed_handler (request->user_data, client);
+                ply_boot_client_request_free (request);
+        }
+        ply_list_free (updates);
+}
+
+/* Sends the most recent of the coalesced status updates, and answers
+ * every caller that asked for one of them once it's acknowledged
+ */
+static void
+ply_boot_client_send_coalesced_updates (ply_boot_client_t *client)
+{
+        ply_boot_client_request_t *last_request;
+        ply_list_t *updates;
+        ply_list_node_t *node;
+
+        if (ply_list_get_length (client->coalesced_updates) == 0)
+                return;
+
+        updates = ply_list_new ();
+        while ((node = ply_list_get_first_node (client->coalesced_updates)) != NULL) {
+                ply_list_append_data (updates, ply_list_node_get_data (node));
+                ply_list_remove_node (client->coalesced_updates, node);
+        }
+
+        last_request = ply_list_node_get_data (ply_list_get_last_node (updates));
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE,
+                                       last_request->argument,
+                                       (ply_boot_client_response_handler_t)
+                                       ply_boot_client_on_coalesced_update_sent,
+                                       (ply_boot_client_response_handler_t)
+                                       ply_boot_client_on_coalesced_update_failed,
+                                       updates);
+}
+
+static void
+ply_boot_client_on_update_coalescing_timeout (ply_boot_client_t *client)
+{
+        ply_boot_client_send_coalesced_updates (client);
+}
+
+void
+ply_boot_client_set_update_coalescing_window (ply_boot_client_t *client,
+                                              double             seconds)
+{
+        assert (client != NULL);
+
+        if (seconds <= 0.0 && client->loop != NULL) {
+                ply_event_loop_stop_watching_for_timeout (client->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          ply_boot_client_on_update_coalescing_timeout,
+                                                          client);
+                ply_boot_client_send_coalesced_updates (client);
+        }
+
+        client->update_coalescing_window = seconds;
+}
+
 void
 ply_boot_client_update_daemon (ply_boot_client_t                 *client,
                                const char                        *status,
@@ -506,10 +946,28 @@ ply_boot_client_update_daemon (ply_boot_client_t                 *client,
                                ply_boot_client_response_handler_t failed_handler,
                                void                              *user_data)
 {
+        ply_boot_client_request_t *request;
+
         assert (client != NULL);
 
-        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE,
-                                       status, handler, failed_handler, user_data);
+        if (client->update_coalescing_window <= 0.0 || !client->is_connected) {
+                ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE,
+                                               status, handler, failed_handler, user_data);
+                return;
+        }
+
+        assert (client->loop != NULL);
+
+        if (ply_list_get_length (client->coalesced_updates) == 0)
+                ply_event_loop_watch_for_timeout (client->loop,
+                                                  client->update_coalescing_window,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  ply_boot_client_on_update_coalescing_timeout,
+                                                  client);
+
+        request = ply_boot_client_request_new (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE,
+                                               status, handler, failed_handler, user_data);
+        ply_list_append_data (client->coalesced_updates, request);
 }
 
 void
@@ -779,11 +1237,46 @@ ply_boot_client_tell_daemon_about_error (ply_boot_client_t                 *clie
                                        NULL, handler, failed_handler, user_data);
 }
 
+void
+ply_boot_client_ask_daemon_for_statistics (ply_boot_client_t                 *client,
+                                           ply_boot_client_answer_handler_t   handler,
+                                           ply_boot_client_response_handler_t failed_handler,
+                                           void                              *user_data)
+{
+        assert (client != NULL);
+
+        ply_boot_client_queue_request (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS,
+                                       NULL, (ply_boot_client_response_handler_t)
+                                       handler, failed_handler, user_data);
+}
+
+void
+ply_boot_client_tell_daemon_about_progress_page (ply_boot_client_t                 *client,
+                                                 int                                page_fd,
+                                                 ply_boot_client_response_handler_t handler,
+                                                 ply_boot_client_response_handler_t failed_handler,
+                                                 void                              *user_data)
+{
+        assert (client != NULL);
+        assert (page_fd >= 0);
+
+        ply_boot_client_queue_request_with_fd (client, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_PAGE,
+                                               NULL, page_fd, handler, failed_handler, user_data);
+}
+
 void
 ply_boot_client_flush (ply_boot_client_t *client)
 {
         assert (client != NULL);
 
+        if (ply_list_get_length (client->coalesced_updates) > 0) {
+                ply_event_loop_stop_watching_for_timeout (client->loop,
+                                                          (ply_event_loop_timeout_handler_t)
+                                                          ply_boot_client_on_update_coalescing_timeout,
+                                                          client);
+                ply_boot_client_send_coalesced_updates (client);
+        }
+
         while (ply_list_get_length (client->requests_to_send) > 0) {
                 ply_event_loop_process_pending_events (client->loop);
         }
@@ -49,10 +49,14 @@ void ply_boot_client_free (ply_boot_client_t *client);
 bool ply_boot_client_connect (ply_boot_client_t                   *client,
                               ply_boot_client_disconnect_handler_t disconnect_handler,
                               void                                *user_data);
+bool ply_boot_client_upgrade_protocol (ply_boot_client_t *client);
+int ply_boot_client_get_protocol_version (ply_boot_client_t *client);
 void ply_boot_client_ping_daemon (ply_boot_client_t                 *client,
                                   ply_boot_client_response_handler_t handler,
                                   ply_boot_client_response_handler_t failed_handler,
                                   void                              *user_data);
+void ply_boot_client_set_update_coalescing_window (ply_boot_client_t *client,
+                                                   double             seconds);
 void ply_boot_client_update_daemon (ply_boot_client_t                 *client,
                                     const char                        *new_status,
                                     ply_boot_client_response_handler_t handler,
@@ -148,6 +152,15 @@ void ply_boot_client_ask_daemon_has_active_vt (ply_boot_client_t
                                                ply_boot_client_response_handler_t handler,
                                                ply_boot_client_response_handler_t failed_handler,
                                                void                              *user_data);
+void ply_boot_client_ask_daemon_for_statistics (ply_boot_client_t                 *client,
+                                                ply_boot_client_answer_handler_t   handler,
+                                                ply_boot_client_response_handler_t failed_handler,
+                                                void                              *user_data);
+void ply_boot_client_tell_daemon_about_progress_page (ply_boot_client_t                 *client,
+                                                      int                                page_fd,
+                                                      ply_boot_client_response_handler_t handler,
+                                                      ply_boot_client_response_handler_t failed_handler,
+                                                      void                              *user_data);
 void ply_boot_client_flush (ply_boot_client_t *client);
 void ply_boot_client_disconnect (ply_boot_client_t *client);
 void ply_boot_client_attach_to_event_loop (ply_boot_client_t *client,
@@ -32,6 +32,7 @@
 #include <sys/wait.h>
 
 #include "ply-boot-client.h"
+#include "ply-buffer.h"
 #include "ply-command-parser.h"
 #include "ply-event-loop.h"
 #include "ply-logger.h"
@@ -80,6 +81,16 @@ typedef struct
         char    *keys;
 } key_answer_state_t;
 
+typedef struct
+{
+        state_t        *state;
+        ply_buffer_t   *input;
+        ply_fd_watch_t *input_watch;
+        int             number_of_pending_requests;
+        int             number_of_failed_requests;
+        uint32_t        input_is_done : 1;
+} batch_state_t;
+
 static void
 on_ping_timeout (state_t *state)
 {
@@ -197,6 +208,17 @@ on_success (state_t *state)
         ply_event_loop_exit (state->loop, 0);
 }
 
+static void
+on_statistics_answer (state_t           *state,
+                      const char        *answer,
+                      ply_boot_client_t *client)
+{
+        if (answer != NULL)
+                printf ("%s", answer);
+
+        ply_event_loop_exit (state->loop, 0);
+}
+
 static void
 on_password_answer_failure (password_answer_state_t *answer_state,
                             ply_boot_client_t       *client)
@@ -882,14 +904,251 @@ on_system_update_request (state_t    *state,
         }
 }
 
+typedef void (*batch_request_with_argument_t) (ply_boot_client_t                 *client,
+                                               const char                        *argument,
+                                               ply_boot_client_response_handler_t handler,
+                                               ply_boot_client_response_handler_t failed_handler,
+                                               void                              *user_data);
+typedef void (*batch_request_t) (ply_boot_client_t                 *client,
+                                 ply_boot_client_response_handler_t handler,
+                                 ply_boot_client_response_handler_t failed_handler,
+                                 void                              *user_data);
+
+static const struct
+{
+        const char                   *name;
+        batch_request_with_argument_t request_with_argument;
+        batch_request_t               request;
+} batch_commands[] = {
+        { "update",           ply_boot_client_update_daemon,                   NULL                                              },
+        { "message",          ply_boot_client_tell_daemon_to_display_message,  NULL                                              },
+        { "display-message",  ply_boot_client_tell_daemon_to_display_message,  NULL                                              },
+        { "hide-message",     ply_boot_client_tell_daemon_to_hide_message,     NULL                                              },
+        { "system-update",    ply_boot_client_system_update,                   NULL                                              },
+        { "change-mode",      ply_boot_client_change_mode,                     NULL                                              },
+        { "newroot",          ply_boot_client_tell_daemon_to_change_root,      NULL                                              },
+        { "ping",             NULL,                                            ply_boot_client_ping_daemon                       },
+        { "sysinit",          NULL,                                            ply_boot_client_tell_daemon_system_is_initialized },
+        { "show-splash",      NULL,                                            ply_boot_client_tell_daemon_to_show_splash        },
+        { "hide-splash",      NULL,                                            ply_boot_client_tell_daemon_to_hide_splash        },
+        { "pause-progress",   NULL,                                            ply_boot_client_tell_daemon_to_progress_pause     },
+        { "unpause-progress", NULL,                                            ply_boot_client_tell_daemon_to_progress_unpause   },
+        { "report-error",     NULL,                                            ply_boot_client_tell_daemon_about_error           },
+        { "reactivate",       NULL,                                            ply_boot_client_tell_daemon_to_reactivate         },
+        { "reload",           NULL,                                            ply_boot_client_tell_daemon_to_reload             },
+};
+
+static void
+finish_batch_if_done (batch_state_t *batch_state)
+{
+        if (!batch_state->input_is_done || batch_state->number_of_pending_requests > 0)
+                return;
+
+        ply_trace ("batch: finished with %d failed requests",
+                   batch_state->number_of_failed_requests);
+        ply_event_loop_exit (batch_state->state->loop,
+                             batch_state->number_of_failed_requests > 0 ? 1 : 0);
+}
+
+static void
+on_batch_request_success (batch_state_t *batch_state)
+{
+        batch_state->number_of_pending_requests--;
+        finish_batch_if_done (batch_state);
+}
+
+static void
+on_batch_request_failure (batch_state_t *batch_state)
+{
+        batch_state->number_of_pending_requests--;
+        batch_state->number_of_failed_requests++;
+        finish_batch_if_done (batch_state);
+}
+
+static void
+process_batch_line (batch_state_t *batch_state,
+                    char          *line)
+{
+        const char *argument;
+        size_t i, length;
+
+        length = strlen (line);
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == ' '))
+                line[--length] = '\0';
+
+        while (*line == ' ' || *line == '\t') {
+                line++;
+        }
+
+        if (line[0] == '\0' || line[0] == '#')
+                return;
+
+        argument = NULL;
+        length = strcspn (line, " \t");
+        if (line[length] != '\0') {
+                line[length] = '\0';
+                argument = line + length + 1;
+        }
+
+        for (i = 0; i < PLY_NUMBER_OF_ELEMENTS (batch_commands); i++) {
+                if (strcmp (line, batch_commands[i].name) == 0)
+                        break;
+        }
+
+        if (i == PLY_NUMBER_OF_ELEMENTS (batch_commands)) {
+                ply_error ("batch: unknown command '%s'", line);
+                batch_state->number_of_failed_requests++;
+                return;
+        }
+
+        if ((batch_commands[i].request_with_argument != NULL) != (argument != NULL)) {
+                ply_error ("batch: command '%s' %s an argument", line,
+                           argument != NULL ? "doesn't take" : "requires");
+                batch_state->number_of_failed_requests++;
+                return;
+        }
+
+        /* Version 1 of the protocol sends the argument length, including its
+         * terminating NUL, in one byte */
+        if (argument != NULL &&
+            ply_boot_client_get_protocol_version (batch_state->state->client) < 2 &&
+            strlen (argument) + 1 > UCHAR_MAX) {
+                ply_error ("batch: argument to '%s' is too long", line);
+                batch_state->number_of_failed_requests++;
+                return;
+        }
+
+        batch_state->number_of_pending_requests++;
+
+        if (argument != NULL)
+                batch_commands[i].request_with_argument (batch_state->state->client,
+                                                         argument,
+                                                         (ply_boot_client_response_handler_t)
+                                                         on_batch_request_success,
+                                                         (ply_boot_client_response_handler_t)
+                                                         on_batch_request_failure,
+                                                         batch_state);
+        else
+                batch_commands[i].request (batch_state->state->client,
+                                           (ply_boot_client_response_handler_t)
+                                           on_batch_request_success,
+                                           (ply_boot_client_response_handler_t)
+                                           on_batch_request_failure,
+                                           batch_state);
+}
+
+static void
+process_batch_input (batch_state_t *batch_state,
+                     bool           is_at_end)
+{
+        char *lines, *line, *end_of_line;
+        size_t size;
+
+        size = ply_buffer_get_size (batch_state->input);
+
+        if (size == 0)
+                return;
+
+        lines = strndup (ply_buffer_get_bytes (batch_state->input), size);
+
+        line = lines;
+        while ((end_of_line = strchr (line, '\n')) != NULL) {
+                *end_of_line = '\0';
+                process_batch_line (batch_state, line);
+                line = end_of_line + 1;
+        }
+
+        if (is_at_end) {
+                process_batch_line (batch_state, line);
+                ply_buffer_clear (batch_state->input);
+        } else {
+                ply_buffer_remove_bytes (batch_state->input, line - lines);
+        }
+
+        free (lines);
+}
+
+static bool
+read_batch_input (batch_state_t *batch_state)
+{
+        char bytes[4096];
+        ssize_t bytes_read;
+
+        do {
+                bytes_read = read (STDIN_FILENO, bytes, sizeof(bytes));
+        } while (bytes_read < 0 && errno == EINTR);
+
+        if (bytes_read <= 0)
+                return false;
+
+        ply_buffer_append_bytes (batch_state->input, bytes, bytes_read);
+        return true;
+}
+
+static void
+on_batch_input_hangup (batch_state_t *batch_state)
+{
+        ply_trace ("batch: reached end of input");
+
+        batch_state->input_watch = NULL;
+
+        while (read_batch_input (batch_state)) {
+        }
+
+        process_batch_input (batch_state, true);
+        batch_state->input_is_done = true;
+        finish_batch_if_done (batch_state);
+}
+
+static void
+on_batch_input (batch_state_t *batch_state)
+{
+        if (!read_batch_input (batch_state)) {
+                if (batch_state->input_watch != NULL) {
+                        ply_event_loop_stop_watching_fd (batch_state->state->loop,
+                                                         batch_state->input_watch);
+                }
+                on_batch_input_hangup (batch_state);
+                return;
+        }
+
+        process_batch_input (batch_state, false);
+}
+
+static void
+start_batch (batch_state_t *batch_state)
+{
+        struct stat file_info;
+
+        batch_state->input = ply_buffer_new ();
+
+        /* Regular files can't be watched from the event loop, but they
+         * also never block, so just read them in one go
+         */
+        if (fstat (STDIN_FILENO, &file_info) == 0 && S_ISREG (file_info.st_mode)) {
+                on_batch_input_hangup (batch_state);
+                return;
+        }
+
+        batch_state->input_watch = ply_event_loop_watch_fd (batch_state->state->loop,
+                                                            STDIN_FILENO,
+                                                            PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
+                                                            (ply_event_handler_t)
+                                                            on_batch_input,
+                                                            (ply_event_handler_t)
+                                                            on_batch_input_hangup,
+                                                            batch_state);
+}
+
 int
 main (int    argc,
       char **argv)
 {
         state_t state = { 0 };
-        bool should_help, should_quit, should_ping, should_check_for_active_vt, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path;
+        batch_state_t batch_state = { 0 };
+        bool should_batch, should_show_statistics, should_help, should_quit, should_ping, should_check_for_active_vt, should_sysinit, should_ask_for_password, should_show_splash, should_hide_splash, should_wait, should_be_verbose, report_error, should_get_plugin_path;
         bool is_connected;
-        char *status, *chroot_dir, *ignore_keystroke;
+        char *status, *chroot_dir, *ignore_keystroke, *log_to_decode;
         int exit_code;
 
         exit_code = 0;
@@ -916,6 +1175,9 @@ main (int    argc,
                                         "update", "Tell boot daemon an update about boot progress", PLY_COMMAND_OPTION_TYPE_STRING,
                                         "details", "Tell boot daemon there were errors during boot", PLY_COMMAND_OPTION_TYPE_FLAG,
                                         "wait", "Wait for boot daemon to quit", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "batch", "Send newline separated commands from standard input over one connection", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "stats", "Show boot daemon statistics", PLY_COMMAND_OPTION_TYPE_FLAG,
+                                        "decode-log", "Print a structured boot log as text", PLY_COMMAND_OPTION_TYPE_STRING,
                                         NULL);
 
         ply_command_parser_add_command (state.command_parser,
@@ -1106,6 +1368,9 @@ main (int    argc,
                                         "update", &status,
                                         "wait", &should_wait,
                                         "details", &report_error,
+                                        "batch", &should_batch,
+                                        "stats", &should_show_statistics,
+                                        "decode-log", &log_to_decode,
                                         NULL);
 
         if (should_help || argc < 2) {
@@ -1133,6 +1398,15 @@ main (int    argc,
                 goto out;
         }
 
+        if (log_to_decode != NULL) {
+                if (!ply_logger_decode_file (log_to_decode, STDOUT_FILENO)) {
+                        ply_error ("plymouth: could not decode %s", log_to_decode);
+                        exit_code = 1;
+                }
+                free (log_to_decode);
+                goto out;
+        }
+
         is_connected = ply_boot_client_connect (state.client,
                                                 (ply_boot_client_disconnect_handler_t)
                                                 on_disconnect, &state);
@@ -1153,11 +1427,27 @@ main (int    argc,
                         ply_trace ("no need to wait");
                         goto out;
                 }
+                if (should_batch) {
+                        ply_trace ("batch failed");
+                        exit_code = 1;
+                        goto out;
+                }
+                if (should_show_statistics) {
+                        ply_trace ("stats failed");
+                        exit_code = 1;
+                        goto out;
+                }
         }
 
+        if (should_batch)
+                ply_boot_client_upgrade_protocol (state.client);
+
         ply_boot_client_attach_to_event_loop (state.client, state.loop);
 
-        if (should_show_splash) {
+        if (should_batch) {
+                batch_state.state = &state;
+                start_batch (&batch_state);
+        } else if (should_show_splash) {
                 ply_boot_client_tell_daemon_to_show_splash (state.client,
                                                             (ply_boot_client_response_handler_t)
                                                             on_success,
@@ -1191,6 +1481,12 @@ main (int    argc,
                                                           on_success,
                                                           (ply_boot_client_response_handler_t)
                                                           on_failure, &state);
+        } else if (should_show_statistics) {
+                ply_boot_client_ask_daemon_for_statistics (state.client,
+                                                           (ply_boot_client_answer_handler_t)
+                                                           on_statistics_answer,
+                                                           (ply_boot_client_response_handler_t)
+                                                           on_failure, &state);
         } else if (status != NULL) {
                 ply_boot_client_update_daemon (state.client, status,
                                                (ply_boot_client_response_handler_t)
@@ -1240,6 +1536,8 @@ main (int    argc,
         exit_code = ply_event_loop_run (state.loop);
 
 out:
+        ply_buffer_free (batch_state.input);
+
         ply_boot_client_free (state.client);
 
         ply_event_loop_free (state.loop);
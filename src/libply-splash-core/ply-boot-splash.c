@@ -208,7 +208,7 @@ bool
 ply_boot_splash_load (ply_boot_splash_t *splash)
 {
         ply_key_file_t *key_file;
-        char *module_name;
+        const char *module_name;
         char *module_path;
 
         assert (splash != NULL);
@@ -222,11 +222,10 @@ ply_boot_splash_load (ply_boot_splash_t *splash)
                 return false;
         }
 
-        module_name = ply_key_file_get_value (key_file, "Plymouth Theme", "ModuleName");
+        module_name = ply_key_file_peek_value (key_file, "Plymouth Theme", "ModuleName");
 
         asprintf (&module_path, "%s%s.so",
                   splash->plugin_dir, module_name);
-        free (module_name);
 
         splash->module_handle = ply_open_module (module_path);
 
@@ -819,3 +818,31 @@ ply_boot_splash_uses_pixel_displays (ply_boot_splash_t *splash)
         return splash->plugin_interface->add_pixel_display != NULL;
 }
 
+void
+ply_boot_splash_append_statistics (ply_boot_splash_t *splash,
+                                   ply_buffer_t      *buffer)
+{
+        ply_list_node_t *node;
+        int head = 0;
+
+        assert (splash != NULL);
+        assert (buffer != NULL);
+
+        ply_list_foreach (splash->pixel_displays, node) {
+                ply_pixel_display_t *display = ply_list_node_get_data (node);
+
+                ply_buffer_append (buffer, "head %d: %lux%lu\n", head,
+                                   ply_pixel_display_get_width (display),
+                                   ply_pixel_display_get_height (display));
+                ply_buffer_append (buffer, "head %d frames drawn: %lu\n", head,
+                                   ply_pixel_display_get_number_of_frames_drawn (display));
+                ply_buffer_append (buffer, "head %d frames dropped: %lu\n", head,
+                                   ply_pixel_display_get_number_of_frames_dropped (display));
+                ply_buffer_append (buffer, "head %d draw time: %.3fs\n", head,
+                                   ply_pixel_display_get_draw_time (display));
+                ply_buffer_append (buffer, "head %d bytes flushed: %llu\n", head,
+                                   ply_pixel_display_get_number_of_bytes_flushed (display));
+                head++;
+        }
+}
+
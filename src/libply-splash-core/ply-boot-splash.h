@@ -97,6 +97,8 @@ void ply_boot_splash_become_idle (ply_boot_splash_t                *splash,
                                   ply_boot_splash_on_idle_handler_t idle_handler,
                                   void                             *user_data);
 bool ply_boot_splash_uses_pixel_displays (ply_boot_splash_t *splash);
+void ply_boot_splash_append_statistics (ply_boot_splash_t *splash,
+                                        ply_buffer_t      *buffer);
 
 
 #endif
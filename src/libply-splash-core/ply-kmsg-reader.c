@@ -23,6 +23,7 @@
 #include "ply-event-loop.h"
 #include "ply-logger.h"
 #include "ply-utils.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,6 +36,14 @@
 #define LOG_LINE_MAX 8192
 #endif
 
+#ifndef PLY_KMSG_READER_MAX_MESSAGES
+#define PLY_KMSG_READER_MAX_MESSAGES 512
+#endif
+
+#ifndef PLY_KMSG_READER_MAX_RECORDS_PER_BATCH
+#define PLY_KMSG_READER_MAX_RECORDS_PER_BATCH 256
+#endif
+
 #define from_hex(c)             (isdigit (c) ? c - '0' : tolower (c) - 'a' + 10)
 
 size_t
@@ -63,136 +72,204 @@ unhexmangle_to_buffer (const char *s,
         return buf - buf0 + 1;
 }
 
-int
-handle_kmsg_message (ply_kmsg_reader_t *kmsg_reader,
-                     int                fd)
+static void
+ply_kmsg_reader_add_message (ply_kmsg_reader_t  *kmsg_reader,
+                             int                 priority,
+                             int                 facility,
+                             uint64_t            sequence,
+                             unsigned long long  timestamp,
+                             const char         *format_begin,
+                             const char         *line)
 {
-        ssize_t bytes_read;
-        char read_buffer[LOG_LINE_MAX] = "";
-        int current_log_level = LOG_ERR, default_log_level = LOG_WARNING;
+        kmsg_message_t *kmsg_message;
+        size_t index;
 
-        ply_get_kmsg_log_levels (&current_log_level,
-                                 &default_log_level);
+        if (kmsg_reader->number_of_messages < PLY_KMSG_READER_MAX_MESSAGES) {
+                index = (kmsg_reader->first_message + kmsg_reader->number_of_messages) % PLY_KMSG_READER_MAX_MESSAGES;
+                kmsg_reader->number_of_messages++;
+        } else {
+                index = kmsg_reader->first_message;
+                kmsg_reader->first_message = (kmsg_reader->first_message + 1) % PLY_KMSG_READER_MAX_MESSAGES;
+                free (kmsg_reader->kmsg_messages[index].message);
+        }
 
-        bytes_read = read (fd, read_buffer, sizeof(read_buffer) - 1);
-        if (bytes_read > 0) {
-                ply_terminal_style_attributes_t bold_enabled = PLY_TERMINAL_ATTRIBUTE_NO_BOLD;
-                ply_terminal_color_t color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_DEFAULT;
-                char *fields, *field_prefix, *field_sequence, *field_timestamp, *message, *message_substr, *msgptr, *saveptr, *format_begin, *new_message;
-                int prefix, priority, facility;
-                uint64_t sequence;
-                unsigned long long timestamp;
-                kmsg_message_t *kmsg_message;
+        kmsg_message = &kmsg_reader->kmsg_messages[index];
+        kmsg_message->priority = priority;
+        kmsg_message->facility = facility;
+        kmsg_message->sequence = sequence;
+        kmsg_message->timestamp = timestamp;
+        asprintf (&kmsg_message->message, "%s%s%s", format_begin, line, "\033[0m");
 
-                fields = strtok_r (read_buffer, ";", &message);
+        ply_buffer_append_bytes (kmsg_reader->batch, kmsg_message->message, strlen (kmsg_message->message));
+        ply_buffer_append_bytes (kmsg_reader->batch, "\n", 1);
+}
 
-                /* Messages end in \n, any following lines are machine readable. Actual multiline messages are expanded with unhexmangle_to_buffer */
-                msgptr = strchr (message, '\n');
-                if (*msgptr && *msgptr != '\n')
-                        msgptr--;
+static void
+ply_kmsg_reader_handle_record (ply_kmsg_reader_t *kmsg_reader,
+                               char              *record,
+                               int                current_log_level,
+                               int                default_log_level)
+{
+        ply_terminal_style_attributes_t bold_enabled = PLY_TERMINAL_ATTRIBUTE_NO_BOLD;
+        ply_terminal_color_t color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_DEFAULT;
+        char *fields, *field_prefix, *field_sequence, *field_timestamp, *message, *message_substr, *msgptr, *saveptr;
+        char format_begin[32];
+        int prefix, priority, facility;
+        uint64_t sequence;
+        unsigned long long timestamp;
 
-                unhexmangle_to_buffer (message, (char *) message, msgptr - message + 1);
+        fields = strtok_r (record, ";", &message);
 
-                field_prefix = strtok_r (fields, ",", &fields);
-                field_sequence = strtok_r (fields, ",", &fields);
-                field_timestamp = strtok_r (fields, ",", &fields);
+        if (message == NULL || *message == '\0')
+                return;
 
-                prefix = atoi (field_prefix);
-                sequence = strtoull (field_sequence, NULL, 0);
-                timestamp = strtoull (field_timestamp, NULL, 0);
+        /* Messages end in \n, any following lines are machine readable. Actual multiline messages are expanded with unhexmangle_to_buffer */
+        msgptr = strchr (message, '\n');
+        if (msgptr == NULL)
+                msgptr = message + strlen (message);
+        else if (*msgptr && *msgptr != '\n')
+                msgptr--;
 
-                if (prefix > 0) {
-                        priority = LOG_PRI (prefix);
-                        facility = LOG_FAC (prefix);
-                } else {
-                        priority = default_log_level;
-                        facility = LOG_USER;
-                }
+        unhexmangle_to_buffer (message, (char *) message, msgptr - message + 1);
 
-                if (priority > current_log_level)
-                        return 0;
+        field_prefix = strtok_r (fields, ",", &fields);
+        field_sequence = strtok_r (fields, ",", &fields);
+        field_timestamp = strtok_r (fields, ",", &fields);
 
-                if (priority < LOG_ALERT)
-                        bold_enabled = PLY_TERMINAL_ATTRIBUTE_BOLD;
+        if (field_prefix == NULL || field_sequence == NULL || field_timestamp == NULL)
+                return;
 
-                switch (priority) {
-                case LOG_EMERG:
-                case LOG_ALERT:
-                case LOG_CRIT:
-                case LOG_ERR:
-                        color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_RED;
-                        break;
-                case LOG_WARNING:
-                        color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_BROWN;
-                        break;
-                case LOG_NOTICE:
-                        color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_GREEN;
-                        break;
-                }
-                asprintf (&format_begin, "\033[0;%i;%im", bold_enabled, color);
+        prefix = atoi (field_prefix);
+        sequence = strtoull (field_sequence, NULL, 0);
+        timestamp = strtoull (field_timestamp, NULL, 0);
+
+        /* The kernel overwrote anything we skipped over before we got to it.
+         * Whatever it overwrote before the first read isn't ours to count.
+         */
+        if (kmsg_reader->has_read_record && sequence > kmsg_reader->next_sequence)
+                kmsg_reader->number_of_dropped_messages += sequence - kmsg_reader->next_sequence;
+        kmsg_reader->next_sequence = sequence + 1;
+        kmsg_reader->has_read_record = true;
+
+        if (prefix > 0) {
+                priority = LOG_PRI (prefix);
+                facility = LOG_FAC (prefix);
+        } else {
+                priority = default_log_level;
+                facility = LOG_USER;
+        }
+
+        if (priority > current_log_level)
+                return;
+
+        if (priority < LOG_ALERT)
+                bold_enabled = PLY_TERMINAL_ATTRIBUTE_BOLD;
+
+        switch (priority) {
+        case LOG_EMERG:
+        case LOG_ALERT:
+        case LOG_CRIT:
+        case LOG_ERR:
+                color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_RED;
+                break;
+        case LOG_WARNING:
+                color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_BROWN;
+                break;
+        case LOG_NOTICE:
+                color = PLY_TERMINAL_ATTRIBUTE_FOREGROUND_COLOR_OFFSET + PLY_TERMINAL_COLOR_GREEN;
+                break;
+        }
+        snprintf (format_begin, sizeof(format_begin), "\033[0;%i;%im", bold_enabled, color);
+
+        message_substr = strtok_r (message, "\n", &saveptr);
+        while (message_substr != NULL) {
+                ply_kmsg_reader_add_message (kmsg_reader, priority, facility,
+                                             sequence, timestamp,
+                                             format_begin, message_substr);
+                message_substr = strtok_r (NULL, "\n", &saveptr);
+        }
+}
 
-                message_substr = strtok_r (message, "\n", &saveptr);
-                while (message_substr != NULL) {
-                        kmsg_message = calloc (1, sizeof(kmsg_message_t));
+/* Each read of /dev/kmsg returns one record, so keep reading until the
+ * kernel has nothing more for us and hand everything over at once. The
+ * batch is capped so a flood of messages can't starve the animation;
+ * the rest gets picked up on the next pass through the event loop.
+ */
+static void
+handle_kmsg_message (ply_kmsg_reader_t *kmsg_reader,
+                     int                fd)
+{
+        char read_buffer[LOG_LINE_MAX];
+        int current_log_level = LOG_ERR, default_log_level = LOG_WARNING;
+        bool should_stop = false;
+        int i;
 
-                        kmsg_message->priority = priority;
-                        kmsg_message->facility = facility;
-                        kmsg_message->sequence = sequence;
-                        kmsg_message->timestamp = timestamp;
+        ply_get_kmsg_log_levels (&current_log_level,
+                                 &default_log_level);
 
-                        asprintf (&new_message, "%s%s%s", format_begin, message_substr, "\033[0m");
-                        kmsg_message->message = strndup (new_message, strlen (new_message));
+        for (i = 0; i < PLY_KMSG_READER_MAX_RECORDS_PER_BATCH; i++) {
+                ssize_t bytes_read;
 
-                        ply_trigger_pull (kmsg_reader->kmsg_trigger, kmsg_message);
-                        ply_list_append_data (kmsg_reader->kmsg_messages, kmsg_message);
-                        free (new_message);
+                bytes_read = read (fd, read_buffer, sizeof(read_buffer) - 1);
 
-                        message_substr = strtok_r (NULL, "\n", &saveptr);
+                if (bytes_read > 0) {
+                        read_buffer[bytes_read] = '\0';
+                        ply_kmsg_reader_handle_record (kmsg_reader, read_buffer,
+                                                       current_log_level,
+                                                       default_log_level);
+                        continue;
                 }
-                free (format_begin);
 
-                return 0;
-        } else {
-                ply_event_loop_stop_watching_fd (ply_event_loop_get_default (), kmsg_reader->fd_watch);
-                close (kmsg_reader->kmsg_fd);
-                return -1;
+                /* EPIPE means records were overwritten since the last read,
+                 * the next one picks up at the oldest record still around
+                 */
+                if (bytes_read < 0 && (errno == EINTR || errno == EPIPE))
+                        continue;
+
+                if (bytes_read < 0 && errno == EAGAIN)
+                        break;
+
+                should_stop = true;
+                break;
         }
+
+        if (ply_buffer_get_size (kmsg_reader->batch) > 0) {
+                ply_trigger_pull (kmsg_reader->kmsg_trigger, kmsg_reader->batch);
+                ply_buffer_clear (kmsg_reader->batch);
+        }
+
+        if (should_stop)
+                ply_kmsg_reader_stop (kmsg_reader);
 }
 
 ply_kmsg_reader_t *
 ply_kmsg_reader_new (void)
 {
         ply_kmsg_reader_t *kmsg_reader = calloc (1, sizeof(ply_kmsg_reader_t));
+        kmsg_reader->kmsg_fd = -1;
         kmsg_reader->kmsg_trigger = ply_trigger_new (NULL);
-        kmsg_reader->kmsg_messages = ply_list_new ();
+        kmsg_reader->kmsg_messages = calloc (PLY_KMSG_READER_MAX_MESSAGES, sizeof(kmsg_message_t));
+        kmsg_reader->batch = ply_buffer_new ();
 
         return kmsg_reader;
 }
 
-void
-ply_kmsg_message_free (kmsg_message_t *kmsg_message)
-{
-        if (kmsg_message == NULL)
-                return;
-
-        free (kmsg_message->message);
-        free (kmsg_message);
-}
-
 void
 ply_kmsg_reader_free (ply_kmsg_reader_t *kmsg_reader)
 {
-        ply_list_node_t *node;
-        kmsg_message_t *kmsg_message;
+        size_t i;
 
         if (kmsg_reader == NULL)
                 return;
 
-        ply_list_foreach (kmsg_reader->kmsg_messages, node) {
-                kmsg_message = ply_list_node_get_data (node);
-                ply_kmsg_message_free (kmsg_message);
+        for (i = 0; i < kmsg_reader->number_of_messages; i++) {
+                size_t index = (kmsg_reader->first_message + i) % PLY_KMSG_READER_MAX_MESSAGES;
+
+                free (kmsg_reader->kmsg_messages[index].message);
         }
+        free (kmsg_reader->kmsg_messages);
 
+        ply_buffer_free (kmsg_reader->batch);
         ply_trigger_free (kmsg_reader->kmsg_trigger);
         free (kmsg_reader);
 }
@@ -234,3 +311,27 @@ ply_kmsg_reader_watch_for_messages (ply_kmsg_reader_t                *kmsg_reade
                                  message_handler,
                                  user_data);
 }
+
+size_t
+ply_kmsg_reader_get_number_of_messages (ply_kmsg_reader_t *kmsg_reader)
+{
+        return kmsg_reader->number_of_messages;
+}
+
+kmsg_message_t *
+ply_kmsg_reader_get_message (ply_kmsg_reader_t *kmsg_reader,
+                             size_t             index)
+{
+        if (index >= kmsg_reader->number_of_messages)
+                return NULL;
+
+        index = (kmsg_reader->first_message + index) % PLY_KMSG_READER_MAX_MESSAGES;
+
+        return &kmsg_reader->kmsg_messages[index];
+}
+
+unsigned long
+ply_kmsg_reader_get_number_of_dropped_messages (ply_kmsg_reader_t *kmsg_reader)
+{
+        return kmsg_reader->number_of_dropped_messages;
+}
@@ -19,6 +19,7 @@
 #ifndef PLY_KMSG_READER_H
 #define PLY_KMSG_READER_H
 
+#include "ply-buffer.h"
 #include "ply-list.h"
 #include "ply-boot-splash.h"
 #include <sys/syslog.h>
@@ -44,11 +45,24 @@ struct _ply_kmsg_reader
         int             kmsg_fd;
         ply_fd_watch_t *fd_watch;
         ply_trigger_t  *kmsg_trigger;
-        ply_list_t     *kmsg_messages;
+
+        /* The most recent messages, oldest first starting at first_message */
+        kmsg_message_t *kmsg_messages;
+        size_t          first_message;
+        size_t          number_of_messages;
+
+        ply_buffer_t   *batch;
+        uint64_t        next_sequence;
+        unsigned long   number_of_dropped_messages;
+
+        uint32_t        has_read_record : 1;
 };
 
+/* Called once per batch of new messages, with all of them formatted for
+ * the terminal and separated by newlines
+ */
 typedef void (* ply_kmsg_reader_message_handler_t) (void *,
-                                                    kmsg_message_t *);
+                                                    ply_buffer_t *);
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_kmsg_reader_t *ply_kmsg_reader_new (void);
@@ -58,6 +72,10 @@ void ply_kmsg_reader_stop (ply_kmsg_reader_t *kmsg_reader);
 void ply_kmsg_reader_watch_for_messages (ply_kmsg_reader_t                *kmsg_reader,
                                          ply_kmsg_reader_message_handler_t message_handler,
                                          void                             *user_data);
+size_t ply_kmsg_reader_get_number_of_messages (ply_kmsg_reader_t *kmsg_reader);
+kmsg_message_t *ply_kmsg_reader_get_message (ply_kmsg_reader_t *kmsg_reader,
+                                             size_t             index);
+unsigned long ply_kmsg_reader_get_number_of_dropped_messages (ply_kmsg_reader_t *kmsg_reader);
 
 #endif //PLY_HIDE_FUNCTION_DECLARATIONS
 
@@ -25,6 +25,7 @@
 #include "ply-list.h"
 #include "ply-pixel-buffer.h"
 #include "ply-logger.h"
+#include "ply-utils.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -38,6 +39,14 @@
 
 #define ALPHA_MASK 0xff000000
 
+/* Precision of the linear light values used to look up sRGB values */
+#ifndef LINEAR_TO_SRGB_TABLE_BITS
+#define LINEAR_TO_SRGB_TABLE_BITS 12
+#endif
+#define LINEAR_TO_SRGB_TABLE_SIZE (1 << LINEAR_TO_SRGB_TABLE_BITS)
+
+#define DITHER_MATRIX_SIZE 8
+
 struct _ply_pixel_buffer
 {
         uint32_t                   *bytes;
@@ -154,6 +163,159 @@ make_pixel_value_translucent (uint32_t pixel_value,
         return (alpha << 24) | (red << 16) | (green << 8) | blue;
 }
 
+/* With plymouth.linear-blending on the kernel command line, gradients
+ * and fades are mixed in linear light instead of directly in sRGB, and
+ * gradients get ordered dithering. The conversions go through tables
+ * filled on first use: sRGB bytes to 16-bit linear values, and linear
+ * values back to sRGB in 8.8 fixed point so the dithering can use the
+ * fraction.
+ */
+static uint16_t srgb_to_linear_table[256];
+static uint16_t linear_to_srgb_table[LINEAR_TO_SRGB_TABLE_SIZE];
+
+/* 8x8 Bayer matrix, scaled to thresholds for the fractional byte */
+static const uint8_t dither_matrix[DITHER_MATRIX_SIZE][DITHER_MATRIX_SIZE] = {
+        {   2, 130,  34, 162,  10, 138,  42, 170 },
+        { 194,  66, 226,  98, 202,  74, 234, 106 },
+        {  50, 178,  18, 146,  58, 186,  26, 154 },
+        { 242, 114, 210,  82, 250, 122, 218,  90 },
+        {  14, 142,  46, 174,   6, 134,  38, 166 },
+        { 206,  78, 238, 110, 198,  70, 230, 102 },
+        {  62, 190,  30, 158,  54, 182,  22, 150 },
+        { 254, 126, 222,  94, 246, 118, 214,  86 }
+};
+
+static bool
+linear_blending_is_enabled (void)
+{
+        static enum { LINEAR_BLENDING_UNKNOWN = -1,
+                      LINEAR_BLENDING_DISABLED,
+                      LINEAR_BLENDING_ENABLED } linear_blending = LINEAR_BLENDING_UNKNOWN;
+        int i;
+
+        if (linear_blending != LINEAR_BLENDING_UNKNOWN)
+                return linear_blending == LINEAR_BLENDING_ENABLED;
+
+        if (!ply_kernel_command_line_has_argument ("plymouth.linear-blending")) {
+                linear_blending = LINEAR_BLENDING_DISABLED;
+                return false;
+        }
+
+        ply_trace ("blending in linear light");
+
+        for (i = 0; i < 256; i++) {
+                double value = i / 255.0;
+
+                if (value <= 0.04045)
+                        value /= 12.92;
+                else
+                        value = pow ((value + 0.055) / 1.055, 2.4);
+
+                srgb_to_linear_table[i] = (uint16_t) (value * 65535.0 + 0.5);
+        }
+
+        for (i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; i++) {
+                double value = (double) i / (LINEAR_TO_SRGB_TABLE_SIZE - 1);
+
+                if (value <= 0.0031308)
+                        value *= 12.92;
+                else
+                        value = 1.055 * pow (value, 1 / 2.4) - 0.055;
+
+                linear_to_srgb_table[i] = (uint16_t) (value * 255.0 * 256.0 + 0.5);
+        }
+
+        linear_blending = LINEAR_BLENDING_ENABLED;
+        return true;
+}
+
+static inline uint_fast32_t
+convert_linear_value_to_srgb (uint_fast32_t value)
+{
+        return linear_to_srgb_table[value >> (16 - LINEAR_TO_SRGB_TABLE_BITS)];
+}
+
+/* Mixes two opaque pixels in linear light, the first at the given opacity */
+__attribute__((__pure__))
+static inline uint32_t
+mix_opaque_pixel_values_in_linear_light (uint32_t pixel_value_1,
+                                         uint32_t pixel_value_2,
+                                         uint8_t  opacity)
+{
+        uint32_t pixel_value = 0xff000000;
+        int shift;
+
+        for (shift = 0; shift < 24; shift += 8) {
+                uint_fast32_t value;
+
+                value = srgb_to_linear_table[(uint8_t) (pixel_value_1 >> shift)] * opacity +
+                        srgb_to_linear_table[(uint8_t) (pixel_value_2 >> shift)] * (255 - opacity);
+                value = (value + 127) / 255;
+                value = (convert_linear_value_to_srgb (value) + 0x80) >> 8;
+
+                pixel_value |= value << shift;
+        }
+
+        return pixel_value;
+}
+
+__attribute__((__pure__))
+static inline uint32_t
+blend_pixel_value_at_opacity (uint32_t pixel_value,
+                              uint32_t old_pixel_value,
+                              uint8_t  opacity,
+                              bool     in_linear_light)
+{
+        if (in_linear_light &&
+            (pixel_value >> 24) == 0xff &&
+            (old_pixel_value >> 24) == 0xff)
+                return mix_opaque_pixel_values_in_linear_light (pixel_value, old_pixel_value, opacity);
+
+        pixel_value = make_pixel_value_translucent (pixel_value, opacity);
+        return blend_two_pixel_values (pixel_value, old_pixel_value);
+}
+
+/* Blends a row of source pixels onto a row of an upright buffer.  The
+ * opacity has already been turned into a byte, so everything here is
+ * integer math; fully transparent source pixels are skipped and fully
+ * opaque ones are stored without reading the destination.
+ */
+static inline void
+blend_row_of_pixel_values (uint32_t       *destination,
+                           const uint32_t *source,
+                           unsigned long   width)
+{
+        unsigned long i;
+
+        for (i = 0; i < width; i++) {
+                uint32_t pixel_value = source[i];
+
+                if ((pixel_value >> 24) == 0xff)
+                        destination[i] = pixel_value;
+                else if ((pixel_value >> 24) != 0x00)
+                        destination[i] = blend_two_pixel_values (pixel_value, destination[i]);
+        }
+}
+
+static inline void
+blend_row_of_pixel_values_at_opacity (uint32_t       *destination,
+                                      const uint32_t *source,
+                                      unsigned long   width,
+                                      uint8_t         opacity,
+                                      bool            in_linear_light)
+{
+        unsigned long i;
+
+        for (i = 0; i < width; i++) {
+                uint32_t pixel_value = source[i];
+
+                if ((pixel_value >> 24) == 0x00)
+                        continue;
+
+                destination[i] = blend_pixel_value_at_opacity (pixel_value, destination[i], opacity, in_linear_light);
+        }
+}
+
 static inline void ply_pixel_buffer_set_pixel (ply_pixel_buffer_t *buffer,
                                                int                 x,
                                                int                 y,
@@ -461,6 +623,67 @@ ply_pixel_buffer_get_updated_areas (ply_pixel_buffer_t *buffer)
         return buffer->updated_areas;
 }
 
+/* Same gradient as ply_pixel_buffer_fill_with_gradient, but interpolated
+ * in linear light and dithered with the Bayer matrix. Since the colour
+ * only changes per row, each row is a repeating run of
+ * DITHER_MATRIX_SIZE pixels.
+ */
+static void
+ply_pixel_buffer_fill_area_with_linear_gradient (ply_pixel_buffer_t *buffer,
+                                                 ply_rectangle_t    *cropped_area,
+                                                 uint32_t            start,
+                                                 uint32_t            end)
+{
+        uint32_t start_values[3], end_values[3];
+        unsigned long x, y;
+        int i;
+
+        for (i = 0; i < 3; i++) {
+                start_values[i] = srgb_to_linear_table[(uint8_t) (start >> (16 - 8 * i))];
+                end_values[i] = srgb_to_linear_table[(uint8_t) (end >> (16 - 8 * i))];
+        }
+
+        for (y = cropped_area->y; y < cropped_area->y + cropped_area->height; y++) {
+                uint32_t shaded_set[DITHER_MATRIX_SIZE];
+                uint_fast32_t srgb_values[3];
+                int64_t position;
+
+                position = ((int64_t) (y - buffer->area.y) << 16) / buffer->area.height;
+
+                for (i = 0; i < 3; i++) {
+                        int64_t value;
+
+                        value = start_values[i] + (((int64_t) end_values[i] - start_values[i]) * position >> 16);
+                        srgb_values[i] = convert_linear_value_to_srgb (value);
+                }
+
+                for (x = 0; x < DITHER_MATRIX_SIZE; x++) {
+                        uint_fast32_t threshold = dither_matrix[y % DITHER_MATRIX_SIZE][(cropped_area->x + x) % DITHER_MATRIX_SIZE];
+
+                        shaded_set[x] = 0xff000000 |
+                                        ((srgb_values[0] + threshold) >> 8) << 16 |
+                                        ((srgb_values[1] + threshold) >> 8) << 8 |
+                                        ((srgb_values[2] + threshold) >> 8);
+                }
+
+                if (buffer->device_rotation == PLY_PIXEL_BUFFER_ROTATE_UPRIGHT) {
+                        uint32_t *ptr = &buffer->bytes[y * buffer->area.width + cropped_area->x];
+
+                        for (x = cropped_area->width; x >= DITHER_MATRIX_SIZE; x -= DITHER_MATRIX_SIZE) {
+                                memcpy (ptr, (void *) shaded_set, DITHER_MATRIX_SIZE * sizeof(uint32_t));
+                                ptr += DITHER_MATRIX_SIZE;
+                        }
+
+                        memcpy (ptr, (void *) shaded_set, x * sizeof(uint32_t));
+                } else {
+                        for (x = 0; x < cropped_area->width; x++) {
+                                ply_pixel_buffer_set_pixel (buffer, cropped_area->x + x, y,
+                                                            shaded_set[x % DITHER_MATRIX_SIZE]);
+                        }
+                }
+        }
+}
+
 void
 ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
                                      ply_rectangle_t    *fill_area,
@@ -523,6 +746,12 @@ ply_pixel_buffer_fill_with_gradient (ply_pixel_buffer_t *buffer,
 
         ply_pixel_buffer_crop_area_to_clip_area (buffer, fill_area, &cropped_area);
 
+        if (linear_blending_is_enabled ()) {
+                ply_pixel_buffer_fill_area_with_linear_gradient (buffer, &cropped_area, start, end);
+                ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
+                return;
+        }
+
         red = (start << RED_SHIFT) & COLOR_MASK;
         green = (start << GREEN_SHIFT) & COLOR_MASK;
         blue = (start << BLUE_SHIFT) & COLOR_MASK;
@@ -706,6 +935,7 @@ ply_pixel_buffer_fill_with_argb32_data_at_opacity_with_clip_and_scale (ply_pixel
 {
         unsigned long row, column;
         uint8_t opacity_as_byte;
+        bool in_linear_light;
         ply_rectangle_t logical_fill_area;
         ply_rectangle_t cropped_area;
         unsigned long x;
@@ -737,10 +967,35 @@ ply_pixel_buffer_fill_with_argb32_data_at_opacity_with_clip_and_scale (ply_pixel
                 return;
 
         opacity_as_byte = (uint8_t) (opacity * 255.0);
+
+        /* Nothing shows through at zero opacity */
+        if (opacity_as_byte == 0)
+                return;
+
+        in_linear_light = opacity_as_byte != 0xff && linear_blending_is_enabled ();
+
         scale_factor = (double) scale / buffer->device_scale;
         x = cropped_area.x;
         y = cropped_area.y;
 
+        /* Fast path to whole rows if we need no scaling or rotation */
+        if (buffer->device_scale == scale &&
+            buffer->device_rotation == PLY_PIXEL_BUFFER_ROTATE_UPRIGHT) {
+                for (row = y; row < y + cropped_area.height; row++) {
+                        uint32_t *destination = &buffer->bytes[row * buffer->area.width + x];
+                        uint32_t *source = &data[fill_area->width * (row - fill_area->y) + x - fill_area->x];
+
+                        if (opacity_as_byte == 0xff)
+                                blend_row_of_pixel_values (destination, source, cropped_area.width);
+                        else
+                                blend_row_of_pixel_values_at_opacity (destination, source, cropped_area.width,
+                                                                      opacity_as_byte, in_linear_light);
+                }
+
+                ply_pixel_buffer_add_updated_area (buffer, &cropped_area);
+                return;
+        }
+
         /* column, row are the point we want to write into, in
          * pixel_buffer coordinate space (device pixels)
          *
@@ -764,10 +1019,18 @@ ply_pixel_buffer_fill_with_argb32_data_at_opacity_with_clip_and_scale (ply_pixel
                         if ((pixel_value >> 24) == 0x00)
                                 continue;
 
-                        pixel_value = make_pixel_value_translucent (pixel_value, opacity_as_byte);
-                        ply_pixel_buffer_blend_value_at_pixel (buffer,
-                                                               column, row,
-                                                               pixel_value);
+                        if (opacity_as_byte == 0xff) {
+                                ply_pixel_buffer_blend_value_at_pixel (buffer,
+                                                                       column, row,
+                                                                       pixel_value);
+                        } else {
+                                uint32_t old_pixel_value;
+
+                                old_pixel_value = ply_pixel_buffer_get_pixel (buffer, column, row);
+                                pixel_value = blend_pixel_value_at_opacity (pixel_value, old_pixel_value,
+                                                                            opacity_as_byte, in_linear_light);
+                                ply_pixel_buffer_set_pixel (buffer, column, row, pixel_value);
+                        }
                 }
         }
 
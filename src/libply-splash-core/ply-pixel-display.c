@@ -56,6 +56,11 @@ struct _ply_pixel_display
         void                            *draw_handler_user_data;
 
         int                              pause_count;
+
+        unsigned long                    number_of_frames_drawn;
+        unsigned long                    number_of_frames_dropped;
+        unsigned long long               number_of_bytes_flushed;
+        double                           draw_time;
 };
 
 ply_pixel_display_t *
@@ -115,9 +120,24 @@ ply_pixel_display_get_device_scale (ply_pixel_display_t *display)
 static void
 ply_pixel_display_flush (ply_pixel_display_t *display)
 {
+        ply_pixel_buffer_t *pixel_buffer;
+        ply_region_t *updated_areas;
+        ply_list_node_t *node;
+
         if (display->pause_count > 0)
                 return;
 
+        pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
+                                                         display->head);
+        updated_areas = ply_pixel_buffer_get_updated_areas (pixel_buffer);
+
+        ply_list_foreach (ply_region_get_rectangle_list (updated_areas), node) {
+                ply_rectangle_t *area = ply_list_node_get_data (node);
+
+                display->number_of_bytes_flushed +=
+                        (unsigned long long) area->width * area->height * sizeof(uint32_t);
+        }
+
         ply_renderer_flush_head (display->renderer, display->head);
 }
 
@@ -151,8 +171,19 @@ ply_pixel_display_draw_area (ply_pixel_display_t *display,
         pixel_buffer = ply_renderer_get_buffer_for_head (display->renderer,
                                                          display->head);
 
+        /* Frames drawn while updates are paused never reach the screen
+         * on their own, so they're counted as dropped
+         */
+        if (display->pause_count > 0)
+                display->number_of_frames_dropped++;
+        else
+                display->number_of_frames_drawn++;
+
         if (display->draw_handler != NULL) {
                 ply_rectangle_t clip_area;
+                double start_time;
+
+                start_time = ply_get_timestamp ();
 
                 clip_area.x = x;
                 clip_area.y = y;
@@ -163,6 +194,8 @@ ply_pixel_display_draw_area (ply_pixel_display_t *display,
                                        pixel_buffer,
                                        x, y, width, height, display);
                 ply_pixel_buffer_pop_clip_area (pixel_buffer);
+
+                display->draw_time += ply_get_timestamp () - start_time;
         }
 
         ply_pixel_display_flush (display);
@@ -188,3 +221,26 @@ ply_pixel_display_set_draw_handler (ply_pixel_display_t             *display,
         display->draw_handler_user_data = user_data;
 }
 
+unsigned long
+ply_pixel_display_get_number_of_frames_drawn (ply_pixel_display_t *display)
+{
+        return display->number_of_frames_drawn;
+}
+
+unsigned long
+ply_pixel_display_get_number_of_frames_dropped (ply_pixel_display_t *display)
+{
+        return display->number_of_frames_dropped;
+}
+
+unsigned long long
+ply_pixel_display_get_number_of_bytes_flushed (ply_pixel_display_t *display)
+{
+        return display->number_of_bytes_flushed;
+}
+
+double
+ply_pixel_display_get_draw_time (ply_pixel_display_t *display)
+{
+        return display->draw_time;
+}
@@ -66,6 +66,11 @@ void ply_pixel_display_draw_area (ply_pixel_display_t *display,
 void ply_pixel_display_pause_updates (ply_pixel_display_t *display);
 void ply_pixel_display_unpause_updates (ply_pixel_display_t *display);
 
+unsigned long ply_pixel_display_get_number_of_frames_drawn (ply_pixel_display_t *display);
+unsigned long ply_pixel_display_get_number_of_frames_dropped (ply_pixel_display_t *display);
+unsigned long long ply_pixel_display_get_number_of_bytes_flushed (ply_pixel_display_t *display);
+double ply_pixel_display_get_draw_time (ply_pixel_display_t *display);
+
 #endif
 
 #endif /* PLY_PIXEL_DISPLAY_H */
@@ -0,0 +1,256 @@
+/* ply-pixel-format.c - conversion of argb32 pixel rows to device formats
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+#include "ply-pixel-format.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ply-utils.h"
+
+/* Reduces an 8 bit channel to its top bits, diffusing the rounding error
+ * into the next pixel.  This is the same dithering the frame buffer
+ * renderer does for arbitrary layouts, with the shifts known at compile
+ * time.
+ */
+static inline uint32_t
+dither_channel (int      value,
+                int      bits,
+                int32_t *error)
+{
+        int original_value;
+        uint8_t quantized_value, new_value;
+        int i;
+
+        original_value = value - *error;
+        quantized_value = CLAMP (original_value, 0, 255) >> (8 - bits);
+
+        new_value = quantized_value << (8 - bits);
+        for (i = bits; i < 8; i <<= 1) {
+                new_value |= new_value >> i;
+        }
+
+        *error = new_value - original_value;
+
+        return quantized_value;
+}
+
+static inline uint32_t
+expand_channel_to_10_bits (uint32_t value)
+{
+        return (value << 2) | (value >> 6);
+}
+
+static void
+convert_row_to_xbgr8888 (const uint32_t            *src,
+                         void                      *dst,
+                         unsigned long              width,
+                         ply_pixel_format_dither_t *dither)
+{
+        uint32_t *pixels = dst;
+        unsigned long x;
+
+        for (x = 0; x < width; x++) {
+                uint32_t pixel_value = src[x];
+
+                pixels[x] = (pixel_value & 0xff00ff00)
+                            | ((pixel_value >> 16) & 0xff)
+                            | ((pixel_value & 0xff) << 16);
+        }
+}
+
+static void
+convert_row_to_rgb565 (const uint32_t            *src,
+                       void                      *dst,
+                       unsigned long              width,
+                       ply_pixel_format_dither_t *dither)
+{
+        uint16_t *pixels = dst;
+        unsigned long x;
+
+        for (x = 0; x < width; x++) {
+                uint32_t pixel_value = src[x];
+                uint32_t r, g, b;
+
+                r = dither_channel ((pixel_value >> 16) & 0xff, 5, &dither->red);
+                g = dither_channel ((pixel_value >> 8) & 0xff, 6, &dither->green);
+                b = dither_channel (pixel_value & 0xff, 5, &dither->blue);
+
+                pixels[x] = (r << 11) | (g << 5) | b;
+        }
+}
+
+static void
+convert_row_to_bgr565 (const uint32_t            *src,
+                       void                      *dst,
+                       unsigned long              width,
+                       ply_pixel_format_dither_t *dither)
+{
+        uint16_t *pixels = dst;
+        unsigned long x;
+
+        for (x = 0; x < width; x++) {
+                uint32_t pixel_value = src[x];
+                uint32_t r, g, b;
+
+                r = dither_channel ((pixel_value >> 16) & 0xff, 5, &dither->red);
+                g = dither_channel ((pixel_value >> 8) & 0xff, 6, &dither->green);
+                b = dither_channel (pixel_value & 0xff, 5, &dither->blue);
+
+                pixels[x] = (b << 11) | (g << 5) | r;
+        }
+}
+
+static void
+convert_row_to_xrgb2101010 (const uint32_t            *src,
+                            void                      *dst,
+                            unsigned long              width,
+                            ply_pixel_format_dither_t *dither)
+{
+        uint32_t *pixels = dst;
+        unsigned long x;
+
+        for (x = 0; x < width; x++) {
+                uint32_t pixel_value = src[x];
+
+                pixels[x] = (expand_channel_to_10_bits ((pixel_value >> 16) & 0xff) << 20)
+                            | (expand_channel_to_10_bits ((pixel_value >> 8) & 0xff) << 10)
+                            | expand_channel_to_10_bits (pixel_value & 0xff);
+        }
+}
+
+static void
+convert_row_to_xbgr2101010 (const uint32_t            *src,
+                            void                      *dst,
+                            unsigned long              width,
+                            ply_pixel_format_dither_t *dither)
+{
+        uint32_t *pixels = dst;
+        unsigned long x;
+
+        for (x = 0; x < width; x++) {
+                uint32_t pixel_value = src[x];
+
+                pixels[x] = (expand_channel_to_10_bits (pixel_value & 0xff) << 20)
+                            | (expand_channel_to_10_bits ((pixel_value >> 8) & 0xff) << 10)
+                            | expand_channel_to_10_bits ((pixel_value >> 16) & 0xff);
+        }
+}
+
+ply_pixel_format_t
+ply_pixel_format_from_channel_layout (unsigned int bytes_per_pixel,
+                                      unsigned int red_offset,
+                                      unsigned int bits_for_red,
+                                      unsigned int green_offset,
+                                      unsigned int bits_for_green,
+                                      unsigned int blue_offset,
+                                      unsigned int bits_for_blue)
+{
+        if (bytes_per_pixel == 4 &&
+            bits_for_red == 8 && bits_for_green == 8 && bits_for_blue == 8 &&
+            green_offset == 8) {
+                if (red_offset == 16 && blue_offset == 0)
+                        return PLY_PIXEL_FORMAT_XRGB8888;
+                if (red_offset == 0 && blue_offset == 16)
+                        return PLY_PIXEL_FORMAT_XBGR8888;
+        }
+
+        if (bytes_per_pixel == 2 &&
+            bits_for_red == 5 && bits_for_green == 6 && bits_for_blue == 5 &&
+            green_offset == 5) {
+                if (red_offset == 11 && blue_offset == 0)
+                        return PLY_PIXEL_FORMAT_RGB565;
+                if (red_offset == 0 && blue_offset == 11)
+                        return PLY_PIXEL_FORMAT_BGR565;
+        }
+
+        if (bytes_per_pixel == 4 &&
+            bits_for_red == 10 && bits_for_green == 10 && bits_for_blue == 10 &&
+            green_offset == 10) {
+                if (red_offset == 20 && blue_offset == 0)
+                        return PLY_PIXEL_FORMAT_XRGB2101010;
+                if (red_offset == 0 && blue_offset == 20)
+                        return PLY_PIXEL_FORMAT_XBGR2101010;
+        }
+
+        return PLY_PIXEL_FORMAT_UNKNOWN;
+}
+
+const char *
+ply_pixel_format_get_name (ply_pixel_format_t format)
+{
+        switch (format) {
+        case PLY_PIXEL_FORMAT_XRGB8888:
+                return "XRGB8888";
+        case PLY_PIXEL_FORMAT_XBGR8888:
+                return "XBGR8888";
+        case PLY_PIXEL_FORMAT_RGB565:
+                return "RGB565";
+        case PLY_PIXEL_FORMAT_BGR565:
+                return "BGR565";
+        case PLY_PIXEL_FORMAT_XRGB2101010:
+                return "XRGB2101010";
+        case PLY_PIXEL_FORMAT_XBGR2101010:
+                return "XBGR2101010";
+        case PLY_PIXEL_FORMAT_UNKNOWN:
+                break;
+        }
+
+        return "unknown";
+}
+
+unsigned int
+ply_pixel_format_get_bytes_per_pixel (ply_pixel_format_t format)
+{
+        switch (format) {
+        case PLY_PIXEL_FORMAT_RGB565:
+        case PLY_PIXEL_FORMAT_BGR565:
+                return 2;
+        case PLY_PIXEL_FORMAT_XRGB8888:
+        case PLY_PIXEL_FORMAT_XBGR8888:
+        case PLY_PIXEL_FORMAT_XRGB2101010:
+        case PLY_PIXEL_FORMAT_XBGR2101010:
+                return 4;
+        case PLY_PIXEL_FORMAT_UNKNOWN:
+                break;
+        }
+
+        return 0;
+}
+
+ply_pixel_row_converter_t
+ply_pixel_format_get_row_converter (ply_pixel_format_t format)
+{
+        switch (format) {
+        case PLY_PIXEL_FORMAT_XBGR8888:
+                return convert_row_to_xbgr8888;
+        case PLY_PIXEL_FORMAT_RGB565:
+                return convert_row_to_rgb565;
+        case PLY_PIXEL_FORMAT_BGR565:
+                return convert_row_to_bgr565;
+        case PLY_PIXEL_FORMAT_XRGB2101010:
+                return convert_row_to_xrgb2101010;
+        case PLY_PIXEL_FORMAT_XBGR2101010:
+                return convert_row_to_xbgr2101010;
+        case PLY_PIXEL_FORMAT_XRGB8888:
+        case PLY_PIXEL_FORMAT_UNKNOWN:
+                break;
+        }
+
+        return NULL;
+}
@@ -0,0 +1,72 @@
+/* ply-pixel-format.h - conversion of argb32 pixel rows to device formats
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+#ifndef PLY_PIXEL_FORMAT_H
+#define PLY_PIXEL_FORMAT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Formats are named after the channel order in the native endian pixel
+ * value, most significant bits first, like the DRM fourcc formats they
+ * correspond to.
+ */
+typedef enum
+{
+        PLY_PIXEL_FORMAT_UNKNOWN = 0,
+        PLY_PIXEL_FORMAT_XRGB8888,
+        PLY_PIXEL_FORMAT_XBGR8888,
+        PLY_PIXEL_FORMAT_RGB565,
+        PLY_PIXEL_FORMAT_BGR565,
+        PLY_PIXEL_FORMAT_XRGB2101010,
+        PLY_PIXEL_FORMAT_XBGR2101010,
+} ply_pixel_format_t;
+
+/* Error carried from one pixel to the next when a format has fewer than
+ * 8 bits per channel
+ */
+typedef struct
+{
+        int32_t red;
+        int32_t green;
+        int32_t blue;
+} ply_pixel_format_dither_t;
+
+typedef void (*ply_pixel_row_converter_t) (const uint32_t            *src,
+                                           void                      *dst,
+                                           unsigned long              width,
+                                           ply_pixel_format_dither_t *dither);
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_pixel_format_t ply_pixel_format_from_channel_layout (unsigned int bytes_per_pixel,
+                                                         unsigned int red_offset,
+                                                         unsigned int bits_for_red,
+                                                         unsigned int green_offset,
+                                                         unsigned int bits_for_green,
+                                                         unsigned int blue_offset,
+                                                         unsigned int bits_for_blue);
+const char *ply_pixel_format_get_name (ply_pixel_format_t format);
+unsigned int ply_pixel_format_get_bytes_per_pixel (ply_pixel_format_t format);
+
+/* Returns NULL for XRGB8888, which is the layout of argb32 data already and
+ * can be copied as is
+ */
+ply_pixel_row_converter_t ply_pixel_format_get_row_converter (ply_pixel_format_t format);
+#endif
+
+#endif /* PLY_PIXEL_FORMAT_H */
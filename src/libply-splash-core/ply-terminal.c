@@ -97,6 +97,8 @@ struct _ply_terminal
         int                  number_of_rows;
         int                  number_of_columns;
 
+        int                  baud_rate;
+
         uint32_t             original_term_attributes_saved : 1;
         uint32_t             original_locked_term_attributes_saved : 1;
         uint32_t             supports_text_color : 1;
@@ -480,6 +482,69 @@ ply_terminal_check_for_vt (ply_terminal_t *terminal)
                 terminal->vt_number = -1;
 }
 
+static void
+ply_terminal_check_for_baud_rate (ply_terminal_t *terminal)
+{
+        static const struct
+        {
+                speed_t speed;
+                int     baud_rate;
+        } speeds[] = {
+                { B50,      50 },
+                { B75,      75 },
+                { B110,     110 },
+                { B134,     134 },
+                { B150,     150 },
+                { B200,     200 },
+                { B300,     300 },
+                { B600,     600 },
+                { B1200,    1200 },
+                { B1800,    1800 },
+                { B2400,    2400 },
+                { B4800,    4800 },
+                { B9600,    9600 },
+                { B19200,   19200 },
+                { B38400,   38400 },
+                { B57600,   57600 },
+                { B115200,  115200 },
+                { B230400,  230400 },
+                { B460800,  460800 },
+                { B500000,  500000 },
+                { B576000,  576000 },
+                { B921600,  921600 },
+                { B1000000, 1000000 },
+                { B1152000, 1152000 },
+                { B1500000, 1500000 },
+                { B2000000, 2000000 },
+                { B2500000, 2500000 },
+                { B3000000, 3000000 },
+                { B3500000, 3500000 },
+                { B4000000, 4000000 },
+        };
+        struct termios term_attributes;
+        speed_t speed;
+        size_t i;
+
+        terminal->baud_rate = 0;
+
+        /* Virtual consoles draw straight into video memory */
+        if (ply_terminal_is_vt (terminal))
+                return;
+
+        if (tcgetattr (terminal->fd, &term_attributes) != 0)
+                return;
+
+        speed = cfgetospeed (&term_attributes);
+        for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+                if (speeds[i].speed == speed) {
+                        terminal->baud_rate = speeds[i].baud_rate;
+                        break;
+                }
+        }
+
+        ply_trace ("terminal '%s' runs at %d baud", terminal->name, terminal->baud_rate);
+}
+
 static int
 get_active_vt (ply_terminal_t *terminal)
 {
@@ -627,6 +692,7 @@ ply_terminal_open_device (ply_terminal_t *terminal)
                                                       terminal);
 
         ply_terminal_check_for_vt (terminal);
+        ply_terminal_check_for_baud_rate (terminal);
 
         if (!ply_terminal_set_unbuffered_input (terminal))
                 ply_trace ("terminal '%s' will be line buffered", terminal->name);
@@ -692,6 +758,12 @@ ply_terminal_is_vt (ply_terminal_t *terminal)
         return terminal->vt_number > 0;
 }
 
+int
+ply_terminal_get_baud_rate (ply_terminal_t *terminal)
+{
+        return terminal->baud_rate;
+}
+
 bool
 ply_terminal_is_open (ply_terminal_t *terminal)
 {
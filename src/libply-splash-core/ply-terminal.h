@@ -63,6 +63,7 @@ void ply_terminal_free (ply_terminal_t *terminal);
 bool ply_terminal_open (ply_terminal_t *terminal);
 int ply_terminal_get_fd (ply_terminal_t *terminal);
 bool ply_terminal_is_vt (ply_terminal_t *terminal);
+int ply_terminal_get_baud_rate (ply_terminal_t *terminal);
 bool ply_terminal_is_open (ply_terminal_t *terminal);
 bool ply_terminal_is_active (ply_terminal_t *terminal);
 void ply_terminal_close (ply_terminal_t *terminal);
@@ -89,6 +89,46 @@
 #define TEXT_PALETTE_SIZE 48
 #endif
 
+#ifndef TEXT_FLUSH_DELAY
+#define TEXT_FLUSH_DELAY (1.0 / 1000.0)
+#endif
+
+/* How much of a serial line's bandwidth redraws may take up, so console
+ * messages from everything else don't back up behind them
+ */
+#ifndef TEXT_SERIAL_BANDWIDTH_SHARE
+#define TEXT_SERIAL_BANDWIDTH_SHARE 0.5
+#endif
+
+#ifndef TEXT_SERIAL_BITS_PER_BYTE
+#define TEXT_SERIAL_BITS_PER_BYTE 10
+#endif
+
+#ifndef TEXT_FORMAT_BUFFER_SIZE
+#define TEXT_FORMAT_BUFFER_SIZE 256
+#endif
+
+/* Output is not written immediately.  Instead, writes update a model of
+ * the screen (the "desired" grid), and once per main loop iteration the
+ * cells that differ from what was last sent to the terminal (the "emitted"
+ * grid) are turned into escape sequences and written out in one go
+ * shortly after.
+ *
+ * A cell with a length of 0 has unknown contents.  Anything the model
+ * can't account for (control characters, wide characters, text that would
+ * wrap, or callers writing to the terminal behind our back) is passed
+ * through as is and makes the affected cells unknown again.
+ */
+typedef struct
+{
+        char   bytes[4];
+        uint8_t length;
+        int8_t  foreground_color;
+        int8_t  background_color;
+} ply_text_display_cell_t;
+
+#define PLY_TEXT_DISPLAY_COLOR_UNSET -1
+
 struct _ply_text_display
 {
         ply_event_loop_t               *loop;
@@ -100,8 +140,34 @@ struct _ply_text_display
 
         ply_text_display_draw_handler_t draw_handler;
         void                           *draw_handler_user_data;
+
+        ply_text_display_cell_t        *desired_cells;
+        ply_text_display_cell_t        *emitted_cells;
+        int                             number_of_columns;
+        int                             number_of_rows;
+
+        /* Where the next write goes, and the colors it gets */
+        int                             cursor_column;
+        int                             cursor_row;
+        int                             pen_foreground_color;
+        int                             pen_background_color;
+
+        /* What the terminal really has, -1 if unknown.  A column equal
+         * to number_of_columns means the terminal is about to wrap.
+         */
+        int                             terminal_cursor_column;
+        int                             terminal_cursor_row;
+        int                             terminal_foreground_color;
+        int                             terminal_background_color;
+
+        ply_buffer_t                   *output_buffer;
+        double                          next_flush_time;
+
+        uint32_t                        flush_is_pending : 1;
 };
 
+static void ply_text_display_flush (ply_text_display_t *display);
+
 ply_text_display_t *
 ply_text_display_new (ply_terminal_t *terminal)
 {
@@ -112,6 +178,18 @@ ply_text_display_new (ply_terminal_t *terminal)
         display->loop = NULL;
         display->terminal = terminal;
 
+        display->cursor_column = -1;
+        display->cursor_row = -1;
+        display->pen_foreground_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+        display->pen_background_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+
+        display->terminal_cursor_column = -1;
+        display->terminal_cursor_row = -1;
+        display->terminal_foreground_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+        display->terminal_background_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+
+        display->output_buffer = ply_buffer_new ();
+
         return display;
 }
 
@@ -127,6 +205,347 @@ ply_text_display_get_number_of_rows (ply_text_display_t *display)
         return ply_terminal_get_number_of_rows (display->terminal);
 }
 
+static void
+ply_text_display_forget_cells (ply_text_display_t *display,
+                               bool                should_forget_desired_cells)
+{
+        size_t number_of_cells;
+
+        number_of_cells = (size_t) display->number_of_columns * display->number_of_rows;
+
+        if (number_of_cells == 0)
+                return;
+
+        memset (display->emitted_cells, 0, number_of_cells * sizeof(ply_text_display_cell_t));
+
+        if (should_forget_desired_cells)
+                memset (display->desired_cells, 0, number_of_cells * sizeof(ply_text_display_cell_t));
+}
+
+static void
+ply_text_display_forget_terminal_state (ply_text_display_t *display)
+{
+        ply_text_display_forget_cells (display, true);
+
+        display->terminal_cursor_column = -1;
+        display->terminal_cursor_row = -1;
+        display->terminal_foreground_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+        display->terminal_background_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+}
+
+static bool
+ply_text_display_update_size (ply_text_display_t *display)
+{
+        int number_of_columns;
+        int number_of_rows;
+        size_t number_of_cells;
+
+        number_of_columns = MAX (ply_text_display_get_number_of_columns (display), 0);
+        number_of_rows = MAX (ply_text_display_get_number_of_rows (display), 0);
+
+        if (number_of_columns == display->number_of_columns &&
+            number_of_rows == display->number_of_rows)
+                return number_of_columns > 0 && number_of_rows > 0;
+
+        free (display->desired_cells);
+        free (display->emitted_cells);
+        display->desired_cells = NULL;
+        display->emitted_cells = NULL;
+        display->number_of_columns = 0;
+        display->number_of_rows = 0;
+
+        display->terminal_cursor_column = -1;
+        display->terminal_cursor_row = -1;
+
+        number_of_cells = (size_t) number_of_columns * number_of_rows;
+
+        if (number_of_cells == 0)
+                return false;
+
+        display->desired_cells = calloc (number_of_cells, sizeof(ply_text_display_cell_t));
+        display->emitted_cells = calloc (number_of_cells, sizeof(ply_text_display_cell_t));
+        display->number_of_columns = number_of_columns;
+        display->number_of_rows = number_of_rows;
+
+        return true;
+}
+
+static bool
+ply_text_display_cells_match (const ply_text_display_cell_t *a,
+                              const ply_text_display_cell_t *b)
+{
+        if (a->length != b->length)
+                return false;
+
+        if (memcmp (a->bytes, b->bytes, a->length) != 0)
+                return false;
+
+        if (a->background_color != b->background_color)
+                return false;
+
+        /* The foreground color of a blank doesn't show */
+        if (a->length == 1 && a->bytes[0] == ' ')
+                return true;
+
+        return a->foreground_color == b->foreground_color;
+}
+
+static void
+ply_text_display_set_blank_cell (ply_text_display_t      *display,
+                                 ply_text_display_cell_t *cell)
+{
+        cell->bytes[0] = ' ';
+        cell->length = 1;
+        cell->foreground_color = display->pen_foreground_color;
+        cell->background_color = display->pen_background_color;
+}
+
+static void
+ply_text_display_emit_cursor_position (ply_text_display_t *display,
+                                       int                 column,
+                                       int                 row)
+{
+        if (display->terminal_cursor_column == column &&
+            display->terminal_cursor_row == row)
+                return;
+
+        /* The sequence is 1-based, but positions have always been passed
+         * to it unadjusted, so column and row are 0-based here and callers'
+         * coordinates are mapped accordingly.
+         */
+        ply_buffer_append (display->output_buffer,
+                           MOVE_CURSOR_SEQUENCE,
+                           row + 1, column + 1);
+
+        display->terminal_cursor_column = column;
+        display->terminal_cursor_row = row;
+}
+
+static void
+ply_text_display_emit_colors (ply_text_display_t *display,
+                              int                 foreground_color,
+                              int                 background_color)
+{
+        if (foreground_color != PLY_TEXT_DISPLAY_COLOR_UNSET &&
+            foreground_color != display->terminal_foreground_color) {
+                ply_buffer_append (display->output_buffer,
+                                   COLOR_SEQUENCE_FORMAT,
+                                   FOREGROUND_COLOR_BASE + foreground_color);
+                display->terminal_foreground_color = foreground_color;
+        }
+
+        if (background_color != PLY_TEXT_DISPLAY_COLOR_UNSET &&
+            background_color != display->terminal_background_color) {
+                ply_buffer_append (display->output_buffer,
+                                   COLOR_SEQUENCE_FORMAT,
+                                   BACKGROUND_COLOR_BASE + background_color);
+                display->terminal_background_color = background_color;
+        }
+}
+
+/* Moving the cursor a few cells to the right on the same row takes
+ * more bytes than writing out what's already in those cells, which
+ * matters on slow serial lines
+ */
+static bool
+ply_text_display_rewrite_cells_up_to (ply_text_display_t *display,
+                                      int                 column,
+                                      int                 row)
+{
+        ply_text_display_cell_t *cells;
+        size_t number_of_bytes;
+        int move_length;
+        int i;
+
+        if (display->terminal_cursor_row != row ||
+            display->terminal_cursor_column < 0 ||
+            display->terminal_cursor_column >= column)
+                return false;
+
+        move_length = snprintf (NULL, 0, MOVE_CURSOR_SEQUENCE, row + 1, column + 1);
+
+        cells = &display->desired_cells[row * display->number_of_columns];
+        number_of_bytes = 0;
+        for (i = display->terminal_cursor_column; i < column; i++) {
+                if (cells[i].length == 0)
+                        return false;
+
+                if (!ply_text_display_cells_match (&cells[i], &display->emitted_cells[row * display->number_of_columns + i]))
+                        return false;
+
+                if (cells[i].background_color != display->terminal_background_color)
+                        return false;
+
+                if ((cells[i].length != 1 || cells[i].bytes[0] != ' ') &&
+                    cells[i].foreground_color != display->terminal_foreground_color)
+                        return false;
+
+                number_of_bytes += cells[i].length;
+                if (number_of_bytes >= (size_t) move_length)
+                        return false;
+        }
+
+        for (i = display->terminal_cursor_column; i < column; i++) {
+                ply_buffer_append_bytes (display->output_buffer, cells[i].bytes, cells[i].length);
+        }
+
+        display->terminal_cursor_column = column;
+
+        return true;
+}
+
+static void
+ply_text_display_emit_cell (ply_text_display_t *display,
+                            int                 column,
+                            int                 row)
+{
+        ply_text_display_cell_t *cell;
+        int foreground_color;
+
+        cell = &display->desired_cells[row * display->number_of_columns + column];
+
+        foreground_color = cell->foreground_color;
+        if (cell->length == 1 && cell->bytes[0] == ' ')
+                foreground_color = PLY_TEXT_DISPLAY_COLOR_UNSET;
+
+        if (!ply_text_display_rewrite_cells_up_to (display, column, row))
+                ply_text_display_emit_cursor_position (display, column, row);
+        ply_text_display_emit_colors (display, foreground_color, cell->background_color);
+        ply_buffer_append_bytes (display->output_buffer, cell->bytes, cell->length);
+
+        display->emitted_cells[row * display->number_of_columns + column] = *cell;
+        display->terminal_cursor_column = column + 1;
+}
+
+static void
+ply_text_display_sync (ply_text_display_t *display)
+{
+        int row, column;
+
+        for (row = 0; row < display->number_of_rows; row++) {
+                for (column = 0; column < display->number_of_columns; column++) {
+                        size_t index;
+
+                        index = row * display->number_of_columns + column;
+
+                        if (display->desired_cells[index].length == 0)
+                                continue;
+
+                        if (ply_text_display_cells_match (&display->desired_cells[index],
+                                                          &display->emitted_cells[index]))
+                                continue;
+
+                        ply_text_display_emit_cell (display, column, row);
+                }
+        }
+}
+
+static void
+ply_text_display_sync_cursor_and_pen (ply_text_display_t *display)
+{
+        ply_text_display_sync (display);
+
+        if (display->cursor_row >= 0 && display->cursor_row < display->number_of_rows) {
+                if (display->cursor_column < display->number_of_columns) {
+                        ply_text_display_emit_cursor_position (display,
+                                                               display->cursor_column,
+                                                               display->cursor_row);
+                } else if (display->terminal_cursor_column != display->cursor_column ||
+                           display->terminal_cursor_row != display->cursor_row) {
+                        int last_column;
+
+                        /* Rewriting the last cell puts the terminal back
+                         * into its about-to-wrap state
+                         */
+                        last_column = display->number_of_columns - 1;
+                        if (display->desired_cells[display->cursor_row * display->number_of_columns + last_column].length != 0)
+                                ply_text_display_emit_cell (display, last_column, display->cursor_row);
+                        else
+                                ply_text_display_emit_cursor_position (display, last_column, display->cursor_row);
+                }
+        }
+
+        ply_text_display_emit_colors (display,
+                                      display->pen_foreground_color,
+                                      display->pen_background_color);
+}
+
+static void
+ply_text_display_write_through (ply_text_display_t *display,
+                                const char         *bytes,
+                                size_t              number_of_bytes)
+{
+        ply_text_display_sync_cursor_and_pen (display);
+        ply_buffer_append_bytes (display->output_buffer, bytes, number_of_bytes);
+}
+
+static void
+on_flush_timeout (ply_text_display_t *display)
+{
+        display->flush_is_pending = false;
+        ply_text_display_flush (display);
+}
+
+static void
+ply_text_display_schedule_flush (ply_text_display_t *display)
+{
+        double delay;
+
+        if (display->loop == NULL) {
+                ply_text_display_flush (display);
+                return;
+        }
+
+        if (display->flush_is_pending)
+                return;
+
+        /* On serial consoles, frames that come in while the line is still
+         * busy with the last one get folded into the next
+         */
+        delay = MAX (display->next_flush_time - ply_get_timestamp (), TEXT_FLUSH_DELAY);
+
+        ply_event_loop_watch_for_timeout (display->loop, delay,
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_flush_timeout,
+                                          display);
+        display->flush_is_pending = true;
+}
+
+static void
+ply_text_display_flush (ply_text_display_t *display)
+{
+        size_t size;
+        int baud_rate;
+
+        if (display->flush_is_pending) {
+                if (display->loop != NULL)
+                        ply_event_loop_stop_watching_for_timeout (display->loop,
+                                                                  (ply_event_loop_timeout_handler_t)
+                                                                  on_flush_timeout,
+                                                                  display);
+                display->flush_is_pending = false;
+        }
+
+        ply_text_display_update_size (display);
+        ply_text_display_sync_cursor_and_pen (display);
+
+        size = ply_buffer_get_size (display->output_buffer);
+
+        if (size == 0)
+                return;
+
+        ply_terminal_set_mode (display->terminal, PLY_TERMINAL_MODE_TEXT);
+        ply_write (ply_terminal_get_fd (display->terminal),
+                   ply_buffer_get_bytes (display->output_buffer),
+                   size);
+        ply_buffer_clear (display->output_buffer);
+
+        baud_rate = ply_terminal_get_baud_rate (display->terminal);
+        if (baud_rate > 0)
+                display->next_flush_time = ply_get_timestamp () +
+                                           (size * TEXT_SERIAL_BITS_PER_BYTE) / (baud_rate * TEXT_SERIAL_BANDWIDTH_SHARE);
+}
+
 void
 ply_text_display_set_cursor_position (ply_text_display_t *display,
                                       int                 column,
@@ -141,57 +560,105 @@ ply_text_display_set_cursor_position (ply_text_display_t *display,
         column = CLAMP (column, 0, number_of_columns - 1);
         row = CLAMP (row, 0, number_of_rows - 1);
 
-        ply_terminal_write (display->terminal,
-                            MOVE_CURSOR_SEQUENCE,
-                            row, column);
+        display->cursor_column = MAX (column - 1, 0);
+        display->cursor_row = MAX (row - 1, 0);
+
+        ply_text_display_schedule_flush (display);
+}
+
+static void
+ply_text_display_write_sequence (ply_text_display_t *display,
+                                 const char         *sequence)
+{
+        ply_text_display_update_size (display);
+        ply_text_display_write_through (display, sequence, strlen (sequence));
+        ply_text_display_flush (display);
 }
 
 void
 ply_text_display_clear_screen (ply_text_display_t *display)
 {
+        size_t number_of_cells, i;
+
         if (ply_is_tracing_to_terminal ())
                 return;
 
-        ply_terminal_write (display->terminal,
-                            CLEAR_SCREEN_SEQUENCE);
+        ply_text_display_write_sequence (display, CLEAR_SCREEN_SEQUENCE);
+
+        number_of_cells = (size_t) display->number_of_columns * display->number_of_rows;
+        for (i = 0; i < number_of_cells; i++) {
+                ply_text_display_set_blank_cell (display, &display->desired_cells[i]);
+                display->emitted_cells[i] = display->desired_cells[i];
+        }
 
         ply_text_display_set_cursor_position (display, 0, 0);
+        ply_text_display_flush (display);
 }
 
 void
 ply_text_display_clear_line (ply_text_display_t *display)
 {
-        ply_terminal_write (display->terminal,
-                            CLEAR_LINE_SEQUENCE);
+        int column;
+
+        if (!ply_text_display_update_size (display) ||
+            display->cursor_row < 0 ||
+            display->cursor_row + 1 >= display->number_of_rows) {
+                ply_text_display_write_through (display, CLEAR_LINE_SEQUENCE, strlen (CLEAR_LINE_SEQUENCE));
+                ply_text_display_forget_terminal_state (display);
+                display->cursor_column = -1;
+                display->cursor_row = -1;
+                ply_text_display_schedule_flush (display);
+                return;
+        }
+
+        for (column = 0; column < display->number_of_columns; column++)
+                ply_text_display_set_blank_cell (display, &display->desired_cells[display->cursor_row * display->number_of_columns + column]);
+
+        display->cursor_column = 0;
+        display->cursor_row++;
+
+        ply_text_display_schedule_flush (display);
 }
 
 void
 ply_text_display_remove_character (ply_text_display_t *display)
 {
-        ply_terminal_write (display->terminal,
-                            BACKSPACE);
+        int column;
+
+        if (!ply_text_display_update_size (display) || display->cursor_row < 0) {
+                ply_text_display_write_through (display, BACKSPACE, strlen (BACKSPACE));
+                ply_text_display_forget_terminal_state (display);
+                ply_text_display_schedule_flush (display);
+                return;
+        }
+
+        display->cursor_column = MIN (display->cursor_column, display->number_of_columns - 1);
+        display->cursor_column = MAX (display->cursor_column - 1, 0);
+
+        for (column = display->cursor_column; column < display->number_of_columns; column++)
+                ply_text_display_set_blank_cell (display, &display->desired_cells[display->cursor_row * display->number_of_columns + column]);
+
+        ply_text_display_schedule_flush (display);
 }
 
 void
 ply_text_display_set_background_color (ply_text_display_t  *display,
                                        ply_terminal_color_t color)
 {
-        ply_terminal_write (display->terminal,
-                            COLOR_SEQUENCE_FORMAT,
-                            BACKGROUND_COLOR_BASE + color);
-
+        display->pen_background_color = color;
         display->background_color = color;
+
+        ply_text_display_schedule_flush (display);
 }
 
 void
 ply_text_display_set_foreground_color (ply_text_display_t  *display,
                                        ply_terminal_color_t color)
 {
-        ply_terminal_write (display->terminal,
-                            COLOR_SEQUENCE_FORMAT,
-                            FOREGROUND_COLOR_BASE + color);
-
+        display->pen_foreground_color = color;
         display->foreground_color = color;
+
+        ply_text_display_schedule_flush (display);
 }
 
 ply_terminal_color_t
@@ -213,17 +680,118 @@ ply_text_display_draw_area (ply_text_display_t *display,
                             int                 width,
                             int                 height)
 {
+        /* Only the cells the draw handler changes get written out. Cells
+         * the terminal has lost track of were already forgotten when it
+         * was resized, cleared or written to behind our back.
+         */
+        ply_text_display_update_size (display);
+
         if (display->draw_handler != NULL)
                 display->draw_handler (display->draw_handler_user_data,
                                        display->terminal,
                                        x, y, width, height);
+
+        ply_text_display_schedule_flush (display);
 }
 
 void
 ply_text_display_hide_cursor (ply_text_display_t *display)
 {
-        ply_terminal_write (display->terminal,
-                            HIDE_CURSOR_SEQUENCE);
+        ply_text_display_write_sequence (display, HIDE_CURSOR_SEQUENCE);
+}
+
+/* Returns the length of the UTF-8 character at the start of string if
+ * it takes up exactly one cell, otherwise 0.  This only vouches for
+ * ranges that are known to be narrow and free of combining and
+ * formatting characters; anything else gets written through unmodeled.
+ */
+static size_t
+ply_text_display_get_cell_character_length (const char *string,
+                                            size_t      size)
+{
+        const unsigned char *bytes = (const unsigned char *) string;
+        uint32_t character;
+        size_t length, i;
+
+        if (bytes[0] >= 0x20 && bytes[0] < 0x7f)
+                return 1;
+
+        if ((bytes[0] & 0xe0) == 0xc0) {
+                length = 2;
+                character = bytes[0] & 0x1f;
+        } else if ((bytes[0] & 0xf0) == 0xe0) {
+                length = 3;
+                character = bytes[0] & 0x0f;
+        } else {
+                return 0;
+        }
+
+        if (length > size)
+                return 0;
+
+        for (i = 1; i < length; i++) {
+                if ((bytes[i] & 0xc0) != 0x80)
+                        return 0;
+                character = (character << 6) | (bytes[i] & 0x3f);
+        }
+
+        if (character >= 0xa0 && character < 0x300 && character != 0xad)
+                return length;
+
+        if (character >= 0x2010 && character < 0x2028)
+                return length;
+
+        if (character >= 0x2030 && character < 0x2060)
+                return length;
+
+        if (character >= 0x2070 && character < 0x2c00)
+                return length;
+
+        return 0;
+}
+
+static bool
+ply_text_display_write_cells (ply_text_display_t *display,
+                              const char         *string,
+                              size_t              size)
+{
+        size_t offset, length;
+        int number_of_cells;
+        ply_text_display_cell_t *cell;
+
+        if (!ply_text_display_update_size (display))
+                return false;
+
+        if (display->cursor_row < 0 || display->cursor_row >= display->number_of_rows)
+                return false;
+
+        number_of_cells = 0;
+        for (offset = 0; offset < size; offset += length) {
+                length = ply_text_display_get_cell_character_length (string + offset, size - offset);
+
+                if (length == 0)
+                        return false;
+
+                number_of_cells++;
+        }
+
+        if (display->cursor_column + number_of_cells > display->number_of_columns)
+                return false;
+
+        cell = &display->desired_cells[display->cursor_row * display->number_of_columns + display->cursor_column];
+        for (offset = 0; offset < size; offset += length) {
+                length = ply_text_display_get_cell_character_length (string + offset, size - offset);
+
+                memcpy (cell->bytes, string + offset, length);
+                cell->length = length;
+                cell->foreground_color = display->pen_foreground_color;
+                cell->background_color = display->pen_background_color;
+                cell++;
+        }
+
+        display->cursor_column += number_of_cells;
+
+        return true;
 }
 
 void
@@ -231,30 +799,46 @@ ply_text_display_write (ply_text_display_t *display,
                         const char         *format,
                         ...)
 {
-        int fd;
-
         va_list args;
+        char buffer[TEXT_FORMAT_BUFFER_SIZE];
         char *string;
+        int size;
 
         assert (display != NULL);
         assert (format != NULL);
 
-        fd = ply_terminal_get_fd (display->terminal);
-
-        string = NULL;
+        string = buffer;
         va_start (args, format);
-        vasprintf (&string, format, args);
+        size = vsnprintf (buffer, sizeof(buffer), format, args);
         va_end (args);
 
-        write (fd, string, strlen (string));
-        free (string);
+        if (size < 0)
+                return;
+
+        if ((size_t) size >= sizeof(buffer)) {
+                string = malloc (size + 1);
+                va_start (args, format);
+                vsnprintf (string, size + 1, format, args);
+                va_end (args);
+        }
+
+        if (!ply_text_display_write_cells (display, string, size)) {
+                ply_text_display_write_through (display, string, size);
+                ply_text_display_forget_terminal_state (display);
+                display->cursor_column = -1;
+                display->cursor_row = -1;
+        }
+
+        if (string != buffer)
+                free (string);
+
+        ply_text_display_schedule_flush (display);
 }
 
 void
 ply_text_display_show_cursor (ply_text_display_t *display)
 {
-        ply_terminal_write (display->terminal,
-                            SHOW_CURSOR_SEQUENCE);
+        ply_text_display_write_sequence (display, SHOW_CURSOR_SEQUENCE);
 }
 
 bool
@@ -267,6 +851,8 @@ static void
 ply_text_display_detach_from_event_loop (ply_text_display_t *display)
 {
         assert (display != NULL);
+
+        ply_text_display_flush (display);
         display->loop = NULL;
 }
 
@@ -276,6 +862,8 @@ ply_text_display_free (ply_text_display_t *display)
         if (display == NULL)
                 return;
 
+        ply_text_display_flush (display);
+
         if (display->loop != NULL) {
                 ply_event_loop_stop_watching_for_exit (display->loop,
                                                        (ply_event_loop_exit_handler_t)
@@ -283,6 +871,9 @@ ply_text_display_free (ply_text_display_t *display)
                                                        display);
         }
 
+        ply_buffer_free (display->output_buffer);
+        free (display->desired_cells);
+        free (display->emitted_cells);
         free (display);
 }
 
@@ -300,15 +891,13 @@ ply_text_display_set_draw_handler (ply_text_display_t             *display,
 void
 ply_text_display_pause_updates (ply_text_display_t *display)
 {
-        ply_terminal_write (display->terminal,
-                            PAUSE_SEQUENCE);
+        ply_text_display_write_sequence (display, PAUSE_SEQUENCE);
 }
 
 void
 ply_text_display_unpause_updates (ply_text_display_t *display)
 {
-        ply_terminal_write (display->terminal,
-                            UNPAUSE_SEQUENCE);
+        ply_text_display_write_sequence (display, UNPAUSE_SEQUENCE);
 }
 
 void
@@ -329,6 +918,11 @@ ply_text_display_attach_to_event_loop (ply_text_display_t *display,
 ply_terminal_t *
 ply_text_display_get_terminal (ply_text_display_t *display)
 {
+        /* The caller may write to the terminal directly, so get
+         * everything out first and stop trusting the model afterward
+         */
+        ply_text_display_flush (display);
+        ply_text_display_forget_terminal_state (display);
+
         return display->terminal;
 }
-
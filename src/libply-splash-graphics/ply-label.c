@@ -41,7 +41,6 @@
 struct _ply_label
 {
         ply_event_loop_t                   *loop;
-        ply_module_handle_t                *module_handle;
         const ply_label_plugin_interface_t *plugin_interface;
         ply_label_plugin_control_t         *control;
 
@@ -101,52 +100,87 @@ ply_label_free (ply_label_t *label)
         free (label);
 }
 
-static bool
-ply_label_load_plugin (ply_label_t *label)
+/* The label backend is resolved once and then shared by every label in
+ * the process.  The pango one is preferred, and the FreeType based one is
+ * tried after that, it is not a complete substitute (yet).
+ */
+static const struct
 {
-        assert (label != NULL);
+        const char *name;
+        const char *module_path;
+} label_backends[] = {
+        { "pango",    PLYMOUTH_PLUGIN_PATH "label-pango.so"    },
+        { "freetype", PLYMOUTH_PLUGIN_PATH "label-freetype.so" },
+};
+
+/* The backend is shared by all labels and stays loaded until exit */
+static const ply_label_plugin_interface_t *label_backend_plugin_interface;
+static const char *label_backend_name;
 
+static const ply_label_plugin_interface_t *
+ply_label_get_backend (void)
+{
         get_plugin_interface_function_t get_label_plugin_interface;
+        const ply_label_plugin_interface_t *plugin_interface;
+        ply_module_handle_t *module_handle;
+        size_t i;
 
-        label->module_handle = ply_open_module (PLYMOUTH_PLUGIN_PATH "label-pango.so");
+        if (label_backend_plugin_interface != NULL)
+                return label_backend_plugin_interface;
 
-        /* and the FreeType based one after that, it is not a complete substitute (yet). */
-        if (label->module_handle == NULL)
-                label->module_handle = ply_open_module (PLYMOUTH_PLUGIN_PATH "label-freetype.so");
+        for (i = 0; i < sizeof(label_backends) / sizeof(label_backends[0]); i++) {
+                module_handle = ply_open_module (label_backends[i].module_path);
 
-        if (label->module_handle == NULL)
-                return false;
+                if (module_handle == NULL)
+                        continue;
 
-        get_label_plugin_interface = (get_plugin_interface_function_t)
-                                     ply_module_look_up_function (label->module_handle,
-                                                                  "ply_label_plugin_get_interface");
+                get_label_plugin_interface = (get_plugin_interface_function_t)
+                                             ply_module_look_up_function (module_handle,
+                                                                          "ply_label_plugin_get_interface");
 
-        if (get_label_plugin_interface == NULL) {
-                ply_save_errno ();
-                ply_close_module (label->module_handle);
-                label->module_handle = NULL;
-                ply_restore_errno ();
-                return false;
+                plugin_interface = NULL;
+                if (get_label_plugin_interface != NULL)
+                        plugin_interface = get_label_plugin_interface ();
+
+                if (plugin_interface == NULL) {
+                        ply_save_errno ();
+                        ply_close_module (module_handle);
+                        ply_restore_errno ();
+                        continue;
+                }
+
+                ply_trace ("using %s label backend", label_backends[i].name);
+
+                label_backend_plugin_interface = plugin_interface;
+                label_backend_name = label_backends[i].name;
+                break;
         }
 
-        label->plugin_interface = get_label_plugin_interface ();
+        return label_backend_plugin_interface;
+}
+
+const char *
+ply_label_get_backend_name (void)
+{
+        ply_label_get_backend ();
 
-        if (label->plugin_interface == NULL) {
-                ply_save_errno ();
-                ply_close_module (label->module_handle);
-                label->module_handle = NULL;
-                ply_restore_errno ();
+        return label_backend_name;
+}
+
+static bool
+ply_label_load_plugin (ply_label_t *label)
+{
+        assert (label != NULL);
+
+        label->plugin_interface = ply_label_get_backend ();
+
+        if (label->plugin_interface == NULL)
                 return false;
-        }
 
         label->control = label->plugin_interface->create_control ();
 
         if (label->control == NULL) {
-                ply_save_errno ();
                 label->plugin_interface = NULL;
-                ply_close_module (label->module_handle);
-                label->module_handle = NULL;
-                ply_restore_errno ();
                 return false;
         }
 
@@ -181,11 +215,10 @@ ply_label_unload_plugin (ply_label_t *label)
 {
         assert (label != NULL);
         assert (label->plugin_interface != NULL);
-        assert (label->module_handle != NULL);
 
-        ply_close_module (label->module_handle);
+        label->plugin_interface->destroy_control (label->control);
+        label->control = NULL;
         label->plugin_interface = NULL;
-        label->module_handle = NULL;
 }
 
 bool
@@ -44,6 +44,8 @@ typedef enum
 ply_label_t *ply_label_new (void);
 void ply_label_free (ply_label_t *label);
 
+const char *ply_label_get_backend_name (void);
+
 bool ply_label_show (ply_label_t         *label,
                      ply_pixel_display_t *display,
                      long                 x,
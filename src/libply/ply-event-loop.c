@@ -48,6 +48,13 @@
 #define PLY_EVENT_LOOP_NO_TIMED_WAKEUP 0.0
 #endif
 
+/* A timeout that runs more than a 60Hz frame after it was due is counted
+ * as late, since an animation driven by it will have visibly stalled
+ */
+#ifndef PLY_EVENT_LOOP_LATE_TIMEOUT_THRESHOLD
+#define PLY_EVENT_LOOP_LATE_TIMEOUT_THRESHOLD (1.0 / 60)
+#endif
+
 typedef struct
 {
         int         fd;
@@ -115,6 +122,9 @@ struct _ply_event_loop
 
         ply_signal_dispatcher_t *signal_dispatcher;
 
+        unsigned long            number_of_wakeups;
+        unsigned long            number_of_late_timeouts;
+
         uint32_t                 should_exit : 1;
         uint32_t                 is_running : 1;
 };
@@ -1189,6 +1199,9 @@ ply_event_loop_handle_timeouts (ply_event_loop_t *loop)
 
                         ply_list_remove_node (loop->timeout_watches, node);
 
+                        if (now - watch->timeout > PLY_EVENT_LOOP_LATE_TIMEOUT_THRESHOLD)
+                                loop->number_of_late_timeouts++;
+
                         watch->handler (watch->user_data, loop);
                         free (watch);
 
@@ -1223,13 +1236,16 @@ ply_event_loop_process_pending_events (ply_event_loop_t *loop)
                 if (fabs (loop->wakeup_time - PLY_EVENT_LOOP_NO_TIMED_WAKEUP) <= 0) {
                         timeout = -1;
                 } else {
-                        timeout = (int) ((loop->wakeup_time - ply_get_timestamp ()) * 1000);
+                        /* Round up, or a wakeup less than a millisecond
+                         * away turns into a busy loop of zero timeouts */
+                        timeout = (int) ceil ((loop->wakeup_time - ply_get_timestamp ()) * 1000);
                         timeout = MAX (timeout, 0);
                 }
 
                 number_of_received_events = epoll_wait (loop->epoll_fd, events,
                                                         PLY_EVENT_LOOP_NUM_EVENT_HANDLERS,
                                                         timeout);
+                loop->number_of_wakeups++;
                 if (number_of_received_events < 0) {
                         if (errno != EINTR && errno != EAGAIN) {
                                 ply_event_loop_exit (loop, 255);
@@ -1321,3 +1337,18 @@ ply_event_loop_run (ply_event_loop_t *loop)
         return loop->exit_code;
 }
 
+unsigned long
+ply_event_loop_get_number_of_wakeups (ply_event_loop_t *loop)
+{
+        assert (loop != NULL);
+
+        return loop->number_of_wakeups;
+}
+
+unsigned long
+ply_event_loop_get_number_of_late_timeouts (ply_event_loop_t *loop)
+{
+        assert (loop != NULL);
+
+        return loop->number_of_late_timeouts;
+}
@@ -85,6 +85,9 @@ void ply_event_loop_exit (ply_event_loop_t *loop,
                           int               exit_code);
 void
 ply_event_loop_process_pending_events (ply_event_loop_t *loop);
+
+unsigned long ply_event_loop_get_number_of_wakeups (ply_event_loop_t *loop);
+unsigned long ply_event_loop_get_number_of_late_timeouts (ply_event_loop_t *loop);
 #endif
 
 #endif
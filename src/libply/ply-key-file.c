@@ -39,8 +39,13 @@
 
 #include "ply-utils.h"
 #include "ply-hashtable.h"
+#include "ply-list.h"
 #include "ply-logger.h"
 
+#ifndef PLY_KEY_FILE_CACHE_SIZE
+#define PLY_KEY_FILE_CACHE_SIZE 8
+#endif
+
 typedef struct
 {
         char *key;
@@ -53,13 +58,34 @@ typedef struct
         ply_hashtable_t *entries;
 } ply_key_file_group_t;
 
-struct _ply_key_file
+/* What a file parsed to. Keys, values and group names all point into
+ * buffer, and the whole thing is shared by every key file loaded from
+ * the same, unchanged, file.
+ */
+typedef struct
 {
         char                 *filename;
-        FILE                 *fp;
+        dev_t                 device;
+        ino_t                 inode;
+        off_t                 size;
+        struct timespec       modification_time;
+        int                   reference_count;
+        uint32_t              is_groupless : 1;
+
+        char                 *buffer;
+        ply_key_file_entry_t *entries;
+        size_t                number_of_entries;
+        ply_key_file_group_t *groups_array;
+        size_t                number_of_groups;
 
         ply_hashtable_t      *groups;
         ply_key_file_group_t *groupless_group;
+} ply_key_file_contents_t;
+
+struct _ply_key_file
+{
+        char                    *filename;
+        ply_key_file_contents_t *contents;
 };
 
 typedef struct
@@ -69,34 +95,8 @@ typedef struct
         char                        *group_name;
 } ply_key_file_foreach_func_data_t;
 
-static bool ply_key_file_open_file (ply_key_file_t *key_file);
-static void ply_key_file_close_file (ply_key_file_t *key_file);
-
-static bool
-ply_key_file_open_file (ply_key_file_t *key_file)
-{
-        assert (key_file != NULL);
-
-        key_file->fp = fopen (key_file->filename, "re");
-
-        if (key_file->fp == NULL) {
-                ply_trace ("Failed to open key file %s: %m",
-                           key_file->filename);
-                return false;
-        }
-        return true;
-}
-
-static void
-ply_key_file_close_file (ply_key_file_t *key_file)
-{
-        assert (key_file != NULL);
-
-        if (key_file->fp == NULL)
-                return;
-        fclose (key_file->fp);
-        key_file->fp = NULL;
-}
+/* Most recently used first */
+static ply_list_t *contents_cache = NULL;
 
 ply_key_file_t *
 ply_key_file_new (const char *filename)
@@ -108,37 +108,44 @@ ply_key_file_new (const char *filename)
         key_file = calloc (1, sizeof(ply_key_file_t));
 
         key_file->filename = strdup (filename);
-        key_file->fp = NULL;
-        key_file->groups = ply_hashtable_new (ply_hashtable_string_hash, ply_hashtable_string_compare);
 
         return key_file;
 }
 
 static void
-ply_key_file_free_entry_foreach (void *key,
+ply_key_file_free_group_entries (void *key,
                                  void *data,
                                  void *user_data)
 {
-        ply_key_file_entry_t *entry = data;
+        ply_key_file_group_t *group = data;
 
-        free (entry->key);
-        free (entry->value);
-        free (entry);
+        ply_hashtable_free (group->entries);
 }
 
 static void
-ply_key_file_free_group (void *key,
-                         void *data,
-                         void *user_data)
+ply_key_file_contents_unref (ply_key_file_contents_t *contents)
 {
-        ply_key_file_group_t *group = data;
+        if (contents == NULL)
+                return;
 
-        ply_hashtable_foreach (group->entries,
-                               ply_key_file_free_entry_foreach,
+        contents->reference_count--;
+        if (contents->reference_count > 0)
+                return;
+
+        ply_hashtable_foreach (contents->groups,
+                               ply_key_file_free_group_entries,
                                NULL);
-        ply_hashtable_free (group->entries);
-        free (group->name);
-        free (group);
+        ply_hashtable_free (contents->groups);
+
+        if (contents->groupless_group != NULL)
+                ply_hashtable_free (contents->groupless_group->entries);
+        free (contents->groupless_group);
+
+        free (contents->groups_array);
+        free (contents->entries);
+        free (contents->buffer);
+        free (contents->filename);
+        free (contents);
 }
 
 void
@@ -148,167 +155,293 @@ ply_key_file_free (ply_key_file_t *key_file)
                 return;
 
         assert (key_file->filename != NULL);
-        ply_hashtable_foreach (key_file->groups,
-                               ply_key_file_free_group,
-                               NULL);
 
-        if (key_file->groupless_group)
-                ply_key_file_free_group (NULL, key_file->groupless_group, NULL);
-
-        ply_hashtable_free (key_file->groups);
+        ply_key_file_contents_unref (key_file->contents);
         free (key_file->filename);
         free (key_file);
 }
 
 static ply_key_file_group_t *
-ply_key_file_load_group (ply_key_file_t *key_file,
-                         const char     *group_name)
+ply_key_file_contents_add_group (ply_key_file_contents_t *contents,
+                                 char                    *name)
 {
-        int items_matched;
         ply_key_file_group_t *group;
 
-        group = calloc (1, sizeof(ply_key_file_group_t));
-        group->name = strdup (group_name);
+        ply_trace ("trying to load group %s", name);
+
+        group = &contents->groups_array[contents->number_of_groups++];
+        group->name = name;
         group->entries = ply_hashtable_new (ply_hashtable_string_hash, ply_hashtable_string_compare);
 
-        ply_trace ("trying to load group %s", group_name);
-        do {
+        ply_hashtable_insert (contents->groups, group->name, group);
+
+        return group;
+}
+
+/* Makes one pass over the file, splitting it up in place. Lines are
+ * "[group]", "key = value" or comments starting with '#'. Values run to
+ * the end of the line.
+ */
+static void
+ply_key_file_contents_parse (ply_key_file_contents_t *contents)
+{
+        ply_key_file_group_t *group;
+        char *line, *end_of_buffer;
+        size_t number_of_lines;
+
+        end_of_buffer = contents->buffer + contents->size;
+
+        number_of_lines = 1;
+        for (line = contents->buffer; (line = memchr (line, '\n', end_of_buffer - line)) != NULL; line++) {
+                number_of_lines++;
+        }
+
+        contents->entries = calloc (number_of_lines, sizeof(ply_key_file_entry_t));
+        contents->groups = ply_hashtable_new (ply_hashtable_string_hash, ply_hashtable_string_compare);
+
+        if (contents->is_groupless) {
+                group = calloc (1, sizeof(ply_key_file_group_t));
+                group->name = "NONE";
+                group->entries = ply_hashtable_new (ply_hashtable_string_hash, ply_hashtable_string_compare);
+                contents->groupless_group = group;
+        } else {
+                contents->groups_array = calloc (number_of_lines, sizeof(ply_key_file_group_t));
+                group = NULL;
+        }
+
+        for (line = contents->buffer; line < end_of_buffer; line++) {
                 ply_key_file_entry_t *entry;
-                char *key;
-                char *value;
-                off_t offset;
-                int first_byte;
+                char *end_of_line, *key, *value;
+
+                end_of_line = memchr (line, '\n', end_of_buffer - line);
+                if (end_of_line == NULL)
+                        end_of_line = end_of_buffer;
+                *end_of_line = '\0';
 
-                key = NULL;
-                value = NULL;
+                while (isspace (*line)) {
+                        line++;
+                }
+
+                if (*line == '\0' || *line == '#') {
+                        line = end_of_line;
+                        continue;
+                }
 
-                do {
-                        first_byte = fgetc (key_file->fp);
-                } while (isspace (first_byte));
+                if (*line == '[' && !contents->is_groupless) {
+                        char *end_of_name;
 
-                if (first_byte == '#') {
-                        char *line_to_toss;
-                        size_t number_of_bytes;
+                        line++;
+                        while (isspace (*line)) {
+                                line++;
+                        }
 
-                        line_to_toss = NULL;
-                        number_of_bytes = 0;
+                        end_of_name = strchr (line, ']');
+                        if (end_of_name == NULL || end_of_name == line) {
+                                ply_trace ("key file has malformed group '%s'", line);
+                                line = end_of_line;
+                                continue;
+                        }
+                        *end_of_name = '\0';
 
-                        getline (&line_to_toss, &number_of_bytes,
-                                 key_file->fp);
-                        free (line_to_toss);
-                        items_matched = 0;
+                        group = ply_key_file_contents_add_group (contents, line);
+                        line = end_of_line;
                         continue;
                 }
-                ungetc (first_byte, key_file->fp);
 
-                offset = ftello (key_file->fp);
-                items_matched = fscanf (key_file->fp, " %m[^= \t\n] = %m[^\n] ", &key, &value);
+                key = line;
+                line += strcspn (line, "= \t");
+                value = line + strspn (line, " \t");
 
-                if (items_matched != 2) {
-                        if (items_matched == 1)
-                                fseeko (key_file->fp, offset, SEEK_SET);
+                if (group == NULL || line == key || *value != '=') {
+                        ply_trace ("key file has malformed line '%s'", key);
+                        line = end_of_line;
+                        continue;
+                }
+                *line = '\0';
 
-                        free (key);
-                        free (value);
-                        break;
+                value++;
+                while (isspace (*value)) {
+                        value++;
                 }
 
-                entry = calloc (1, sizeof(ply_key_file_entry_t));
+                line = end_of_line;
+
+                if (*value == '\0')
+                        continue;
 
+                entry = &contents->entries[contents->number_of_entries++];
                 entry->key = key;
                 entry->value = value;
 
                 ply_hashtable_insert (group->entries, entry->key, entry);
-        } while (items_matched != EOF);
-
-        return group;
+        }
 }
 
 static bool
-ply_key_file_load_groups (ply_key_file_t *key_file)
+ply_key_file_contents_matches (ply_key_file_contents_t *contents,
+                               const char              *filename,
+                               const struct stat       *file_info,
+                               bool                     is_groupless)
 {
-        int items_matched;
-        bool added_group = false;
-        bool has_comments = false;
+        return contents->is_groupless == is_groupless &&
+               contents->device == file_info->st_dev &&
+               contents->inode == file_info->st_ino &&
+               contents->size == file_info->st_size &&
+               contents->modification_time.tv_sec == file_info->st_mtim.tv_sec &&
+               contents->modification_time.tv_nsec == file_info->st_mtim.tv_nsec &&
+               strcmp (contents->filename, filename) == 0;
+}
 
-        do {
-                char *group_name;
-                int first_byte;
+static void
+ply_key_file_cache_contents (ply_key_file_contents_t *contents)
+{
+        ply_list_node_t *node;
 
-                ply_key_file_group_t *group;
+        if (contents_cache == NULL)
+                contents_cache = ply_list_new ();
 
-                first_byte = fgetc (key_file->fp);
-                if (first_byte == '#') {
-                        char *line_to_toss;
-                        size_t number_of_bytes;
+        contents->reference_count++;
+        ply_list_prepend_data (contents_cache, contents);
 
-                        line_to_toss = NULL;
-                        number_of_bytes = 0;
+        while (ply_list_get_length (contents_cache) > PLY_KEY_FILE_CACHE_SIZE) {
+                node = ply_list_get_last_node (contents_cache);
+                ply_key_file_contents_unref (ply_list_node_get_data (node));
+                ply_list_remove_node (contents_cache, node);
+        }
+}
+
+static ply_key_file_contents_t *
+ply_key_file_look_up_cached_contents (const char        *filename,
+                                      const struct stat *file_info,
+                                      bool               is_groupless)
+{
+        ply_list_node_t *node;
 
-                        getline (&line_to_toss, &number_of_bytes,
-                                 key_file->fp);
-                        free (line_to_toss);
-                        has_comments = true;
-                        items_matched = 0;
+        if (contents_cache == NULL)
+                return NULL;
+
+        node = ply_list_get_first_node (contents_cache);
+        while (node != NULL) {
+                ply_key_file_contents_t *contents = ply_list_node_get_data (node);
+                ply_list_node_t *next_node = ply_list_get_next_node (contents_cache, node);
+
+                if (strcmp (contents->filename, filename) != 0) {
+                        node = next_node;
                         continue;
                 }
-                ungetc (first_byte, key_file->fp);
-
-                group_name = NULL;
-                items_matched = fscanf (key_file->fp, " [ %m[^]] ] ", &group_name);
 
-                if (items_matched <= 0) {
-                        ply_trace ("key file has no %sgroups",
-                                   added_group ? "more " : "");
-                        break;
+                /* The file changed since it was parsed, so this is stale */
+                if (!ply_key_file_contents_matches (contents, filename, file_info, is_groupless)) {
+                        if (contents->is_groupless == is_groupless) {
+                                ply_list_remove_node (contents_cache, node);
+                                ply_key_file_contents_unref (contents);
+                        }
+                        node = next_node;
+                        continue;
                 }
 
-                assert (group_name != NULL);
-                group = ply_key_file_load_group (key_file, group_name);
+                ply_list_remove_node (contents_cache, node);
+                ply_list_prepend_data (contents_cache, contents);
+
+                return contents;
+        }
+
+        return NULL;
+}
+
+static ply_key_file_contents_t *
+ply_key_file_get_contents (ply_key_file_t *key_file,
+                           bool            is_groupless)
+{
+        ply_key_file_contents_t *contents;
+        struct stat file_info;
+        int fd;
+
+        assert (key_file != NULL);
+
+        if (stat (key_file->filename, &file_info) < 0) {
+                ply_trace ("Failed to open key file %s: %m",
+                           key_file->filename);
+                return NULL;
+        }
 
-                free (group_name);
+        contents = ply_key_file_look_up_cached_contents (key_file->filename, &file_info, is_groupless);
+        if (contents != NULL) {
+                contents->reference_count++;
+                return contents;
+        }
 
-                if (group == NULL)
-                        break;
+        fd = open (key_file->filename, O_RDONLY | O_CLOEXEC);
 
-                ply_hashtable_insert (key_file->groups, group->name, group);
-                added_group = true;
-        } while (items_matched != EOF);
+        if (fd < 0 || fstat (fd, &file_info) < 0) {
+                ply_trace ("Failed to open key file %s: %m",
+                           key_file->filename);
+                if (fd >= 0)
+                        close (fd);
+                return NULL;
+        }
 
-        if (!added_group && has_comments)
-                ply_trace ("key file has comments but no groups");
+        contents = calloc (1, sizeof(ply_key_file_contents_t));
+        contents->filename = strdup (key_file->filename);
+        contents->device = file_info.st_dev;
+        contents->inode = file_info.st_ino;
+        contents->size = file_info.st_size;
+        contents->modification_time = file_info.st_mtim;
+        contents->is_groupless = is_groupless;
+        contents->reference_count = 1;
+
+        contents->buffer = malloc (file_info.st_size + 1);
+        if (file_info.st_size > 0 &&
+            !ply_read (fd, contents->buffer, file_info.st_size)) {
+                ply_trace ("Failed to read key file %s: %m",
+                           key_file->filename);
+                close (fd);
+                ply_key_file_contents_unref (contents);
+                return NULL;
+        }
+        contents->buffer[file_info.st_size] = '\0';
+        close (fd);
 
-        return added_group;
+        ply_key_file_contents_parse (contents);
+        ply_key_file_cache_contents (contents);
+
+        return contents;
 }
 
 bool
 ply_key_file_load (ply_key_file_t *key_file)
 {
-        bool was_loaded;
+        ply_key_file_contents_t *contents;
 
         assert (key_file != NULL);
 
-        if (!ply_key_file_open_file (key_file))
+        contents = ply_key_file_get_contents (key_file, false);
+
+        if (contents == NULL)
                 return false;
 
-        was_loaded = ply_key_file_load_groups (key_file);
+        ply_key_file_contents_unref (key_file->contents);
+        key_file->contents = contents;
 
-        if (!was_loaded)
+        if (contents->number_of_groups == 0) {
                 ply_trace ("was unable to load any groups");
+                return false;
+        }
 
-        ply_key_file_close_file (key_file);
-
-        return was_loaded;
+        return true;
 }
 
 static ply_key_file_group_t *
 ply_key_file_find_group (ply_key_file_t *key_file,
                          const char     *group_name)
 {
+        if (key_file->contents == NULL)
+                return NULL;
+
         if (!group_name)
-                return key_file->groupless_group;
+                return key_file->contents->groupless_group;
 
-        return ply_hashtable_lookup (key_file->groups, (void *) group_name);
+        return ply_hashtable_lookup (key_file->contents->groups, (void *) group_name);
 }
 
 static ply_key_file_entry_t *
@@ -337,10 +470,10 @@ ply_key_file_has_key (ply_key_file_t *key_file,
         return entry != NULL;
 }
 
-static char *
-ply_key_file_get_raw_value (ply_key_file_t *key_file,
-                            const char     *group_name,
-                            const char     *key)
+const char *
+ply_key_file_peek_value (ply_key_file_t *key_file,
+                         const char     *group_name,
+                         const char     *key)
 {
         ply_key_file_group_t *group;
         ply_key_file_entry_t *entry;
@@ -367,7 +500,7 @@ ply_key_file_get_value (ply_key_file_t *key_file,
                         const char     *group,
                         const char     *key)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        const char *raw_value = ply_key_file_peek_value (key_file, group, key);
 
         return raw_value ? strdup (raw_value) : NULL;
 }
@@ -377,7 +510,7 @@ ply_key_file_get_bool (ply_key_file_t *key_file,
                        const char     *group,
                        const char     *key)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        const char *raw_value = ply_key_file_peek_value (key_file, group, key);
 
         if (!raw_value)
                 return false;
@@ -398,7 +531,7 @@ ply_key_file_get_double (ply_key_file_t *key_file,
                          const char     *key,
                          double          default_value)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        const char *raw_value = ply_key_file_peek_value (key_file, group, key);
 
         if (!raw_value)
                 return default_value;
@@ -412,7 +545,7 @@ ply_key_file_get_long (ply_key_file_t *key_file,
                        const char     *key,
                        long            default_value)
 {
-        char *raw_value = ply_key_file_get_raw_value (key_file, group, key);
+        const char *raw_value = ply_key_file_peek_value (key_file, group, key);
 
         if (!raw_value)
                 return default_value;
@@ -461,9 +594,12 @@ ply_key_file_foreach_entry (ply_key_file_t             *key_file,
 {
         ply_key_file_foreach_func_data_t func_data;
 
+        if (key_file->contents == NULL)
+                return;
+
         func_data.func = func;
         func_data.user_data = user_data;
-        ply_hashtable_foreach (key_file->groups,
+        ply_hashtable_foreach (key_file->contents->groups,
                                ply_key_file_foreach_entry_groups,
                                &func_data);
 }
@@ -471,14 +607,17 @@ ply_key_file_foreach_entry (ply_key_file_t             *key_file,
 bool
 ply_key_file_load_groupless_file (ply_key_file_t *key_file)
 {
-        if (!ply_key_file_open_file (key_file))
-                return false;
+        ply_key_file_contents_t *contents;
 
-        key_file->groupless_group =
-                ply_key_file_load_group (key_file, "NONE");
+        assert (key_file != NULL);
 
-        ply_key_file_close_file (key_file);
+        contents = ply_key_file_get_contents (key_file, true);
 
-        return key_file->groupless_group != NULL;
-}
+        if (contents == NULL)
+                return false;
 
+        ply_key_file_contents_unref (key_file->contents);
+        key_file->contents = contents;
+
+        return true;
+}
@@ -47,6 +47,12 @@ bool ply_key_file_has_key (ply_key_file_t *key_file,
 char *ply_key_file_get_value (ply_key_file_t *key_file,
                               const char     *group_name,
                               const char     *key);
+/* Like ply_key_file_get_value, but the returned string belongs to the key
+ * file and is only valid until it's freed
+ */
+const char *ply_key_file_peek_value (ply_key_file_t *key_file,
+                                     const char     *group_name,
+                                     const char     *key);
 /* Note this returns false for non existing keys */
 bool ply_key_file_get_bool (ply_key_file_t *key_file,
                             const char     *group_name,
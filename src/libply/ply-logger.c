@@ -23,8 +23,10 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +38,11 @@
 #include <time.h>
 #include <unistd.h>
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "ply-buffer.h"
 #include "ply-utils.h"
 #include "ply-list.h"
 
@@ -51,27 +58,83 @@
 #define PLY_LOGGER_MAX_BUFFER_CAPACITY (8 * 4096)
 #endif
 
+#ifndef PLY_LOGGER_COMPRESSION_LEVEL
+#define PLY_LOGGER_COMPRESSION_LEVEL 3
+#endif
+
+#define PLY_LOGGER_STRUCTURED_MAGIC "PLYLOG\0\1"
+
+/* Structured logs start with this header, every time the file is opened,
+ * followed by records. All fields are little endian.
+ */
+typedef struct
+{
+        char     magic[8];
+        uint64_t wall_clock_time;
+        uint64_t monotonic_time;
+} ply_logger_file_header_t;
+
+typedef struct
+{
+        uint64_t timestamp;
+        uint32_t size;
+        uint8_t  source;
+        uint8_t  padding[3];
+} ply_logger_record_header_t;
+
 typedef struct
 {
         ply_logger_filter_handler_t handler;
         void                       *user_data;
 } ply_logger_filter_t;
 
+typedef struct
+{
+        int           output_fd;
+        ply_buffer_t *output;
+
+        char         *bytes;
+        size_t        size;
+        size_t        capacity;
+
+        int           last_source;
+        uint32_t      has_seen_header : 1;
+        uint32_t      is_at_line_start : 1;
+} ply_logger_decoder_t;
+
 struct _ply_logger
 {
         int                       output_fd;
         bool                      output_fd_is_terminal;
         char                     *filename;
 
+        /* A ring of buffer_capacity bytes. The offsets only ever grow,
+         * the unflushed bytes are the ones between them.
+         */
         char                     *buffer;
-        size_t                    buffer_size;
         size_t                    buffer_capacity;
+        uint64_t                  read_offset;
+        uint64_t                  write_offset;
+        uint32_t                  dropped_record_count;
 
         ply_logger_flush_policy_t flush_policy;
+        ply_logger_format_t       format;
         ply_list_t               *filters;
 
+#ifdef HAVE_ZSTD
+        ZSTD_CCtx                *compressor;
+#endif
+
+        pthread_t                 writer_thread;
+        pthread_mutex_t           mutex;
+        pthread_cond_t            has_data_to_write;
+        pthread_cond_t            writer_is_idle;
+        bool                      writer_is_busy;
+        bool                      writer_should_exit;
+
         uint32_t                  is_enabled : 1;
         uint32_t                  tracing_is_enabled : 1;
+        uint32_t                  has_background_writer : 1;
 };
 
 static bool ply_text_is_loggable (const char *string,
@@ -106,6 +169,10 @@ ply_logger_write_exception (ply_logger_t *logger,
         char *message;
         int number_of_bytes;
 
+        /* There's no room for free form text in a structured log */
+        if (logger->format != PLY_LOGGER_FORMAT_PLAIN)
+                return;
+
         if (!ply_text_is_loggable (string, -1))
                 return;
 
@@ -146,81 +213,383 @@ ply_logger_write (ply_logger_t *logger,
         return true;
 }
 
+#ifdef HAVE_ZSTD
 static bool
-ply_logger_flush_buffer (ply_logger_t *logger)
+ply_logger_compress (ply_logger_t     *logger,
+                     const void       *bytes,
+                     size_t            size,
+                     ZSTD_EndDirective directive)
 {
-        assert (logger != NULL);
+        ZSTD_inBuffer input = { bytes, size, 0 };
+        char chunk[4096];
+        size_t bytes_left;
 
-        if (logger->buffer_size == 0)
-                return true;
+        do {
+                ZSTD_outBuffer output = { chunk, sizeof(chunk), 0 };
 
-        if (!ply_logger_write (logger, logger->buffer, logger->buffer_size, true))
-                return false;
+                bytes_left = ZSTD_compressStream2 (logger->compressor, &output, &input, directive);
 
-        memset (logger->buffer, '\0', logger->buffer_size);
-        logger->buffer_size = 0;
+                if (ZSTD_isError (bytes_left))
+                        return false;
+
+                if (output.pos > 0 && !ply_write (logger->output_fd, chunk, output.pos))
+                        return false;
+        } while (directive == ZSTD_e_continue ? input.pos < input.size : bytes_left != 0);
+
+        return true;
+}
+#endif
+
+static bool
+ply_logger_write_encoded (ply_logger_t *logger,
+                          const char   *bytes,
+                          size_t        size,
+                          bool          should_report_failures)
+{
+#ifdef HAVE_ZSTD
+        if (logger->compressor != NULL)
+                return ply_logger_compress (logger, bytes, size, ZSTD_e_continue);
+#endif
+
+        return ply_logger_write (logger, bytes, size, should_report_failures);
+}
+
+/* Pushes out anything the compressor is holding on to, so the file can be
+ * decoded up to this point. Ending the stream closes the current frame.
+ */
+static bool
+ply_logger_flush_encoder (ply_logger_t *logger,
+                          bool          should_end_stream)
+{
+#ifdef HAVE_ZSTD
+        if (logger->compressor != NULL)
+                return ply_logger_compress (logger, NULL, 0,
+                                            should_end_stream ? ZSTD_e_end : ZSTD_e_flush);
+#endif
 
         return true;
 }
 
+static void
+ply_logger_lock (ply_logger_t *logger)
+{
+        if (logger->has_background_writer)
+                pthread_mutex_lock (&logger->mutex);
+}
+
+static void
+ply_logger_unlock (ply_logger_t *logger)
+{
+        if (logger->has_background_writer)
+                pthread_mutex_unlock (&logger->mutex);
+}
+
+/* Must be called with the lock held. Once this returns the writer won't
+ * touch the output fd until the lock is dropped.
+ */
+static void
+ply_logger_wait_for_background_writer (ply_logger_t *logger)
+{
+        if (!logger->has_background_writer)
+                return;
+
+        while (logger->writer_is_busy) {
+                pthread_cond_wait (&logger->writer_is_idle, &logger->mutex);
+        }
+}
+
+static void
+ply_logger_copy_from_buffer (ply_logger_t *logger,
+                             uint64_t      offset,
+                             void         *bytes,
+                             size_t        length)
+{
+        size_t start, first_size;
+
+        start = offset % logger->buffer_capacity;
+        first_size = MIN (length, logger->buffer_capacity - start);
+
+        memcpy (bytes, logger->buffer + start, first_size);
+        memcpy ((char *) bytes + first_size, logger->buffer, length - first_size);
+}
+
+/* Goes ahead of the records that are left in the buffer, so the decoded log
+ * shows where the gap is
+ */
 static bool
-ply_logger_increase_buffer_size (ply_logger_t *logger)
+ply_logger_write_dropped_record_note (ply_logger_t *logger,
+                                      uint64_t      start_offset,
+                                      uint32_t      dropped_record_count)
+{
+        ply_logger_record_header_t header;
+        char note[64];
+        size_t note_size;
+
+        note_size = snprintf (note, sizeof(note), "%u earlier log records dropped\n",
+                              dropped_record_count);
+
+        ply_logger_copy_from_buffer (logger, start_offset, &header, sizeof(header));
+        header.size = htole32 (note_size);
+        header.source = PLY_LOGGER_SOURCE_STATUS;
+
+        if (!ply_logger_write_encoded (logger, (const char *) &header, sizeof(header), false))
+                return false;
+
+        return ply_logger_write_encoded (logger, note, note_size, false);
+}
+
+static bool
+ply_logger_write_range (ply_logger_t *logger,
+                        uint64_t      start_offset,
+                        uint64_t      end_offset,
+                        uint32_t      dropped_record_count,
+                        bool          should_report_failures)
+{
+        size_t start, size, first_size;
+
+        if (dropped_record_count > 0 &&
+            !ply_logger_write_dropped_record_note (logger, start_offset, dropped_record_count))
+                return false;
+
+        start = start_offset % logger->buffer_capacity;
+        size = end_offset - start_offset;
+        first_size = MIN (size, logger->buffer_capacity - start);
+
+        if (!ply_logger_write_encoded (logger, logger->buffer + start, first_size, should_report_failures))
+                return false;
+
+        if (first_size < size &&
+            !ply_logger_write_encoded (logger, logger->buffer, size - first_size, should_report_failures))
+                return false;
+
+        return ply_logger_flush_encoder (logger, false);
+}
+
+static void *
+ply_logger_run_background_writer (ply_logger_t *logger)
+{
+        pthread_mutex_lock (&logger->mutex);
+        while (true) {
+                uint64_t start_offset, end_offset;
+                uint32_t dropped_record_count;
+
+                while ((logger->read_offset == logger->write_offset || logger->output_fd < 0) &&
+                       !logger->writer_should_exit) {
+                        pthread_cond_wait (&logger->has_data_to_write, &logger->mutex);
+                }
+
+                if (logger->read_offset == logger->write_offset || logger->output_fd < 0)
+                        break;
+
+                start_offset = logger->read_offset;
+                end_offset = logger->write_offset;
+                dropped_record_count = logger->dropped_record_count;
+                logger->dropped_record_count = 0;
+                logger->writer_is_busy = true;
+                pthread_mutex_unlock (&logger->mutex);
+
+                /* Nothing else touches these bytes or the fd while we're busy,
+                 * so the slow part can happen without the lock
+                 */
+                ply_logger_write_range (logger, start_offset, end_offset,
+                                        dropped_record_count, false);
+#ifdef SYNC_ON_FLUSH
+                fdatasync (logger->output_fd);
+#endif
+
+                pthread_mutex_lock (&logger->mutex);
+                logger->read_offset = end_offset;
+                logger->writer_is_busy = false;
+                pthread_cond_broadcast (&logger->writer_is_idle);
+        }
+        pthread_mutex_unlock (&logger->mutex);
+
+        return NULL;
+}
+
+static bool
+ply_logger_flush_buffer (ply_logger_t *logger)
 {
         assert (logger != NULL);
 
-        if ((logger->buffer_capacity * 2) > PLY_LOGGER_MAX_BUFFER_CAPACITY)
+        if (logger->read_offset == logger->write_offset)
+                return true;
+
+        if (!ply_logger_write_range (logger, logger->read_offset, logger->write_offset,
+                                     logger->dropped_record_count, true))
                 return false;
 
-        logger->buffer_capacity *= 2;
+        logger->read_offset = logger->write_offset;
+        logger->dropped_record_count = 0;
 
-        logger->buffer = realloc (logger->buffer, logger->buffer_capacity);
         return true;
 }
 
 static void
-ply_logger_decapitate_buffer (ply_logger_t *logger,
-                              size_t        bytes_in_head)
+ply_logger_copy_to_buffer (ply_logger_t *logger,
+                           const char   *bytes,
+                           size_t        length)
 {
-        assert (logger != NULL);
+        size_t start, first_size;
 
-        bytes_in_head = MIN (logger->buffer_size, bytes_in_head);
+        start = logger->write_offset % logger->buffer_capacity;
+        first_size = MIN (length, logger->buffer_capacity - start);
 
-        if (bytes_in_head == logger->buffer_size) {
-                logger->buffer_size = 0;
-        } else {
-                memmove (logger->buffer, logger->buffer + bytes_in_head,
-                         logger->buffer_size - bytes_in_head);
-                logger->buffer_size -= bytes_in_head;
-        }
+        memcpy (logger->buffer + start, bytes, first_size);
+        memcpy (logger->buffer, bytes + first_size, length - first_size);
+
+        logger->write_offset += length;
 }
 
+/* When the ring fills up the oldest bytes make way for the new ones. If a
+ * background writer already has them queued up for the log file, the new
+ * bytes are dropped instead, since waiting on the disk is what we're trying
+ * to avoid.
+ */
 static bool
 ply_logger_buffer (ply_logger_t *logger,
                    const char   *string,
                    size_t        length)
 {
+        size_t available;
+
         assert (logger != NULL);
 
-        if ((logger->buffer_size + length) >= logger->buffer_capacity) {
-                if (!ply_logger_increase_buffer_size (logger)) {
-                        ply_logger_decapitate_buffer (logger, length);
+        if (length > logger->buffer_capacity) {
+                string += length - logger->buffer_capacity;
+                length = logger->buffer_capacity;
+        }
+
+        ply_logger_lock (logger);
+
+        available = logger->buffer_capacity - (logger->write_offset - logger->read_offset);
 
-                        if ((logger->buffer_size + length) >= logger->buffer_capacity)
-                                if (!ply_logger_increase_buffer_size (logger))
-                                        return false;
+        if (length > available) {
+                if (logger->has_background_writer && logger->output_fd >= 0) {
+                        ply_logger_unlock (logger);
+                        return false;
                 }
+
+                logger->read_offset += length - available;
         }
 
-        assert (logger->buffer_size + length < logger->buffer_capacity);
+        ply_logger_copy_to_buffer (logger, string, length);
 
-        memcpy (logger->buffer + logger->buffer_size,
-                string, length);
+        ply_logger_unlock (logger);
 
-        logger->buffer_size += length;
+        return true;
+}
+
+/* Must be called with the lock held. Records are only ever dropped whole,
+ * since losing part of one would make the rest of the log unreadable. Like
+ * plain text, the oldest go first, unless a background writer already has
+ * them queued up for the log file.
+ */
+static bool
+ply_logger_make_room_for_record (ply_logger_t *logger,
+                                 size_t        size)
+{
+        while (logger->buffer_capacity - (logger->write_offset - logger->read_offset) < size) {
+                ply_logger_record_header_t header;
+
+                if (logger->has_background_writer && logger->output_fd >= 0)
+                        return false;
+
+                ply_logger_copy_from_buffer (logger, logger->read_offset, &header, sizeof(header));
+                logger->read_offset += sizeof(header) + le32toh (header.size);
+                logger->dropped_record_count++;
+        }
 
         return true;
 }
 
+static void
+ply_logger_copy_record_to_buffer (ply_logger_t       *logger,
+                                  ply_logger_source_t source,
+                                  uint64_t            timestamp,
+                                  const char         *bytes,
+                                  size_t              length)
+{
+        ply_logger_record_header_t header = { 0 };
+
+        header.timestamp = htole64 (timestamp);
+        header.size = htole32 (length);
+        header.source = source;
+
+        ply_logger_copy_to_buffer (logger, (const char *) &header, sizeof(header));
+        ply_logger_copy_to_buffer (logger, bytes, length);
+}
+
+static bool
+ply_logger_buffer_record (ply_logger_t       *logger,
+                          ply_logger_source_t source,
+                          const char         *bytes,
+                          size_t              length)
+{
+        struct timespec now = { 0, 0 };
+        uint64_t timestamp;
+        size_t record_size;
+        bool is_buffered;
+
+        if (logger->format == PLY_LOGGER_FORMAT_PLAIN)
+                return ply_logger_buffer (logger, bytes, length);
+
+        if (length > logger->buffer_capacity - sizeof(ply_logger_record_header_t)) {
+                bytes += length - (logger->buffer_capacity - sizeof(ply_logger_record_header_t));
+                length = logger->buffer_capacity - sizeof(ply_logger_record_header_t);
+        }
+        record_size = sizeof(ply_logger_record_header_t) + length;
+
+        clock_gettime (CLOCK_MONOTONIC, &now);
+        timestamp = (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+
+        ply_logger_lock (logger);
+
+        is_buffered = ply_logger_make_room_for_record (logger, record_size);
+
+        if (is_buffered)
+                ply_logger_copy_record_to_buffer (logger, source, timestamp, bytes, length);
+        else
+                logger->dropped_record_count++;
+
+        ply_logger_unlock (logger);
+
+        return is_buffered;
+}
+
+static bool
+ply_logger_write_header (ply_logger_t *logger)
+{
+        char header[80];
+        struct tm *tm;
+        time_t t;
+
+        if (logger->format != PLY_LOGGER_FORMAT_PLAIN) {
+                ply_logger_file_header_t file_header = { PLY_LOGGER_STRUCTURED_MAGIC, 0, 0 };
+                struct timespec now = { 0, 0 };
+
+                clock_gettime (CLOCK_REALTIME, &now);
+                file_header.wall_clock_time = htole64 ((uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+                clock_gettime (CLOCK_MONOTONIC, &now);
+                file_header.monotonic_time = htole64 ((uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+
+                if (!ply_logger_write_encoded (logger, (const char *) &file_header, sizeof(file_header), true))
+                        return false;
+
+                return ply_logger_flush_encoder (logger, false);
+        }
+
+        time (&t);
+        tm = localtime (&t);
+        if (tm == NULL)
+                return true;
+
+        /* This uses uname -v date format */
+        strftime (header, sizeof(header),
+                  "------------ %a %b %d %T %Z %Y ------------\n", tm);
+        return ply_logger_write (logger, header, strlen (header), true);
+}
+
 ply_logger_t *
 ply_logger_new (void)
 {
@@ -234,9 +603,8 @@ ply_logger_new (void)
         logger->is_enabled = true;
         logger->tracing_is_enabled = false;
 
-        logger->buffer_capacity = 4096;
+        logger->buffer_capacity = PLY_LOGGER_MAX_BUFFER_CAPACITY;
         logger->buffer = calloc (1, logger->buffer_capacity);
-        logger->buffer_size = 0;
 
         logger->filters = ply_list_new ();
 
@@ -297,12 +665,30 @@ ply_logger_free (ply_logger_t *logger)
         if (logger == NULL)
                 return;
 
+        if (logger->output_fd >= 0 && ply_logger_is_logging (logger))
+                ply_logger_flush (logger);
+
+        if (logger->has_background_writer) {
+                pthread_mutex_lock (&logger->mutex);
+                logger->writer_should_exit = true;
+                pthread_cond_signal (&logger->has_data_to_write);
+                pthread_mutex_unlock (&logger->mutex);
+
+                pthread_join (logger->writer_thread, NULL);
+                pthread_cond_destroy (&logger->writer_is_idle);
+                pthread_cond_destroy (&logger->has_data_to_write);
+                pthread_mutex_destroy (&logger->mutex);
+        }
+
         if (logger->output_fd >= 0) {
-                if (ply_logger_is_logging (logger))
-                        ply_logger_flush (logger);
+                ply_logger_flush_encoder (logger, true);
                 close (logger->output_fd);
         }
 
+#ifdef HAVE_ZSTD
+        ZSTD_freeCCtx (logger->compressor);
+#endif
+
         ply_logger_free_filters (logger);
 
         free (logger->filename);
@@ -314,9 +700,6 @@ bool
 ply_logger_open_file (ply_logger_t *logger,
                       const char   *filename)
 {
-        char header[80];
-        struct tm *tm;
-        time_t t;
         int fd;
 
         assert (logger != NULL);
@@ -327,20 +710,30 @@ ply_logger_open_file (ply_logger_t *logger,
         if (fd < 0)
                 return false;
 
-        ply_logger_set_output_fd (logger, fd);
+        ply_logger_lock (logger);
+        ply_logger_wait_for_background_writer (logger);
+
+        /* Finish off the old file, so it can still be decoded on its own */
+        if (logger->output_fd >= 0) {
+                ply_logger_flush_buffer (logger);
+                ply_logger_flush_encoder (logger, true);
+        }
+
+        logger->output_fd = fd;
+        logger->output_fd_is_terminal = isatty (fd);
 
         free (logger->filename);
 
         logger->filename = strdup (filename);
 
-        time (&t);
-        tm = localtime (&t);
-        if (tm) {
-                /* This uses uname -v date format */
-                strftime (header, sizeof(header),
-                          "------------ %a %b %d %T %Z %Y ------------\n", tm);
-                ply_logger_write (logger, header, strlen (header), true);
-        }
+#ifdef HAVE_ZSTD
+        if (logger->compressor != NULL)
+                ZSTD_CCtx_reset (logger->compressor, ZSTD_reset_session_only);
+#endif
+
+        ply_logger_write_header (logger);
+
+        ply_logger_unlock (logger);
 
         return true;
 }
@@ -353,8 +746,15 @@ ply_logger_close_file (ply_logger_t *logger)
         if (logger->output_fd < 0)
                 return;
 
+        ply_logger_lock (logger);
+        ply_logger_wait_for_background_writer (logger);
+
+        ply_logger_flush_encoder (logger, true);
         close (logger->output_fd);
-        ply_logger_set_output_fd (logger, -1);
+        logger->output_fd = -1;
+        logger->output_fd_is_terminal = false;
+
+        ply_logger_unlock (logger);
 }
 
 void
@@ -363,8 +763,16 @@ ply_logger_set_output_fd (ply_logger_t *logger,
 {
         assert (logger != NULL);
 
+        ply_logger_lock (logger);
+        ply_logger_wait_for_background_writer (logger);
+
+        if (logger->output_fd >= 0)
+                ply_logger_flush_encoder (logger, true);
+
         logger->output_fd = fd;
         logger->output_fd_is_terminal = isatty (fd);
+
+        ply_logger_unlock (logger);
 }
 
 int
@@ -386,6 +794,13 @@ ply_logger_flush (ply_logger_t *logger)
         if (logger->output_fd < 0)
                 return false;
 
+        if (logger->has_background_writer) {
+                pthread_mutex_lock (&logger->mutex);
+                pthread_cond_signal (&logger->has_data_to_write);
+                pthread_mutex_unlock (&logger->mutex);
+                return true;
+        }
+
         if (!ply_logger_flush_buffer (logger))
                 return false;
 
@@ -398,6 +813,81 @@ ply_logger_flush (ply_logger_t *logger)
         return true;
 }
 
+/* Must be picked before anything is logged. Structured logs are made of
+ * timestamped records tagged with where they came from, and can also be
+ * compressed if plymouth was built with zstd.
+ */
+bool
+ply_logger_set_format (ply_logger_t       *logger,
+                       ply_logger_format_t format)
+{
+        assert (logger != NULL);
+        assert (logger->write_offset == 0);
+
+        if (format == logger->format)
+                return true;
+
+#ifdef HAVE_ZSTD
+        ZSTD_freeCCtx (logger->compressor);
+        logger->compressor = NULL;
+
+        if (format == PLY_LOGGER_FORMAT_COMPRESSED) {
+                logger->compressor = ZSTD_createCCtx ();
+
+                if (logger->compressor == NULL)
+                        return false;
+
+                ZSTD_CCtx_setParameter (logger->compressor, ZSTD_c_compressionLevel,
+                                        PLY_LOGGER_COMPRESSION_LEVEL);
+        }
+#else
+        if (format == PLY_LOGGER_FORMAT_COMPRESSED)
+                return false;
+#endif
+
+        logger->format = format;
+
+        return true;
+}
+
+ply_logger_format_t
+ply_logger_get_format (ply_logger_t *logger)
+{
+        assert (logger != NULL);
+
+        return logger->format;
+}
+
+/* Hands flushes off to a thread, so writing the log never blocks the caller
+ * on slow storage. Everything buffered still gets written before the logger
+ * is freed.
+ */
+bool
+ply_logger_enable_background_writer (ply_logger_t *logger)
+{
+        assert (logger != NULL);
+
+        if (logger->has_background_writer)
+                return true;
+
+        pthread_mutex_init (&logger->mutex, NULL);
+        pthread_cond_init (&logger->has_data_to_write, NULL);
+        pthread_cond_init (&logger->writer_is_idle, NULL);
+
+        if (pthread_create (&logger->writer_thread, NULL,
+                            (void *(*)(void *)) ply_logger_run_background_writer,
+                            logger) != 0) {
+                pthread_cond_destroy (&logger->writer_is_idle);
+                pthread_cond_destroy (&logger->has_data_to_write);
+                pthread_mutex_destroy (&logger->mutex);
+                return false;
+        }
+
+        logger->has_background_writer = true;
+
+        return true;
+}
+
 void
 ply_logger_set_flush_policy (ply_logger_t             *logger,
                              ply_logger_flush_policy_t policy)
@@ -495,6 +985,16 @@ void
 ply_logger_inject_bytes (ply_logger_t *logger,
                          const void   *bytes,
                          size_t        number_of_bytes)
+{
+        ply_logger_inject_record (logger, PLY_LOGGER_SOURCE_CONSOLE,
+                                  bytes, number_of_bytes);
+}
+
+void
+ply_logger_inject_record (ply_logger_t       *logger,
+                          ply_logger_source_t source,
+                          const void         *bytes,
+                          size_t              number_of_bytes)
 {
         ply_list_node_t *node;
         void *filtered_bytes;
@@ -538,9 +1038,9 @@ ply_logger_inject_bytes (ply_logger_t *logger,
         }
 
         if (filtered_bytes == NULL) {
-                ply_logger_buffer (logger, bytes, number_of_bytes);
+                ply_logger_buffer_record (logger, source, bytes, number_of_bytes);
         } else {
-                ply_logger_buffer (logger, filtered_bytes, filtered_size);
+                ply_logger_buffer_record (logger, source, filtered_bytes, filtered_size);
                 free (filtered_bytes);
         }
 
@@ -551,6 +1051,275 @@ ply_logger_inject_bytes (ply_logger_t *logger,
                 ply_logger_flush (logger);
 }
 
+static const char *
+ply_logger_get_source_name (int source)
+{
+        switch (source) {
+        case PLY_LOGGER_SOURCE_CONSOLE:
+                return "console";
+        case PLY_LOGGER_SOURCE_KERNEL:
+                return "kernel";
+        case PLY_LOGGER_SOURCE_STATUS:
+                return "status";
+        case PLY_LOGGER_SOURCE_PLUGIN:
+                return "plugin";
+        }
+
+        return "unknown";
+}
+
+static bool
+ply_logger_decoder_flush_output (ply_logger_decoder_t *decoder)
+{
+        bool written;
+
+        written = ply_write (decoder->output_fd,
+                             ply_buffer_get_bytes (decoder->output),
+                             ply_buffer_get_size (decoder->output));
+        ply_buffer_clear (decoder->output);
+
+        return written;
+}
+
+static void
+ply_logger_decoder_write_header (ply_logger_decoder_t           *decoder,
+                                 const ply_logger_file_header_t *file_header)
+{
+        char header[80];
+        struct tm *tm;
+        time_t t;
+
+        if (!decoder->is_at_line_start)
+                ply_buffer_append_bytes (decoder->output, "\n", 1);
+
+        decoder->is_at_line_start = true;
+        decoder->last_source = -1;
+
+        t = le64toh (file_header->wall_clock_time) / 1000000;
+        tm = localtime (&t);
+        if (tm == NULL)
+                return;
+
+        strftime (header, sizeof(header),
+                  "------------ %a %b %d %T %Z %Y ------------\n", tm);
+        ply_buffer_append_bytes (decoder->output, header, strlen (header));
+}
+
+/* Each line gets the time and source of the record it started in. Console
+ * output can stop mid line, so a line is only broken up if something else
+ * gets logged before it's finished.
+ */
+static void
+ply_logger_decoder_write_record (ply_logger_decoder_t             *decoder,
+                                 const ply_logger_record_header_t *record_header,
+                                 const char                       *bytes)
+{
+        uint64_t timestamp;
+        size_t size;
+
+        timestamp = le64toh (record_header->timestamp);
+        size = le32toh (record_header->size);
+
+        if (!decoder->is_at_line_start && record_header->source != decoder->last_source) {
+                ply_buffer_append_bytes (decoder->output, "\n", 1);
+                decoder->is_at_line_start = true;
+        }
+
+        while (size > 0) {
+                const char *end_of_line;
+                size_t line_size;
+
+                if (decoder->is_at_line_start)
+                        ply_buffer_append (decoder->output, "[%5llu.%06llu] %-7s ",
+                                           (unsigned long long) (timestamp / 1000000),
+                                           (unsigned long long) (timestamp % 1000000),
+                                           ply_logger_get_source_name (record_header->source));
+
+                end_of_line = memchr (bytes, '\n', size);
+                line_size = end_of_line != NULL ? (size_t) (end_of_line - bytes) + 1 : size;
+
+                ply_buffer_append_bytes (decoder->output, bytes, line_size);
+                decoder->is_at_line_start = end_of_line != NULL;
+
+                bytes += line_size;
+                size -= line_size;
+        }
+
+        decoder->last_source = record_header->source;
+
+        /* Only console output is expected to bring its own newlines */
+        if (!decoder->is_at_line_start && record_header->source != PLY_LOGGER_SOURCE_CONSOLE) {
+                ply_buffer_append_bytes (decoder->output, "\n", 1);
+                decoder->is_at_line_start = true;
+        }
+}
+
+static bool
+ply_logger_decoder_add_bytes (ply_logger_decoder_t *decoder,
+                              const char           *bytes,
+                              size_t                size)
+{
+        size_t offset;
+
+        if (decoder->size + size > decoder->capacity) {
+                decoder->capacity = MAX (decoder->size + size, 2 * decoder->capacity);
+                decoder->bytes = realloc (decoder->bytes, decoder->capacity);
+        }
+        memcpy (decoder->bytes + decoder->size, bytes, size);
+        decoder->size += size;
+
+        offset = 0;
+        while (decoder->size - offset >= sizeof(ply_logger_record_header_t)) {
+                ply_logger_record_header_t record_header;
+                size_t record_size;
+
+                if (memcmp (decoder->bytes + offset, PLY_LOGGER_STRUCTURED_MAGIC,
+                            sizeof(PLY_LOGGER_STRUCTURED_MAGIC) - 1) == 0) {
+                        ply_logger_file_header_t file_header;
+
+                        /* The rest of the file header hasn't arrived yet */
+                        if (decoder->size - offset < sizeof(file_header))
+                                break;
+
+                        memcpy (&file_header, decoder->bytes + offset, sizeof(file_header));
+                        ply_logger_decoder_write_header (decoder, &file_header);
+                        decoder->has_seen_header = true;
+                        offset += sizeof(file_header);
+                        continue;
+                }
+
+                if (!decoder->has_seen_header)
+                        return false;
+
+                memcpy (&record_header, decoder->bytes + offset, sizeof(record_header));
+                record_size = le32toh (record_header.size);
+
+                if (decoder->size - offset - sizeof(record_header) < record_size)
+                        break;
+
+                ply_logger_decoder_write_record (decoder, &record_header,
+                                                 decoder->bytes + offset + sizeof(record_header));
+                offset += sizeof(record_header) + record_size;
+
+                if (ply_buffer_get_size (decoder->output) >= PLY_LOGGER_MAX_BUFFER_CAPACITY &&
+                    !ply_logger_decoder_flush_output (decoder))
+                        return false;
+        }
+
+        memmove (decoder->bytes, decoder->bytes + offset, decoder->size - offset);
+        decoder->size -= offset;
+
+        return true;
+}
+
+#ifdef HAVE_ZSTD
+static bool
+ply_logger_decoder_add_compressed_bytes (ply_logger_decoder_t *decoder,
+                                         ZSTD_DCtx            *decompressor,
+                                         const char           *bytes,
+                                         size_t                size)
+{
+        ZSTD_inBuffer input = { bytes, size, 0 };
+        char chunk[4096];
+
+        while (input.pos < input.size) {
+                ZSTD_outBuffer output = { chunk, sizeof(chunk), 0 };
+                size_t result;
+
+                result = ZSTD_decompressStream (decompressor, &output, &input);
+
+                if (ZSTD_isError (result))
+                        return false;
+
+                if (!ply_logger_decoder_add_bytes (decoder, chunk, output.pos))
+                        return false;
+        }
+
+        return true;
+}
+#endif
+
+/* Turns a structured log, compressed or not, back into readable text */
+bool
+ply_logger_decode_file (const char *filename,
+                        int         output_fd)
+{
+        static const char zstd_magic[] = { 0x28, (char) 0xb5, 0x2f, (char) 0xfd };
+        ply_logger_decoder_t decoder = { 0 };
+        char bytes[4096];
+        ssize_t bytes_read;
+        bool is_compressed = false, is_decoded = true, is_first_read = true;
+        int fd;
+
+#ifdef HAVE_ZSTD
+        ZSTD_DCtx *decompressor = NULL;
+#endif
+
+        fd = open (filename, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+                return false;
+
+        decoder.output_fd = output_fd;
+        decoder.output = ply_buffer_new ();
+        decoder.last_source = -1;
+        decoder.is_at_line_start = true;
+
+        while ((bytes_read = read (fd, bytes, sizeof(bytes))) != 0) {
+                if (bytes_read < 0) {
+                        if (errno == EINTR)
+                                continue;
+
+                        is_decoded = false;
+                        break;
+                }
+
+                if (is_first_read) {
+                        is_compressed = bytes_read >= (ssize_t) sizeof(zstd_magic) &&
+                                        memcmp (bytes, zstd_magic, sizeof(zstd_magic)) == 0;
+                        is_first_read = false;
+#ifdef HAVE_ZSTD
+                        if (is_compressed)
+                                decompressor = ZSTD_createDCtx ();
+#endif
+                }
+
+                if (!is_compressed) {
+                        is_decoded = ply_logger_decoder_add_bytes (&decoder, bytes, bytes_read);
+                } else {
+#ifdef HAVE_ZSTD
+                        is_decoded = decompressor != NULL &&
+                                     ply_logger_decoder_add_compressed_bytes (&decoder, decompressor,
+                                                                              bytes, bytes_read);
+#else
+                        is_decoded = false;
+#endif
+                }
+
+                if (!is_decoded)
+                        break;
+        }
+
+        /* Leftover bytes mean the log was cut off mid record */
+        if (decoder.size > 0 || !decoder.has_seen_header)
+                is_decoded = false;
+
+        if (!decoder.is_at_line_start)
+                ply_buffer_append_bytes (decoder.output, "\n", 1);
+
+        if (!ply_logger_decoder_flush_output (&decoder))
+                is_decoded = false;
+
+#ifdef HAVE_ZSTD
+        ZSTD_freeDCtx (decompressor);
+#endif
+        ply_buffer_free (decoder.output);
+        free (decoder.bytes);
+        close (fd);
+
+        return is_decoded;
+}
+
 void
 ply_logger_add_filter (ply_logger_t               *logger,
                        ply_logger_filter_handler_t filter_handler,
@@ -37,6 +37,21 @@ typedef enum
         PLY_LOGGER_FLUSH_POLICY_EVERY_TIME
 } ply_logger_flush_policy_t;
 
+typedef enum
+{
+        PLY_LOGGER_FORMAT_PLAIN = 0,
+        PLY_LOGGER_FORMAT_STRUCTURED,
+        PLY_LOGGER_FORMAT_COMPRESSED,
+} ply_logger_format_t;
+
+typedef enum
+{
+        PLY_LOGGER_SOURCE_CONSOLE = 0,
+        PLY_LOGGER_SOURCE_KERNEL,
+        PLY_LOGGER_SOURCE_STATUS,
+        PLY_LOGGER_SOURCE_PLUGIN,
+} ply_logger_source_t;
+
 typedef void (*ply_logger_filter_handler_t) (void         *user_data,
                                              const void   *in_bytes,
                                              size_t        in_size,
@@ -57,11 +72,21 @@ bool ply_logger_flush (ply_logger_t *logger);
 void ply_logger_set_flush_policy (ply_logger_t             *logger,
                                   ply_logger_flush_policy_t policy);
 ply_logger_flush_policy_t ply_logger_get_flush_policy (ply_logger_t *logger);
+bool ply_logger_enable_background_writer (ply_logger_t *logger);
+bool ply_logger_set_format (ply_logger_t       *logger,
+                            ply_logger_format_t format);
+ply_logger_format_t ply_logger_get_format (ply_logger_t *logger);
 void ply_logger_toggle_logging (ply_logger_t *logger);
 bool ply_logger_is_logging (ply_logger_t *logger);
 void ply_logger_inject_bytes (ply_logger_t *logger,
                               const void   *bytes,
                               size_t        number_of_bytes);
+void ply_logger_inject_record (ply_logger_t       *logger,
+                               ply_logger_source_t source,
+                               const void         *bytes,
+                               size_t              number_of_bytes);
+bool ply_logger_decode_file (const char *filename,
+                             int         output_fd);
 void ply_logger_add_filter (ply_logger_t               *logger,
                             ply_logger_filter_handler_t filter_handler,
                             void                       *user_data);
@@ -0,0 +1,260 @@
+/* ply-progress-page.c - shared memory page for boot progress
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#include "ply-progress-page.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ply-logger.h"
+
+#ifndef PLY_PROGRESS_PAGE_MAX_SAMPLE_RETRIES
+#define PLY_PROGRESS_PAGE_MAX_SAMPLE_RETRIES 16
+#endif
+
+struct _ply_progress_page
+{
+        ply_progress_page_data_t *data;
+        size_t                    size;
+        int                       fd;
+        uint32_t                  last_sequence;
+        uint32_t                  is_writable : 1;
+};
+
+ply_progress_page_t *
+ply_progress_page_new (void)
+{
+        ply_progress_page_t *page;
+        int fd;
+        void *data;
+
+        fd = memfd_create ("plymouth-progress", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+        if (fd < 0) {
+                ply_trace ("could not create progress page: %m");
+                return NULL;
+        }
+
+        if (ftruncate (fd, sizeof(ply_progress_page_data_t)) < 0) {
+                ply_trace ("could not size progress page: %m");
+                close (fd);
+                return NULL;
+        }
+
+        /* The daemon maps the page too, so make sure it can never shrink
+         * out from under that mapping.
+         */
+        if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+                ply_trace ("could not seal progress page: %m");
+                close (fd);
+                return NULL;
+        }
+
+        data = mmap (NULL, sizeof(ply_progress_page_data_t),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        if (data == MAP_FAILED) {
+                ply_trace ("could not map progress page: %m");
+                close (fd);
+                return NULL;
+        }
+
+        page = calloc (1, sizeof(ply_progress_page_t));
+        page->data = data;
+        page->size = sizeof(ply_progress_page_data_t);
+        page->fd = fd;
+        page->is_writable = true;
+
+        page->data->magic = PLY_PROGRESS_PAGE_MAGIC;
+        page->data->version = PLY_PROGRESS_PAGE_VERSION;
+
+        return page;
+}
+
+ply_progress_page_t *
+ply_progress_page_open (int fd)
+{
+        ply_progress_page_t *page;
+        struct stat file_info;
+        int seals;
+        void *data;
+
+        assert (fd >= 0);
+
+        if (fstat (fd, &file_info) < 0)
+                return NULL;
+
+        if (!S_ISREG (file_info.st_mode) ||
+            file_info.st_size < (off_t) sizeof(ply_progress_page_data_t)) {
+                ply_trace ("progress page has wrong size or type");
+                return NULL;
+        }
+
+        /* An unsealed page could be truncated while mapped, and touching
+         * it afterward would kill the daemon with SIGBUS.
+         */
+        seals = fcntl (fd, F_GET_SEALS);
+        if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+                ply_trace ("progress page is not sealed against shrinking");
+                return NULL;
+        }
+
+        data = mmap (NULL, sizeof(ply_progress_page_data_t),
+                     PROT_READ, MAP_SHARED, fd, 0);
+
+        if (data == MAP_FAILED) {
+                ply_trace ("could not map progress page: %m");
+                return NULL;
+        }
+
+        page = calloc (1, sizeof(ply_progress_page_t));
+        page->data = data;
+        page->size = sizeof(ply_progress_page_data_t);
+        page->fd = -1;
+
+        if (page->data->magic != PLY_PROGRESS_PAGE_MAGIC ||
+            page->data->version != PLY_PROGRESS_PAGE_VERSION) {
+                ply_trace ("progress page has unknown format");
+                ply_progress_page_free (page);
+                return NULL;
+        }
+
+        return page;
+}
+
+void
+ply_progress_page_free (ply_progress_page_t *page)
+{
+        if (page == NULL)
+                return;
+
+        munmap (page->data, page->size);
+
+        if (page->fd >= 0)
+                close (page->fd);
+
+        free (page);
+}
+
+int
+ply_progress_page_get_fd (ply_progress_page_t *page)
+{
+        assert (page != NULL);
+
+        return page->fd;
+}
+
+static void
+ply_progress_page_begin_write (ply_progress_page_t *page)
+{
+        uint32_t sequence;
+
+        sequence = __atomic_load_n (&page->data->sequence, __ATOMIC_RELAXED);
+        __atomic_store_n (&page->data->sequence, sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static void
+ply_progress_page_end_write (ply_progress_page_t *page)
+{
+        uint32_t sequence;
+
+        sequence = __atomic_load_n (&page->data->sequence, __ATOMIC_RELAXED);
+        __atomic_store_n (&page->data->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void
+ply_progress_page_update (ply_progress_page_t *page,
+                          uint32_t             percentage,
+                          uint32_t             phase,
+                          const char          *status)
+{
+        assert (page != NULL);
+        assert (page->is_writable);
+
+        ply_progress_page_begin_write (page);
+        page->data->percentage = percentage;
+        page->data->phase = phase;
+        if (status != NULL)
+                strncpy (page->data->status, status, PLY_PROGRESS_PAGE_STATUS_SIZE - 1);
+        else
+                page->data->status[0] = '\0';
+        page->data->status[PLY_PROGRESS_PAGE_STATUS_SIZE - 1] = '\0';
+        ply_progress_page_end_write (page);
+}
+
+void
+ply_progress_page_finish (ply_progress_page_t *page)
+{
+        assert (page != NULL);
+        assert (page->is_writable);
+
+        ply_progress_page_begin_write (page);
+        page->data->flags |= PLY_PROGRESS_PAGE_FLAG_DONE;
+        ply_progress_page_end_write (page);
+}
+
+/* Copies the page into snapshot and returns true if it changed since the
+ * last sample.  Returns false without touching snapshot if nothing
+ * changed, or if the writer kept the page busy for every retry; the
+ * next sample will pick it up.
+ */
+bool
+ply_progress_page_sample (ply_progress_page_t          *page,
+                          ply_progress_page_snapshot_t *snapshot)
+{
+        ply_progress_page_snapshot_t copy;
+        uint32_t sequence, sequence_after;
+        int i;
+
+        assert (page != NULL);
+        assert (snapshot != NULL);
+
+        for (i = 0; i < PLY_PROGRESS_PAGE_MAX_SAMPLE_RETRIES; i++) {
+                sequence = __atomic_load_n (&page->data->sequence, __ATOMIC_ACQUIRE);
+
+                if (sequence == page->last_sequence)
+                        return false;
+
+                if (sequence & 1)
+                        continue;
+
+                copy.flags = page->data->flags;
+                copy.percentage = page->data->percentage;
+                copy.phase = page->data->phase;
+                memcpy (copy.status, page->data->status, PLY_PROGRESS_PAGE_STATUS_SIZE);
+
+                __atomic_thread_fence (__ATOMIC_ACQUIRE);
+                sequence_after = __atomic_load_n (&page->data->sequence, __ATOMIC_RELAXED);
+
+                if (sequence != sequence_after)
+                        continue;
+
+                copy.status[PLY_PROGRESS_PAGE_STATUS_SIZE - 1] = '\0';
+                *snapshot = copy;
+                page->last_sequence = sequence;
+                return true;
+        }
+
+        return false;
+}
@@ -0,0 +1,76 @@
+/* ply-progress-page.h - shared memory page for boot progress
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+#ifndef PLY_PROGRESS_PAGE_H
+#define PLY_PROGRESS_PAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A progress page is a small memfd that a client creates, hands to the
+ * daemon once, and then updates in place.  Updates never touch the
+ * socket; the daemon samples the page at its frame rate instead.
+ *
+ * Writers bump sequence to an odd value, update the fields, then bump it
+ * to the next even value.  Readers retry while the sequence is odd or
+ * changes underneath them.  The layout below is the wire format, so
+ * writers that don't use libply can fill it in directly.
+ */
+#define PLY_PROGRESS_PAGE_MAGIC 0x50524f47 /* "PROG" */
+#define PLY_PROGRESS_PAGE_VERSION 1
+#define PLY_PROGRESS_PAGE_STATUS_SIZE 256
+
+#define PLY_PROGRESS_PAGE_FLAG_DONE 0x1
+
+typedef struct
+{
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sequence;
+        uint32_t flags;
+        uint32_t percentage;
+        uint32_t phase;
+        char     status[PLY_PROGRESS_PAGE_STATUS_SIZE];
+} ply_progress_page_data_t;
+
+typedef struct
+{
+        uint32_t flags;
+        uint32_t percentage;
+        uint32_t phase;
+        char     status[PLY_PROGRESS_PAGE_STATUS_SIZE];
+} ply_progress_page_snapshot_t;
+
+typedef struct _ply_progress_page ply_progress_page_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+ply_progress_page_t *ply_progress_page_new (void);
+ply_progress_page_t *ply_progress_page_open (int fd);
+void ply_progress_page_free (ply_progress_page_t *page);
+int ply_progress_page_get_fd (ply_progress_page_t *page);
+
+void ply_progress_page_update (ply_progress_page_t *page,
+                               uint32_t             percentage,
+                               uint32_t             phase,
+                               const char          *status);
+void ply_progress_page_finish (ply_progress_page_t *page);
+
+bool ply_progress_page_sample (ply_progress_page_t          *page,
+                               ply_progress_page_snapshot_t *snapshot);
+#endif
+
+#endif /* PLY_PROGRESS_PAGE_H */
@@ -27,15 +27,20 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 
+#include "ply-buffer.h"
+#include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-progress.h"
@@ -49,28 +54,73 @@
 #define DEFAULT_BOOT_DURATION 60.0
 #endif
 
+/* How many boots the cached timings are averaged over */
+#ifndef PLY_PROGRESS_CACHE_MAX_BOOTS
+#define PLY_PROGRESS_CACHE_MAX_BOOTS 8
+#endif
 
-struct _ply_progress
+#define PLY_PROGRESS_CACHE_MAGIC "PLYPROG"
+#define PLY_PROGRESS_CACHE_VERSION 1
+
+/* The binary cache is a header, an array of entries sorted by time, and
+ * the nul terminated message strings. It never leaves the machine that
+ * wrote it, so everything is in native byte order.
+ */
+typedef struct
 {
-        double      start_time;
-        double      pause_time;
-        double      scalar;
-        double      last_percentage;
-        double      last_percentage_time;
-        double      dead_time;
-        double      next_message_percentage;
-        ply_list_t *current_message_list;
-        ply_list_t *previous_message_list;
-        uint32_t    paused : 1;
-};
+        char     magic[8];
+        uint32_t version;
+        uint32_t number_of_entries;
+        uint32_t string_table_size;
+        uint32_t number_of_boots;
+        double   boot_duration;
+} ply_progress_cache_header_t;
+
+typedef struct
+{
+        double   time;
+        uint32_t string_offset;
+        uint16_t number_of_boots;
+        uint16_t number_of_boots_missed;
+} ply_progress_cache_entry_t;
 
 typedef struct
 {
         double   time;
         char    *string;
+        uint16_t number_of_boots;
+        uint16_t number_of_boots_missed;
         uint32_t disabled : 1;
+        uint32_t was_seen : 1;
 } ply_progress_message_t;
 
+struct _ply_progress
+{
+        double                  start_time;
+        double                  pause_time;
+        double                  scalar;
+        double                  last_percentage;
+        double                  last_percentage_time;
+        double                  dead_time;
+        double                  next_message_percentage;
+        ply_list_t             *current_message_list;
+        ply_hashtable_t        *current_message_index;
+
+        /* Messages from the cache, sorted by time. Their strings point
+         * into cache_data.
+         */
+        ply_progress_message_t *previous_messages;
+        size_t                  number_of_previous_messages;
+        ply_hashtable_t        *previous_message_index;
+        char                   *cache_data;
+        size_t                  cache_size;
+        double                  previous_boot_duration;
+        uint32_t                number_of_previous_boots;
+
+        uint32_t                paused : 1;
+        uint32_t                cache_is_mapped : 1;
+};
+
 ply_progress_t *
 ply_progress_new (void)
 {
@@ -85,11 +135,34 @@ ply_progress_new (void)
         progress->dead_time = 0.0;
         progress->next_message_percentage = 0.25;
         progress->current_message_list = ply_list_new ();
-        progress->previous_message_list = ply_list_new ();
+        progress->current_message_index = ply_hashtable_new (ply_hashtable_string_hash,
+                                                             ply_hashtable_string_compare);
+        progress->previous_message_index = ply_hashtable_new (ply_hashtable_string_hash,
+                                                              ply_hashtable_string_compare);
         progress->paused = false;
         return progress;
 }
 
+static void
+ply_progress_free_cache (ply_progress_t *progress)
+{
+        free (progress->previous_messages);
+        progress->previous_messages = NULL;
+        progress->number_of_previous_messages = 0;
+
+        if (progress->cache_is_mapped)
+                munmap (progress->cache_data, progress->cache_size);
+        else
+                free (progress->cache_data);
+        progress->cache_data = NULL;
+        progress->cache_size = 0;
+        progress->cache_is_mapped = false;
+
+        ply_hashtable_free (progress->previous_message_index);
+        progress->previous_message_index = ply_hashtable_new (ply_hashtable_string_hash,
+                                                              ply_hashtable_string_compare);
+}
+
 void
 ply_progress_free (ply_progress_t *progress)
 {
@@ -107,130 +180,325 @@ ply_progress_free (ply_progress_t *progress)
                 node = next_node;
         }
         ply_list_free (progress->current_message_list);
+        ply_hashtable_free (progress->current_message_index);
 
-        node = ply_list_get_first_node (progress->previous_message_list);
-
-        while (node) {
-                ply_list_node_t *next_node;
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                next_node = ply_list_get_next_node (progress->previous_message_list, node);
-
-                free (message->string);
-                free (message);
-                node = next_node;
-        }
-        ply_list_free (progress->previous_message_list);
+        ply_progress_free_cache (progress);
+        ply_hashtable_free (progress->previous_message_index);
         free (progress);
         return;
 }
 
+static int
+ply_progress_compare_messages (const void *a,
+                               const void *b)
+{
+        const ply_progress_message_t *message_a = a;
+        const ply_progress_message_t *message_b = b;
+
+        if (message_a->time < message_b->time)
+                return -1;
+        if (message_a->time > message_b->time)
+                return 1;
+        return 0;
+}
 
-static ply_progress_message_t *
-ply_progress_message_search (ply_list_t *message_list,
-                             const char *string)
+static void
+ply_progress_index_previous_messages (ply_progress_t *progress)
 {
-        ply_list_node_t *node;
+        size_t i;
 
-        node = ply_list_get_first_node (message_list);
+        qsort (progress->previous_messages, progress->number_of_previous_messages,
+               sizeof(ply_progress_message_t), ply_progress_compare_messages);
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                if (strcmp (string, message->string) == 0)
-                        return message;
-                node = ply_list_get_next_node (message_list, node);
+        for (i = 0; i < progress->number_of_previous_messages; i++) {
+                ply_progress_message_t *message = &progress->previous_messages[i];
+
+                /* Like the old linear search, the first of any duplicates wins */
+                if (ply_hashtable_lookup (progress->previous_message_index, message->string) == NULL)
+                        ply_hashtable_insert (progress->previous_message_index, message->string, message);
         }
-        return NULL;
 }
 
+static bool
+ply_progress_load_binary_cache (ply_progress_t *progress)
+{
+        const ply_progress_cache_header_t *header;
+        const ply_progress_cache_entry_t *entries;
+        const char *string_table;
+        size_t entries_size, i;
+
+        if (progress->cache_size < sizeof(ply_progress_cache_header_t))
+                return false;
+
+        header = (const ply_progress_cache_header_t *) progress->cache_data;
+
+        if (memcmp (header->magic, PLY_PROGRESS_CACHE_MAGIC, sizeof(header->magic)) != 0)
+                return false;
+
+        if (header->version != PLY_PROGRESS_CACHE_VERSION) {
+                ply_trace ("ignoring progress cache with unknown version %u", header->version);
+                return false;
+        }
+
+        entries_size = (size_t) header->number_of_entries * sizeof(ply_progress_cache_entry_t);
+        if (progress->cache_size - sizeof(*header) < entries_size ||
+            progress->cache_size - sizeof(*header) - entries_size != header->string_table_size)
+                return false;
+
+        entries = (const ply_progress_cache_entry_t *) (header + 1);
+        string_table = (const char *) (entries + header->number_of_entries);
 
-static ply_progress_message_t *
-ply_progress_message_search_next (ply_list_t *message_list,
-                                  double      time)
+        if (header->string_table_size > 0 && string_table[header->string_table_size - 1] != '\0')
+                return false;
+
+        progress->previous_messages = calloc (header->number_of_entries, sizeof(ply_progress_message_t));
+
+        for (i = 0; i < header->number_of_entries; i++) {
+                ply_progress_message_t *message = &progress->previous_messages[i];
+
+                if (entries[i].string_offset >= header->string_table_size) {
+                        free (progress->previous_messages);
+                        progress->previous_messages = NULL;
+                        return false;
+                }
+
+                message->time = entries[i].time;
+                message->string = (char *) string_table + entries[i].string_offset;
+                message->number_of_boots = entries[i].number_of_boots;
+                message->number_of_boots_missed = entries[i].number_of_boots_missed;
+        }
+        progress->number_of_previous_messages = header->number_of_entries;
+        progress->previous_boot_duration = header->boot_duration;
+        progress->number_of_previous_boots = header->number_of_boots;
+
+        return true;
+}
+
+/* The format older versions wrote, one "time:message" per line */
+static void
+ply_progress_load_text_cache (ply_progress_t *progress)
 {
-        ply_list_node_t *node;
+        char *line, *end_of_data;
+        size_t capacity = 0;
 
-        node = ply_list_get_first_node (message_list);
-        ply_progress_message_t *best = NULL;
+        end_of_data = progress->cache_data + progress->cache_size;
+        line = progress->cache_data;
 
-        while (node) {
-                ply_progress_message_t *message = ply_list_node_get_data (node);
-                if (message->time > time && (!best || message->time < best->time))
-                        best = message;
-                node = ply_list_get_next_node (message_list, node);
+        while (line < end_of_data) {
+                ply_progress_message_t *message;
+                char *colon, *end_of_line;
+                double time;
+
+                end_of_line = memchr (line, '\n', end_of_data - line);
+                if (end_of_line == NULL)
+                        end_of_line = end_of_data;
+                *end_of_line = '\0';
+
+                time = strtod (line, &colon);
+                if (colon == line || *colon != ':')
+                        break;
+
+                if (progress->number_of_previous_messages == capacity) {
+                        capacity = MAX (2 * capacity, 32);
+                        progress->previous_messages = realloc (progress->previous_messages,
+                                                               capacity * sizeof(ply_progress_message_t));
+                }
+
+                message = &progress->previous_messages[progress->number_of_previous_messages++];
+                memset (message, 0, sizeof(*message));
+                message->time = time;
+                message->string = colon + 1;
+                message->number_of_boots = 1;
+
+                line = end_of_line + 1;
         }
-        return best;
 }
 
 void
 ply_progress_load_cache (ply_progress_t *progress,
                          const char     *filename)
 {
-        FILE *fp;
+        struct stat file_info;
+        void *data;
+        int fd;
 
-        fp = fopen (filename, "r");
-        if (fp == NULL)
+        fd = open (filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
                 return;
 
-        while (1) {
-                int items_matched;
-                double time;
-                int string_size = 81;
-                char *string;
-                char colon;
-                int i = 0;
-
-                items_matched = fscanf (fp, "%lf", &time);
-                if (items_matched < 1) break;
-                items_matched = fscanf (fp, "%c", &colon);
-                if (items_matched < 1 || colon != ':') break;
-
-                string = malloc (sizeof(char) * string_size);
-                while (1) {
-                        if (i >= string_size) {
-                                string_size *= 2;
-                                string = realloc (string, sizeof(char) * string_size);
-                        }
-                        items_matched = fscanf (fp, "%c", &string[i]);
-                        if (items_matched < 1 || string[i] == '\n') {
-                                string[i] = '\0';
-                                break;
-                        }
-                        i++;
+        if (fstat (fd, &file_info) < 0 || file_info.st_size <= 0) {
+                close (fd);
+                return;
+        }
+
+        ply_progress_free_cache (progress);
+
+        data = mmap (NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+                progress->cache_data = data;
+                progress->cache_size = file_info.st_size;
+                progress->cache_is_mapped = true;
+
+                if (!ply_progress_load_binary_cache (progress))
+                        ply_progress_free_cache (progress);
+        }
+
+        if (progress->cache_data == NULL) {
+                /* Parsing the text format writes into the data, so it gets
+                 * its own nul terminated copy
+                 */
+                progress->cache_data = malloc (file_info.st_size + 1);
+                if (ply_read (fd, progress->cache_data, file_info.st_size)) {
+                        progress->cache_data[file_info.st_size] = '\0';
+                        progress->cache_size = file_info.st_size;
+                        ply_progress_load_text_cache (progress);
                 }
-                ply_progress_message_t *message = malloc (sizeof(ply_progress_message_t));
-                message->time = time;
-                message->string = string;
-                ply_list_append_data (progress->previous_message_list, message);
         }
-        fclose (fp);
+        close (fd);
+
+        ply_progress_index_previous_messages (progress);
+
+        if (progress->previous_boot_duration > 0.0)
+                progress->scalar = 1.0 / progress->previous_boot_duration;
+
+        ply_trace ("loaded %zu messages from progress cache", progress->number_of_previous_messages);
+}
+
+static void
+ply_progress_add_cache_entry (ply_progress_cache_entry_t **entries,
+                              size_t                      *number_of_entries,
+                              ply_buffer_t                *string_table,
+                              double                       time,
+                              const char                  *string,
+                              uint16_t                     number_of_boots,
+                              uint16_t                     number_of_boots_missed)
+{
+        ply_progress_cache_entry_t *entry;
+
+        *entries = realloc (*entries, (*number_of_entries + 1) * sizeof(ply_progress_cache_entry_t));
+        entry = &(*entries)[(*number_of_entries)++];
+
+        entry->time = time;
+        entry->string_offset = ply_buffer_get_size (string_table);
+        entry->number_of_boots = number_of_boots;
+        entry->number_of_boots_missed = number_of_boots_missed;
+
+        ply_buffer_append_bytes (string_table, string, strlen (string) + 1);
 }
 
+static int
+ply_progress_compare_cache_entries (const void *a,
+                                    const void *b)
+{
+        const ply_progress_cache_entry_t *entry_a = a;
+        const ply_progress_cache_entry_t *entry_b = b;
+
+        if (entry_a->time < entry_b->time)
+                return -1;
+        if (entry_a->time > entry_b->time)
+                return 1;
+        return 0;
+}
+
+/* Each message's time is averaged with what previous boots recorded, evenly
+ * until there are PLY_PROGRESS_CACHE_MAX_BOOTS samples and as an
+ * exponentially weighted average after that. Messages that stop showing up
+ * are forgotten after as many boots.
+ */
 void
 ply_progress_save_cache (ply_progress_t *progress,
                          const char     *filename)
 {
-        FILE *fp;
+        ply_progress_cache_header_t header = { { 0 } };
+        ply_progress_cache_entry_t *entries = NULL;
+        size_t number_of_entries = 0, i;
+        ply_buffer_t *string_table;
         ply_list_node_t *node;
         double cur_time = ply_progress_get_time (progress);
+        char *temporary_filename = NULL;
+        bool saved;
+        int fd;
 
         ply_trace ("saving progress cache to %s", filename);
 
-        fp = fopen (filename, "w");
-        if (fp == NULL) {
-                ply_trace ("failed to save cache: %m");
-                return;
-        }
+        string_table = ply_buffer_new ();
 
         node = ply_list_get_first_node (progress->current_message_list);
 
         while (node) {
                 ply_progress_message_t *message = ply_list_node_get_data (node);
+                ply_progress_message_t *previous_message;
                 double percentage = message->time / cur_time;
-                if (!message->disabled)
-                        fprintf (fp, "%.3lf:%s\n", percentage, message->string);
+                uint16_t number_of_boots = 1;
+
                 node = ply_list_get_next_node (progress->current_message_list, node);
+
+                if (message->disabled)
+                        continue;
+
+                previous_message = ply_hashtable_lookup (progress->previous_message_index, message->string);
+                if (previous_message != NULL) {
+                        number_of_boots = MIN (previous_message->number_of_boots + 1, PLY_PROGRESS_CACHE_MAX_BOOTS);
+                        percentage = previous_message->time + (percentage - previous_message->time) / number_of_boots;
+                        previous_message->was_seen = true;
+                }
+
+                ply_progress_add_cache_entry (&entries, &number_of_entries, string_table,
+                                              percentage, message->string, number_of_boots, 0);
+        }
+
+        for (i = 0; i < progress->number_of_previous_messages; i++) {
+                ply_progress_message_t *message = &progress->previous_messages[i];
+
+                if (message->was_seen || message->number_of_boots_missed + 1 >= PLY_PROGRESS_CACHE_MAX_BOOTS)
+                        continue;
+
+                if (ply_hashtable_lookup (progress->previous_message_index, message->string) != message)
+                        continue;
+
+                ply_progress_add_cache_entry (&entries, &number_of_entries, string_table,
+                                              message->time, message->string,
+                                              message->number_of_boots, message->number_of_boots_missed + 1);
         }
-        fclose (fp);
+
+        if (number_of_entries > 0)
+                qsort (entries, number_of_entries, sizeof(ply_progress_cache_entry_t),
+                       ply_progress_compare_cache_entries);
+
+        memcpy (header.magic, PLY_PROGRESS_CACHE_MAGIC, sizeof(header.magic));
+        header.version = PLY_PROGRESS_CACHE_VERSION;
+        header.number_of_entries = number_of_entries;
+        header.string_table_size = ply_buffer_get_size (string_table);
+        header.number_of_boots = MIN (progress->number_of_previous_boots + 1, PLY_PROGRESS_CACHE_MAX_BOOTS);
+        if (progress->previous_boot_duration > 0.0 && progress->number_of_previous_boots > 0)
+                header.boot_duration = progress->previous_boot_duration +
+                                       (cur_time - progress->previous_boot_duration) / header.number_of_boots;
+        else
+                header.boot_duration = cur_time;
+
+        /* Written to the side and renamed over, so a crash can't leave a
+         * truncated cache behind
+         */
+        asprintf (&temporary_filename, "%s.new", filename);
+        fd = open (temporary_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+                ply_trace ("failed to save cache: %m");
+                saved = false;
+        } else {
+                saved = ply_write (fd, &header, sizeof(header)) &&
+                        ply_write (fd, entries, number_of_entries * sizeof(ply_progress_cache_entry_t)) &&
+                        ply_write (fd, ply_buffer_get_bytes (string_table), header.string_table_size);
+                close (fd);
+
+                if (!saved || rename (temporary_filename, filename) < 0) {
+                        ply_trace ("failed to save cache: %m");
+                        unlink (temporary_filename);
+                }
+        }
+
+        free (temporary_filename);
+        free (entries);
+        ply_buffer_free (string_table);
 }
 
 
@@ -302,15 +570,20 @@ ply_progress_status_update (ply_progress_t *progress,
 {
         ply_progress_message_t *message, *message_next;
 
-        message = ply_progress_message_search (progress->current_message_list, status);
+        message = ply_hashtable_lookup (progress->current_message_index, (void *) status);
         if (message) {
                 message->disabled = true;
         }                                               /* Remove duplicates as they confuse things*/
         else {
-                message = ply_progress_message_search (progress->previous_message_list, status);
+                message = ply_hashtable_lookup (progress->previous_message_index, (void *) status);
                 if (message) {
-                        message_next = ply_progress_message_search_next (progress->previous_message_list, message->time);
-                        if (message_next)
+                        message_next = message + 1;
+                        while (message_next < progress->previous_messages + progress->number_of_previous_messages &&
+                               message_next->time <= message->time) {
+                                message_next++;
+                        }
+
+                        if (message_next < progress->previous_messages + progress->number_of_previous_messages)
                                 progress->next_message_percentage = message_next->time;
                         else
                                 progress->next_message_percentage = 1;
@@ -318,11 +591,11 @@ ply_progress_status_update (ply_progress_t *progress,
                         progress->scalar += message->time / (ply_progress_get_time (progress) - progress->dead_time);
                         progress->scalar /= 2;
                 }
-                message = malloc (sizeof(ply_progress_message_t));
+                message = calloc (1, sizeof(ply_progress_message_t));
                 message->time = ply_progress_get_time (progress);
                 message->string = strdup (status);
                 message->disabled = false;
                 ply_list_append_data (progress->current_message_list, message);
+                ply_hashtable_insert (progress->current_message_index, message->string, message);
         }
 }
-
@@ -0,0 +1,164 @@
+/* ply-random.c - seedable pseudo random number generator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+#include "ply-random.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ply-logger.h"
+#include "ply-utils.h"
+
+/* PCG32 (XSH RR variant): 64 bits of state, 32 bits of output per step.
+ * Small, fast, and good enough for scattering stars around the screen.
+ */
+#define PCG32_MULTIPLIER 6364136223846793005ULL
+
+struct _ply_random
+{
+        uint64_t state;
+        uint64_t increment;
+};
+
+/* Spreads the bits of a seed out, so nearby seeds such as consecutive
+ * clock readings give unrelated streams */
+static uint64_t
+split_mix (uint64_t *value)
+{
+        uint64_t result;
+
+        *value += 0x9e3779b97f4a7c15ULL;
+        result = *value;
+        result = (result ^ (result >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        result = (result ^ (result >> 27)) * 0x94d049bb133111ebULL;
+
+        return result ^ (result >> 31);
+}
+
+bool
+ply_random_get_fixed_seed (uint64_t *seed)
+{
+        const char *seed_string;
+        char *end;
+
+        seed_string = getenv ("PLYMOUTH_RANDOM_SEED");
+
+        if (seed_string == NULL)
+                seed_string = ply_kernel_command_line_get_string_after_prefix ("plymouth.random-seed=");
+
+        if (seed_string == NULL)
+                return false;
+
+        *seed = strtoull (seed_string, &end, 0);
+
+        if (end == seed_string)
+                return false;
+
+        return true;
+}
+
+ply_random_t *
+ply_random_new_with_seed (uint64_t seed)
+{
+        ply_random_t *random;
+
+        random = calloc (1, sizeof(ply_random_t));
+        random->increment = split_mix (&seed) | 1;
+        random->state = split_mix (&seed);
+
+        return random;
+}
+
+ply_random_t *
+ply_random_new (void)
+{
+        struct timespec now = { 0L, /* zero-filled */ };
+        uint64_t seed;
+
+        if (ply_random_get_fixed_seed (&seed)) {
+                ply_trace ("using fixed random seed %llu", (unsigned long long) seed);
+                return ply_random_new_with_seed (seed);
+        }
+
+        clock_gettime (CLOCK_TAI, &now);
+        seed = ((uint64_t) now.tv_sec * 1000000000ULL) + now.tv_nsec;
+
+        return ply_random_new_with_seed (seed);
+}
+
+void
+ply_random_free (ply_random_t *random)
+{
+        free (random);
+}
+
+uint32_t
+ply_random_get_uint32 (ply_random_t *random)
+{
+        uint64_t old_state;
+        uint32_t shifted;
+        uint32_t rotation;
+
+        assert (random != NULL);
+
+        old_state = random->state;
+        random->state = old_state * PCG32_MULTIPLIER + random->increment;
+
+        shifted = (uint32_t) (((old_state >> 18) ^ old_state) >> 27);
+        rotation = (uint32_t) (old_state >> 59);
+
+        return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+}
+
+uint64_t
+ply_random_get_uint64 (ply_random_t *random)
+{
+        uint64_t high;
+
+        high = ply_random_get_uint32 (random);
+
+        return (high << 32) | ply_random_get_uint32 (random);
+}
+
+long
+ply_random_get_number (ply_random_t *random,
+                       long          lower_bound,
+                       long          range)
+{
+        uint64_t limit;
+        uint64_t value;
+
+        assert (range > 0);
+
+        /* Throw away the top partial stretch of values so every number in
+         * the range is equally likely */
+        limit = UINT64_MAX - (UINT64_MAX % (uint64_t) range);
+
+        do {
+                value = ply_random_get_uint64 (random);
+        } while (value >= limit);
+
+        return lower_bound + (long) (value % (uint64_t) range);
+}
+
+double
+ply_random_get_double (ply_random_t *random)
+{
+        return (ply_random_get_uint64 (random) >> 11) * (1.0 / 9007199254740992.0);
+}
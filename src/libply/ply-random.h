@@ -0,0 +1,51 @@
+/* ply-random.h - seedable pseudo random number generator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ */
+#ifndef PLY_RANDOM_H
+#define PLY_RANDOM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _ply_random ply_random_t;
+
+#ifndef PLY_HIDE_FUNCTION_DECLARATIONS
+/* Seeds from PLYMOUTH_RANDOM_SEED in the environment or plymouth.random-seed=
+ * on the kernel command line if either is set, so animations can be
+ * reproduced, and from the clock otherwise
+ */
+ply_random_t *ply_random_new (void);
+ply_random_t *ply_random_new_with_seed (uint64_t seed);
+void ply_random_free (ply_random_t *random);
+
+bool ply_random_get_fixed_seed (uint64_t *seed);
+
+uint32_t ply_random_get_uint32 (ply_random_t *random);
+uint64_t ply_random_get_uint64 (ply_random_t *random);
+
+/* Returns a number from lower_bound up to but not including
+ * lower_bound + range */
+long ply_random_get_number (ply_random_t *random,
+                            long          lower_bound,
+                            long          range);
+
+/* Returns a number in [0, 1) */
+double ply_random_get_double (ply_random_t *random);
+#endif
+
+#endif /* PLY_RANDOM_H */
@@ -412,8 +412,12 @@ ply_terminal_session_open_log (ply_terminal_session_t *session,
 
         ply_save_errno ();
         log_is_opened = ply_logger_open_file (session->logger, filename);
-        if (log_is_opened)
+        if (log_is_opened) {
+                /* The log may live on slow storage, don't let it hold up the splash */
+                if (!ply_logger_enable_background_writer (session->logger))
+                        ply_trace ("could not start background log writer, writing synchronously");
                 ply_logger_flush (session->logger);
+        }
         ply_restore_errno ();
 
         return log_is_opened;
@@ -428,3 +432,38 @@ ply_terminal_session_close_log (ply_terminal_session_t *session)
         return ply_logger_close_file (session->logger);
 }
 
+bool
+ply_terminal_session_set_log_format (ply_terminal_session_t *session,
+                                     ply_logger_format_t     format)
+{
+        assert (session != NULL);
+        assert (session->logger != NULL);
+
+        return ply_logger_set_format (session->logger, format);
+}
+
+/* Plain logs only carry console output, anything else only goes in
+ * structured logs
+ */
+void
+ply_terminal_session_log_record (ply_terminal_session_t *session,
+                                 ply_logger_source_t     source,
+                                 const char             *bytes,
+                                 size_t                  size)
+{
+        assert (session != NULL);
+        assert (session->logger != NULL);
+
+        if (size == 0)
+                return;
+
+        if (ply_logger_get_format (session->logger) == PLY_LOGGER_FORMAT_PLAIN)
+                return;
+
+        if (!ply_logger_is_logging (session->logger))
+                return;
+
+        ply_logger_inject_record (session->logger, source, bytes, size);
+        ply_logger_flush (session->logger);
+}
+
@@ -28,6 +28,7 @@
 
 #include "ply-event-loop.h"
 #include "ply-buffer.h"
+#include "ply-logger.h"
 
 typedef struct _ply_terminal_session ply_terminal_session_t;
 
@@ -68,6 +69,12 @@ int ply_terminal_session_get_fd (ply_terminal_session_t *session);
 bool ply_terminal_session_open_log (ply_terminal_session_t *session,
                                     const char             *filename);
 void ply_terminal_session_close_log (ply_terminal_session_t *session);
+bool ply_terminal_session_set_log_format (ply_terminal_session_t *session,
+                                          ply_logger_format_t     format);
+void ply_terminal_session_log_record (ply_terminal_session_t *session,
+                                      ply_logger_source_t     source,
+                                      const char             *bytes,
+                                      size_t                  size);
 #endif
 
 #endif /* PLY_TERMINAL_SESSION_H */
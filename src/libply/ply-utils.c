@@ -50,6 +50,7 @@
 #include <dlfcn.h>
 
 #include "ply-logger.h"
+#include "ply-random.h"
 
 #ifndef PLY_OPEN_FILE_DESCRIPTORS_DIR
 #define PLY_OPEN_FILE_DESCRIPTORS_DIR "/proc/self/fd"
@@ -535,13 +536,67 @@ ply_character_device_exists (const char *device)
         return S_ISCHR (file_info.st_mode);
 }
 
+static const ply_built_in_module_t *built_in_modules;
+
+void
+ply_set_built_in_modules (const ply_built_in_module_t *modules)
+{
+        built_in_modules = modules;
+}
+
+static const ply_built_in_module_t *
+ply_find_built_in_module (const char *module_path)
+{
+        const ply_built_in_module_t *module;
+        const char *module_name;
+
+        if (built_in_modules == NULL)
+                return NULL;
+
+        if (!ply_string_has_prefix (module_path, PLYMOUTH_PLUGIN_PATH))
+                return NULL;
+
+        module_name = module_path + strlen (PLYMOUTH_PLUGIN_PATH);
+
+        for (module = built_in_modules; module->module_name != NULL; module++) {
+                if (strcmp (module->module_name, module_name) == 0)
+                        return module;
+        }
+
+        return NULL;
+}
+
+static bool
+ply_module_handle_is_built_in (ply_module_handle_t *handle)
+{
+        const ply_built_in_module_t *module;
+
+        if (built_in_modules == NULL)
+                return false;
+
+        for (module = built_in_modules; module->module_name != NULL; module++) {
+                if ((ply_module_handle_t *) module == handle)
+                        return true;
+        }
+
+        return false;
+}
+
 ply_module_handle_t *
 ply_open_module (const char *module_path)
 {
+        const ply_built_in_module_t *built_in_module;
         ply_module_handle_t *handle;
 
         assert (module_path != NULL);
 
+        built_in_module = ply_find_built_in_module (module_path);
+
+        if (built_in_module != NULL) {
+                ply_trace ("using built-in copy of module \"%s\"", module_path);
+                return (ply_module_handle_t *) built_in_module;
+        }
+
         handle = (ply_module_handle_t *) dlopen (module_path,
                                                  RTLD_NODELETE | RTLD_NOW | RTLD_LOCAL);
 
@@ -580,6 +635,17 @@ ply_module_look_up_function (ply_module_handle_t *handle,
         assert (handle != NULL);
         assert (function_name != NULL);
 
+        if (ply_module_handle_is_built_in (handle)) {
+                const ply_built_in_module_t *module = (const ply_built_in_module_t *) handle;
+
+                if (strcmp (module->function_name, function_name) != 0) {
+                        errno = ELIBACC;
+                        return NULL;
+                }
+
+                return (ply_module_function_t) module->function;
+        }
+
         dlerror ();
         function = (ply_module_function_t) dlsym (handle, function_name);
 
@@ -596,6 +662,9 @@ ply_module_look_up_function (ply_module_handle_t *handle,
 void
 ply_close_module (ply_module_handle_t *handle)
 {
+        if (ply_module_handle_is_built_in (handle))
+                return;
+
         dlclose (handle);
 }
 
@@ -1293,22 +1362,12 @@ long
 ply_get_random_number (long lower_bound,
                        long range)
 {
-        static bool seed_initialized = false;
-        long offset;
-
-        if (!seed_initialized) {
-                struct timespec now = { 0L, /* zero-filled */ };
-
-                clock_gettime (CLOCK_TAI, &now);
-                srand48 (now.tv_nsec);
-                seed_initialized = true;
-        }
-
-        offset = mrand48 ();
+        static ply_random_t *random = NULL;
 
-        offset = labs (offset) % range;
+        if (random == NULL)
+                random = ply_random_new ();
 
-        return lower_bound + offset;
+        return ply_random_get_number (random, lower_bound, range);
 }
 
 bool
@@ -46,6 +46,19 @@
 typedef intptr_t ply_module_handle_t;
 typedef void (*ply_module_function_t) (void);
 
+/* Every plugin entry point returns a pointer to its interface */
+typedef const void *(*ply_built_in_module_function_t) (void);
+
+/* A plugin linked into the program, standing in for the module of the
+ * same name (relative to the plugin directory)
+ */
+typedef struct
+{
+        const char                    *module_name;
+        const char                    *function_name;
+        ply_built_in_module_function_t function;
+} ply_built_in_module_t;
+
 typedef intptr_t ply_daemon_handle_t;
 
 typedef enum
@@ -118,6 +131,7 @@ bool ply_directory_exists (const char *dir);
 bool ply_file_exists (const char *file);
 bool ply_character_device_exists (const char *device);
 
+void ply_set_built_in_modules (const ply_built_in_module_t *modules);
 ply_module_handle_t *ply_open_module (const char *module_path);
 ply_module_handle_t *ply_open_built_in_module (void);
 
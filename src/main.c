@@ -54,13 +54,21 @@
 #include "ply-trigger.h"
 #include "ply-utils.h"
 #include "ply-progress.h"
+#include "ply-progress-page.h"
 #include "ply-kmsg-reader.h"
 
 #define BOOT_DURATION_FILE     PLYMOUTH_TIME_DIRECTORY "/boot-duration"
 #define SHUTDOWN_DURATION_FILE PLYMOUTH_TIME_DIRECTORY "/shutdown-duration"
 
+#ifndef PROGRESS_PAGE_SAMPLES_PER_SECOND
+#define PROGRESS_PAGE_SAMPLES_PER_SECOND 30
+#endif
+
 static int crash_fd = -1;
 
+/* Generated by the build from the built-in-plugins option */
+extern const ply_built_in_module_t ply_built_in_modules[];
+
 typedef struct
 {
         const char    *keys;
@@ -85,6 +93,7 @@ typedef struct
         ply_terminal_session_t *session;
         ply_buffer_t           *boot_buffer;
         ply_progress_t         *progress;
+        ply_progress_page_t    *progress_page;
         ply_list_t             *keystroke_triggers;
         ply_list_t             *entry_triggers;
         ply_buffer_t           *entry_buffer;
@@ -102,6 +111,8 @@ typedef struct
         double                  splash_delay;
         double                  device_timeout;
 
+        ply_logger_format_t     boot_log_format;
+
         uint32_t                no_boot_log : 1;
         uint32_t                showing_details : 1;
         uint32_t                system_initialized : 1;
@@ -121,6 +132,8 @@ typedef struct
         const char             *default_tty;
 
         int                     number_of_errors;
+
+        ply_progress_page_snapshot_t last_progress_page_snapshot;
 } state_t;
 
 static void show_splash (state_t *state);
@@ -137,6 +150,7 @@ static void detach_from_running_session (state_t *state);
 static void on_escape_pressed (state_t *state);
 static void dump_details_and_quit_splash (state_t *state);
 static void update_display (state_t *state);
+static void on_progress_page_sample (state_t *state);
 
 static void on_error_message (ply_buffer_t *debug_buffer,
                               const void   *bytes,
@@ -161,8 +175,8 @@ static void on_backspace (state_t *state);
 static void on_quit (state_t       *state,
                      bool           retain_splash,
                      ply_trigger_t *quit_trigger);
-static void on_new_kmsg_message (state_t        *state,
-                                 kmsg_message_t *kmsg_message);
+static void on_new_kmsg_messages (state_t      *state,
+                                  ply_buffer_t *kmsg_messages);
 static bool sh_is_init (state_t *state);
 static void cancel_pending_delayed_show (state_t *state);
 static void prepare_logging (state_t *state);
@@ -192,6 +206,10 @@ on_update (state_t    *state,
         ply_trace ("updating status to '%s'", status);
         ply_progress_status_update (state->progress,
                                     status);
+        if (state->session != NULL)
+                ply_terminal_session_log_record (state->session,
+                                                 PLY_LOGGER_SOURCE_STATUS,
+                                                 status, strlen (status));
         if (state->boot_splash != NULL)
                 ply_boot_splash_update_status (state->boot_splash,
                                                status);
@@ -250,6 +268,124 @@ on_system_update (state_t *state,
         }
 }
 
+static void
+stop_sampling_progress_page (state_t *state)
+{
+        if (state->progress_page == NULL)
+                return;
+
+        ply_event_loop_stop_watching_for_timeout (state->loop,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_progress_page_sample,
+                                                  state);
+        ply_progress_page_free (state->progress_page);
+        state->progress_page = NULL;
+}
+
+static void
+on_progress_page_sample (state_t *state)
+{
+        ply_progress_page_snapshot_t *last_snapshot = &state->last_progress_page_snapshot;
+        ply_progress_page_snapshot_t snapshot;
+
+        if (ply_progress_page_sample (state->progress_page, &snapshot)) {
+                if (snapshot.percentage != last_snapshot->percentage)
+                        on_system_update (state, MIN (snapshot.percentage, 100));
+
+                if (snapshot.status[0] != '\0' &&
+                    (snapshot.phase != last_snapshot->phase ||
+                     strcmp (snapshot.status, last_snapshot->status) != 0))
+                        on_update (state, snapshot.status);
+
+                *last_snapshot = snapshot;
+
+                if (snapshot.flags & PLY_PROGRESS_PAGE_FLAG_DONE) {
+                        ply_trace ("progress page is done");
+                        stop_sampling_progress_page (state);
+                        return;
+                }
+        }
+
+        ply_event_loop_watch_for_timeout (state->loop,
+                                          1.0 / PROGRESS_PAGE_SAMPLES_PER_SECOND,
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_progress_page_sample, state);
+}
+
+static bool
+on_progress_page (state_t *state,
+                  int      page_fd)
+{
+        ply_progress_page_t *page;
+
+        page = ply_progress_page_open (page_fd);
+
+        if (page == NULL)
+                return false;
+
+        /* The mapping keeps the page alive, the descriptor isn't needed
+         */
+        close (page_fd);
+
+        ply_trace ("sampling progress page %d times a second",
+                   PROGRESS_PAGE_SAMPLES_PER_SECOND);
+        stop_sampling_progress_page (state);
+        state->progress_page = page;
+
+        memset (&state->last_progress_page_snapshot, 0,
+                sizeof(state->last_progress_page_snapshot));
+        state->last_progress_page_snapshot.percentage = UINT32_MAX;
+        state->last_progress_page_snapshot.phase = UINT32_MAX;
+
+        on_progress_page_sample (state);
+        return true;
+}
+
+static long
+get_resident_set_size (void)
+{
+        FILE *fp;
+        long size, resident_pages;
+
+        fp = fopen ("/proc/self/statm", "r");
+
+        if (fp == NULL)
+                return -1;
+
+        if (fscanf (fp, "%ld %ld", &size, &resident_pages) != 2)
+                resident_pages = -1;
+
+        fclose (fp);
+
+        if (resident_pages < 0)
+                return -1;
+
+        return resident_pages * sysconf (_SC_PAGESIZE);
+}
+
+static void
+on_statistics (state_t      *state,
+               ply_buffer_t *statistics)
+{
+        ply_buffer_append (statistics, "event loop wakeups: %lu\n",
+                           ply_event_loop_get_number_of_wakeups (state->loop));
+        ply_buffer_append (statistics, "late timeouts: %lu\n",
+                           ply_event_loop_get_number_of_late_timeouts (state->loop));
+
+        if (state->boot_splash != NULL)
+                ply_boot_splash_append_statistics (state->boot_splash, statistics);
+
+        if (state->kmsg_reader != NULL)
+                ply_buffer_append (statistics, "kernel messages dropped: %lu\n",
+                                   ply_kmsg_reader_get_number_of_dropped_messages (state->kmsg_reader));
+
+        if (state->boot_buffer != NULL)
+                ply_buffer_append (statistics, "boot log buffer size: %zu\n",
+                                   ply_buffer_get_size (state->boot_buffer));
+        ply_buffer_append (statistics, "resident set size: %ld\n",
+                           get_resident_set_size ());
+}
+
 static void
 show_messages (state_t *state)
 {
@@ -307,7 +443,7 @@ load_settings (state_t    *state,
 {
         ply_key_file_t *key_file = NULL;
         bool settings_loaded = false;
-        char *scale_string = NULL;
+        const char *scale_string = NULL;
         char *splash_string = NULL;
 
         ply_trace ("Trying to load %s", path);
@@ -319,11 +455,10 @@ load_settings (state_t    *state,
         splash_string = ply_key_file_get_value (key_file, "Daemon", "Theme");
 
         if (splash_string != NULL) {
-                char *configured_theme_dir;
-                configured_theme_dir = ply_key_file_get_value (key_file, "Daemon",
-                                                               "ThemeDir");
+                const char *configured_theme_dir;
+                configured_theme_dir = ply_key_file_peek_value (key_file, "Daemon",
+                                                                "ThemeDir");
                 get_theme_path (splash_string, configured_theme_dir, theme_path);
-                free (configured_theme_dir);
         }
 
         if (isnan (state->splash_delay)) {
@@ -336,12 +471,10 @@ load_settings (state_t    *state,
                 ply_trace ("Device timeout is set to %lf", state->device_timeout);
         }
 
-        scale_string = ply_key_file_get_value (key_file, "Daemon", "DeviceScale");
+        scale_string = ply_key_file_peek_value (key_file, "Daemon", "DeviceScale");
 
-        if (scale_string != NULL) {
+        if (scale_string != NULL)
                 ply_set_device_scale (strtoul (scale_string, NULL, 0));
-                free (scale_string);
-        }
 
         settings_loaded = true;
 out:
@@ -578,6 +711,11 @@ on_display_message (state_t    *state,
                 ply_trace ("not displaying message %s as no splash", message);
         }
         ply_list_append_data (state->messages, strdup (message));
+
+        if (state->session != NULL)
+                ply_terminal_session_log_record (state->session,
+                                                 PLY_LOGGER_SOURCE_PLUGIN,
+                                                 message, strlen (message));
 }
 
 static void
@@ -722,10 +860,12 @@ get_log_file_for_state (state_t *state)
                 if (state->no_boot_log) {
                         filename = NULL;
                 } else {
-                        if (boot_log_file == NULL)
-                                filename = PLYMOUTH_LOG_DIRECTORY "/boot.log";
-                        else
+                        if (boot_log_file != NULL)
                                 filename = boot_log_file;
+                        else if (state->boot_log_format != PLY_LOGGER_FORMAT_PLAIN)
+                                filename = PLYMOUTH_LOG_DIRECTORY "/boot.log.ply";
+                        else
+                                filename = PLYMOUTH_LOG_DIRECTORY "/boot.log";
                 }
                 break;
         case PLY_BOOT_SPLASH_MODE_SHUTDOWN:
@@ -783,6 +923,10 @@ spool_error (state_t *state)
 
         ply_trace ("spooling error for viewer");
 
+        /* The log viewer only understands plain text */
+        if (state->boot_log_format != PLY_LOGGER_FORMAT_PLAIN)
+                return;
+
         logfile = get_log_file_for_state (state);
         logspool = get_log_spool_file_for_mode (state->mode);
 
@@ -1464,15 +1608,21 @@ on_quit (state_t       *state,
 }
 
 void
-on_new_kmsg_message (state_t        *state,
-                     kmsg_message_t *kmsg_message)
+on_new_kmsg_messages (state_t      *state,
+                      ply_buffer_t *kmsg_messages)
 {
-        ply_buffer_append (state->boot_buffer, "%s\n", kmsg_message->message);
+        const char *bytes = ply_buffer_get_bytes (kmsg_messages);
+        size_t size = ply_buffer_get_size (kmsg_messages);
 
-        if (state->boot_splash != NULL) {
-                ply_boot_splash_update_output (state->boot_splash, kmsg_message->message, strlen (kmsg_message->message));
-                ply_boot_splash_update_output (state->boot_splash, "\n", 1);
-        }
+        ply_buffer_append_bytes (state->boot_buffer, bytes, size);
+
+        if (state->session != NULL)
+                ply_terminal_session_log_record (state->session,
+                                                 PLY_LOGGER_SOURCE_KERNEL,
+                                                 bytes, size);
+
+        if (state->boot_splash != NULL)
+                ply_boot_splash_update_output (state->boot_splash, bytes, size);
 }
 
 static bool
@@ -1510,6 +1660,8 @@ start_boot_server (state_t *state)
                                       (ply_boot_server_quit_handler_t) on_quit,
                                       (ply_boot_server_has_active_vt_handler_t) on_has_active_vt,
                                       (ply_boot_server_reload_handler_t) on_reload,
+                                      (ply_boot_server_progress_page_handler_t) on_progress_page,
+                                      (ply_boot_server_statistics_handler_t) on_statistics,
                                       state);
 
         if (!ply_boot_server_listen (server)) {
@@ -1878,6 +2030,12 @@ attach_to_running_session (state_t *state)
                 ply_trace ("creating new terminal session");
                 session = ply_terminal_session_new (NULL);
 
+                if (!ply_terminal_session_set_log_format (session, state->boot_log_format)) {
+                        ply_trace ("compressed boot logs aren't supported, using structured format");
+                        state->boot_log_format = PLY_LOGGER_FORMAT_STRUCTURED;
+                        ply_terminal_session_set_log_format (session, state->boot_log_format);
+                }
+
                 ply_terminal_session_attach_to_event_loop (session, state->loop);
         } else {
                 session = state->session;
@@ -1907,7 +2065,7 @@ attach_to_running_session (state_t *state)
 
                 ply_kmsg_reader_watch_for_messages (state->kmsg_reader,
                                                     (ply_kmsg_reader_message_handler_t)
-                                                    on_new_kmsg_message,
+                                                    on_new_kmsg_messages,
                                                     state);
         }
 
@@ -2025,6 +2183,7 @@ check_verbosity (state_t *state)
 static void
 check_logging (state_t *state)
 {
+        char *log_format;
         bool kernel_no_log;
 
         ply_trace ("checking if console messages should be redirected and logged");
@@ -2036,6 +2195,15 @@ check_logging (state_t *state)
         if (kernel_no_log)
                 state->no_boot_log = true;
 
+        log_format = ply_kernel_command_line_get_key_value ("plymouth.boot-log-format=");
+        if (log_format != NULL) {
+                if (strcmp (log_format, "structured") == 0)
+                        state->boot_log_format = PLY_LOGGER_FORMAT_STRUCTURED;
+                else if (strcmp (log_format, "compressed") == 0)
+                        state->boot_log_format = PLY_LOGGER_FORMAT_COMPRESSED;
+                free (log_format);
+        }
+
         if (state->no_boot_log)
                 ply_trace ("logging won't be enabled!");
         else
@@ -2343,6 +2511,8 @@ main (int    argc,
 
         state.loop = ply_event_loop_get_default ();
 
+        ply_set_built_in_modules (ply_built_in_modules);
+
         /* Initialize the translations if they are available (!initrd) */
         if (ply_file_exists (PLYMOUTH_LOCALE_DIRECTORY "/nl/LC_MESSAGES/plymouth.mo"))
                 setlocale (LC_ALL, "");
@@ -2577,6 +2747,7 @@ main (int    argc,
         ply_terminal_session_free (state.session);
 
         ply_buffer_free (state.boot_buffer);
+        ply_progress_page_free (state.progress_page);
         ply_progress_free (state.progress);
 
         ply_trace ("exiting with code %d", exit_code);
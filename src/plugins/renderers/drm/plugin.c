@@ -43,6 +43,7 @@
 #include <unistd.h>
 
 #include <drm.h>
+#include <drm_fourcc.h>
 #include <drm_mode.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -54,6 +55,7 @@
 #include "ply-list.h"
 #include "ply-logger.h"
 #include "ply-hashtable.h"
+#include "ply-pixel-format.h"
 #include "ply-rectangle.h"
 #include "ply-region.h"
 #include "ply-utils.h"
@@ -62,7 +64,23 @@
 #include "ply-renderer.h"
 #include "ply-renderer-plugin.h"
 
-#define BYTES_PER_PIXEL (4)
+/* Scan out formats we can convert to, most preferred first.  XRGB8888 is
+ * the layout of our shadow buffers so it is just copied; the others need a
+ * row converter.  Deeper formats do not add anything to 8 bit content, so
+ * they are only used when the plane cannot do better.
+ */
+static const struct
+{
+        ply_pixel_format_t format;
+        uint32_t           fourcc;
+} supported_formats[] = {
+        { PLY_PIXEL_FORMAT_XRGB8888,    DRM_FORMAT_XRGB8888    },
+        { PLY_PIXEL_FORMAT_XBGR8888,    DRM_FORMAT_XBGR8888    },
+        { PLY_PIXEL_FORMAT_XRGB2101010, DRM_FORMAT_XRGB2101010 },
+        { PLY_PIXEL_FORMAT_XBGR2101010, DRM_FORMAT_XBGR2101010 },
+        { PLY_PIXEL_FORMAT_RGB565,      DRM_FORMAT_RGB565      },
+        { PLY_PIXEL_FORMAT_BGR565,      DRM_FORMAT_BGR565      },
+};
 
 /* For builds with libdrm < 2.4.89 */
 #ifndef DRM_MODE_ROTATE_0
@@ -71,23 +89,27 @@
 
 struct _ply_renderer_head
 {
-        ply_renderer_backend_t *backend;
-        ply_pixel_buffer_t     *pixel_buffer;
-        ply_rectangle_t         area;
+        ply_renderer_backend_t   *backend;
+        ply_pixel_buffer_t       *pixel_buffer;
+        ply_rectangle_t           area;
 
-        unsigned long           row_stride;
+        unsigned long             row_stride;
 
-        ply_array_t            *connector_ids;
-        drmModeModeInfo         connector0_mode;
+        ply_pixel_format_t        pixel_format;
+        ply_pixel_row_converter_t convert_row;
+        ply_pixel_format_dither_t dither;
 
-        uint32_t                controller_id;
-        uint32_t                console_buffer_id;
-        uint32_t                scan_out_buffer_id;
-        bool                    scan_out_buffer_needs_reset;
-        bool                    uses_hw_rotation;
+        ply_array_t              *connector_ids;
+        drmModeModeInfo           connector0_mode;
 
-        int                     gamma_size;
-        uint16_t               *gamma;
+        uint32_t                  controller_id;
+        uint32_t                  console_buffer_id;
+        uint32_t                  scan_out_buffer_id;
+        bool                      scan_out_buffer_needs_reset;
+        bool                      uses_hw_rotation;
+
+        int                       gamma_size;
+        uint16_t                 *gamma;
 };
 
 struct _ply_renderer_input_source
@@ -221,7 +243,8 @@ ply_renderer_buffer_unmap (ply_renderer_backend_t *backend,
 static ply_renderer_buffer_t *
 ply_renderer_buffer_new (ply_renderer_backend_t *backend,
                          uint32_t                width,
-                         uint32_t                height)
+                         uint32_t                height,
+                         uint32_t                bits_per_pixel)
 {
         ply_renderer_buffer_t *buffer;
         struct drm_mode_create_dumb create_dumb_buffer_request;
@@ -235,7 +258,7 @@ ply_renderer_buffer_new (ply_renderer_backend_t *backend,
 
         create_dumb_buffer_request.width = width;
         create_dumb_buffer_request.height = height;
-        create_dumb_buffer_request.bpp = 32;
+        create_dumb_buffer_request.bpp = bits_per_pixel;
         create_dumb_buffer_request.flags = 0;
 
         if (drmIoctl (backend->device_fd,
@@ -292,25 +315,56 @@ get_buffer_from_id (ply_renderer_backend_t *backend,
         return buffer;
 }
 
+static uint32_t
+get_fourcc_for_pixel_format (ply_pixel_format_t format)
+{
+        size_t i;
+
+        for (i = 0; i < sizeof(supported_formats) / sizeof(supported_formats[0]); i++) {
+                if (supported_formats[i].format == format)
+                        return supported_formats[i].fourcc;
+        }
+
+        return 0;
+}
+
 static uint32_t
 create_output_buffer (ply_renderer_backend_t *backend,
                       unsigned long           width,
                       unsigned long           height,
+                      ply_pixel_format_t      format,
                       unsigned long          *row_stride)
 {
         ply_renderer_buffer_t *buffer;
+        int result;
 
-        buffer = ply_renderer_buffer_new (backend, width, height);
+        buffer = ply_renderer_buffer_new (backend, width, height,
+                                          ply_pixel_format_get_bytes_per_pixel (format) * 8);
 
         if (buffer == NULL) {
                 ply_trace ("Could not allocate GEM object for frame buffer: %m");
                 return 0;
         }
 
-        if (drmModeAddFB (backend->device_fd, width, height,
-                          24, 32, buffer->row_stride, buffer->handle,
-                          &buffer->id) != 0) {
-                ply_trace ("Could not set up GEM object as frame buffer: %m");
+        /* Stick to the legacy call for the common case, it works everywhere */
+        if (format == PLY_PIXEL_FORMAT_XRGB8888) {
+                result = drmModeAddFB (backend->device_fd, width, height,
+                                       24, 32, buffer->row_stride, buffer->handle,
+                                       &buffer->id);
+        } else {
+                uint32_t handles[4] = { buffer->handle };
+                uint32_t pitches[4] = { buffer->row_stride };
+                uint32_t offsets[4] = { 0 };
+
+                result = drmModeAddFB2 (backend->device_fd, width, height,
+                                        get_fourcc_for_pixel_format (format),
+                                        handles, pitches, offsets,
+                                        &buffer->id, 0);
+        }
+
+        if (result != 0) {
+                ply_trace ("Could not set up GEM object as %s frame buffer: %m",
+                           ply_pixel_format_get_name (format));
                 ply_renderer_buffer_free (backend, buffer);
                 return 0;
         }
@@ -325,6 +379,114 @@ create_output_buffer (ply_renderer_backend_t *backend,
         return buffer->id;
 }
 
+static bool
+plane_is_primary (ply_renderer_backend_t *backend,
+                  uint32_t                plane_id)
+{
+        drmModeObjectPropertiesPtr plane_props;
+        drmModePropertyPtr prop;
+        bool is_primary = false;
+        uint32_t i;
+
+        plane_props = drmModeObjectGetProperties (backend->device_fd, plane_id,
+                                                  DRM_MODE_OBJECT_PLANE);
+
+        for (i = 0; plane_props && (i < plane_props->count_props); i++) {
+                prop = drmModeGetProperty (backend->device_fd, plane_props->props[i]);
+                if (!prop)
+                        continue;
+
+                if (strcmp (prop->name, "type") == 0 &&
+                    plane_props->prop_values[i] == DRM_PLANE_TYPE_PRIMARY)
+                        is_primary = true;
+
+                drmModeFreeProperty (prop);
+        }
+
+        drmModeFreeObjectProperties (plane_props);
+
+        return is_primary;
+}
+
+/* Picks the first of our supported formats that the primary plane of the
+ * controller can scan out, falling back to XRGB8888 when the driver does
+ * not expose planes.
+ */
+static ply_pixel_format_t
+get_preferred_pixel_format (ply_renderer_backend_t *backend,
+                            uint32_t                controller_id)
+{
+        ply_pixel_format_t format = PLY_PIXEL_FORMAT_XRGB8888;
+        drmModePlaneResPtr plane_resources;
+        drmModePlanePtr plane;
+        int controller_index = -1;
+        uint32_t i, j;
+        size_t k;
+
+        if (backend->resources == NULL || !controller_id)
+                return format;
+
+        for (i = 0; i < (uint32_t) backend->resources->count_crtcs; i++) {
+                if (backend->resources->crtcs[i] == controller_id) {
+                        controller_index = i;
+                        break;
+                }
+        }
+
+        if (controller_index < 0)
+                return format;
+
+        if (drmSetClientCap (backend->device_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1))
+                return format;
+
+        plane_resources = drmModeGetPlaneResources (backend->device_fd);
+        if (!plane_resources)
+                return format;
+
+        for (i = 0; i < plane_resources->count_planes; i++) {
+                bool found = false;
+
+                plane = drmModeGetPlane (backend->device_fd, plane_resources->planes[i]);
+                if (!plane)
+                        continue;
+
+                if (!(plane->possible_crtcs & (1 << controller_index)) ||
+                    !plane_is_primary (backend, plane->plane_id)) {
+                        drmModeFreePlane (plane);
+                        continue;
+                }
+
+                for (k = 0; !found && k < sizeof(supported_formats) / sizeof(supported_formats[0]); k++) {
+                        for (j = 0; j < plane->count_formats; j++) {
+                                if (plane->formats[j] == supported_formats[k].fourcc) {
+                                        format = supported_formats[k].format;
+                                        found = true;
+                                        break;
+                                }
+                        }
+                }
+
+                drmModeFreePlane (plane);
+                break;
+        }
+
+        drmModeFreePlaneResources (plane_resources);
+
+        return format;
+}
+
+static void
+ply_renderer_head_set_pixel_format (ply_renderer_head_t *head,
+                                    ply_pixel_format_t   format)
+{
+        ply_trace ("Using %s scan out buffers for controller %u",
+                   ply_pixel_format_get_name (format), head->controller_id);
+
+        head->pixel_format = format;
+        head->convert_row = ply_pixel_format_get_row_converter (format);
+        memset (&head->dither, 0, sizeof(head->dither));
+}
+
 static bool
 map_buffer (ply_renderer_backend_t *backend,
             uint32_t                buffer_id)
@@ -607,6 +769,9 @@ ply_renderer_head_new (ply_renderer_backend_t *backend,
         head->console_buffer_id = console_buffer_id;
         head->connector0_mode = output->mode;
         head->uses_hw_rotation = output->uses_hw_rotation;
+        ply_renderer_head_set_pixel_format (head,
+                                            get_preferred_pixel_format (backend,
+                                                                        output->controller_id));
 
         head->area.x = 0;
         head->area.y = 0;
@@ -749,6 +914,7 @@ ply_renderer_head_map (ply_renderer_backend_t *backend,
         ply_trace ("Creating buffer for %ldx%ld renderer head", head->area.width, head->area.height);
         head->scan_out_buffer_id = create_output_buffer (backend,
                                                          head->area.width, head->area.height,
+                                                         head->pixel_format,
                                                          &head->row_stride);
 
         if (head->scan_out_buffer_id == 0)
@@ -849,13 +1015,25 @@ ply_renderer_head_flush_area (ply_renderer_head_t *head,
 {
         uint32_t *shadow_buffer;
         char *dst, *src;
+        unsigned long y;
 
         shadow_buffer = ply_pixel_buffer_get_argb32_data (head->pixel_buffer);
 
-        dst = &map_address[area_to_flush->y * head->row_stride + area_to_flush->x * BYTES_PER_PIXEL];
+        dst = &map_address[area_to_flush->y * head->row_stride +
+                           area_to_flush->x * ply_pixel_format_get_bytes_per_pixel (head->pixel_format)];
         src = (char *) &shadow_buffer[area_to_flush->y * head->area.width + area_to_flush->x];
 
-        flush_area (src, head->area.width * 4, dst, head->row_stride, area_to_flush);
+        if (head->convert_row == NULL) {
+                flush_area (src, head->area.width * 4, dst, head->row_stride, area_to_flush);
+                return;
+        }
+
+        for (y = 0; y < area_to_flush->height; y++) {
+                head->convert_row ((const uint32_t *) src, dst, area_to_flush->width,
+                                   &head->dither);
+                dst += head->row_stride;
+                src += head->area.width * 4;
+        }
 }
 
 static void
@@ -1529,7 +1707,8 @@ create_heads_for_active_connectors (ply_renderer_backend_t *backend,
 }
 
 static bool
-has_32bpp_support (ply_renderer_backend_t *backend)
+can_create_output_buffer (ply_renderer_backend_t *backend,
+                          ply_pixel_format_t      format)
 {
         uint32_t buffer_id;
         unsigned long row_stride;
@@ -1548,12 +1727,13 @@ has_32bpp_support (ply_renderer_backend_t *backend)
         if (min_height == 0)
                 min_height = 1;
 
-        buffer_id = create_output_buffer (backend, min_width, min_height, &row_stride);
+        buffer_id = create_output_buffer (backend, min_width, min_height, format, &row_stride);
 
         if (buffer_id == 0) {
-                ply_trace ("Could not create minimal (%ux%u) 32bpp dummy buffer",
+                ply_trace ("Could not create minimal (%ux%u) %s dummy buffer",
                            backend->resources->min_width,
-                           backend->resources->min_height);
+                           backend->resources->min_height,
+                           ply_pixel_format_get_name (format));
                 return false;
         }
 
@@ -1562,6 +1742,32 @@ has_32bpp_support (ply_renderer_backend_t *backend)
         return true;
 }
 
+static bool
+has_output_buffer_support (ply_renderer_backend_t *backend)
+{
+        ply_list_node_t *node;
+
+        node = ply_list_get_first_node (backend->heads);
+        while (node != NULL) {
+                ply_renderer_head_t *head = ply_list_node_get_data (node);
+
+                node = ply_list_get_next_node (backend->heads, node);
+
+                if (can_create_output_buffer (backend, head->pixel_format))
+                        continue;
+
+                if (head->pixel_format == PLY_PIXEL_FORMAT_XRGB8888)
+                        return false;
+
+                ply_renderer_head_set_pixel_format (head, PLY_PIXEL_FORMAT_XRGB8888);
+
+                if (!can_create_output_buffer (backend, head->pixel_format))
+                        return false;
+        }
+
+        return true;
+}
+
 static bool
 query_device (ply_renderer_backend_t *backend)
 {
@@ -1580,8 +1786,8 @@ query_device (ply_renderer_backend_t *backend)
         if (!create_heads_for_active_connectors (backend, false)) {
                 ply_trace ("Could not initialize heads");
                 ret = false;
-        } else if (!has_32bpp_support (backend)) {
-                ply_trace ("Device doesn't support 32bpp framebuffer");
+        } else if (!has_output_buffer_support (backend)) {
+                ply_trace ("Device doesn't support frame buffers in a usable format");
                 ret = false;
         }
 
@@ -48,6 +48,7 @@
 #include "ply-input-device.h"
 #include "ply-list.h"
 #include "ply-logger.h"
+#include "ply-pixel-format.h"
 #include "ply-rectangle.h"
 #include "ply-region.h"
 #include "ply-terminal.h"
@@ -108,6 +109,13 @@ struct _ply_renderer_backend
         unsigned int                bytes_per_pixel;
         unsigned int                row_stride;
 
+        ply_pixel_format_t          pixel_format;
+        ply_pixel_row_converter_t   convert_row;
+        ply_pixel_format_dither_t   dither;
+
+        /* Staging row for layouts without a specialised converter */
+        char                       *row_buffer;
+
         uint32_t                    is_active : 1;
         uint32_t                    input_source_is_open : 1;
 
@@ -185,7 +193,7 @@ flush_area_to_any_device (ply_renderer_backend_t *backend,
         x2 = x1 + area_to_flush->width;
         y2 = y1 + area_to_flush->height;
 
-        row_backend = malloc (backend->row_stride);
+        row_backend = backend->row_buffer;
         shadow_buffer = ply_pixel_buffer_get_argb32_data (backend->head.pixel_buffer);
         for (row = y1; row < y2; row++) {
                 unsigned long offset;
@@ -207,7 +215,30 @@ flush_area_to_any_device (ply_renderer_backend_t *backend,
                 memcpy (head->map_address + offset, row_backend + x1 * backend->bytes_per_pixel,
                         area_to_flush->width * backend->bytes_per_pixel);
         }
-        free (row_backend);
+}
+
+static void
+flush_area_with_row_converter (ply_renderer_backend_t *backend,
+                               ply_renderer_head_t    *head,
+                               ply_rectangle_t        *area_to_flush)
+{
+        unsigned long x, y, y1, y2;
+        uint32_t *shadow_buffer;
+        char *dst;
+
+        x = area_to_flush->x;
+        y1 = area_to_flush->y;
+        y2 = y1 + area_to_flush->height;
+
+        shadow_buffer = ply_pixel_buffer_get_argb32_data (backend->head.pixel_buffer);
+        dst = &head->map_address[y1 * backend->row_stride + x * backend->bytes_per_pixel];
+
+        for (y = y1; y < y2; y++) {
+                backend->convert_row (&shadow_buffer[y * head->area.width + x],
+                                      dst, area_to_flush->width,
+                                      &backend->dither);
+                dst += backend->row_stride;
+        }
 }
 
 static void
@@ -387,6 +418,9 @@ close_device (ply_renderer_backend_t *backend)
         }
         uninitialize_head (backend, &backend->head);
 
+        free (backend->row_buffer);
+        backend->row_buffer = NULL;
+
         close (backend->device_fd);
         backend->device_fd = -1;
 
@@ -512,13 +546,27 @@ query_device (ply_renderer_backend_t *backend)
 
         backend->head.size = backend->head.area.height * backend->row_stride;
 
-        if (backend->bytes_per_pixel == 4 &&
-            backend->red_bit_position == 16 && backend->bits_for_red == 8 &&
-            backend->green_bit_position == 8 && backend->bits_for_green == 8 &&
-            backend->blue_bit_position == 0 && backend->bits_for_blue == 8)
+        backend->pixel_format = ply_pixel_format_from_channel_layout (backend->bytes_per_pixel,
+                                                                      backend->red_bit_position,
+                                                                      backend->bits_for_red,
+                                                                      backend->green_bit_position,
+                                                                      backend->bits_for_green,
+                                                                      backend->blue_bit_position,
+                                                                      backend->bits_for_blue);
+        backend->convert_row = ply_pixel_format_get_row_converter (backend->pixel_format);
+        memset (&backend->dither, 0, sizeof(backend->dither));
+
+        if (backend->pixel_format == PLY_PIXEL_FORMAT_XRGB8888) {
                 backend->flush_area = flush_area_to_xrgb32_device;
-        else
+        } else if (backend->convert_row != NULL) {
+                ply_trace ("using %s row converter",
+                           ply_pixel_format_get_name (backend->pixel_format));
+                backend->flush_area = flush_area_with_row_converter;
+        } else {
+                free (backend->row_buffer);
+                backend->row_buffer = malloc (backend->row_stride);
                 backend->flush_area = flush_area_to_any_device;
+        }
 
         initialize_head (backend, &backend->head);
 
@@ -49,6 +49,7 @@
 #include "ply-key-file.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
+#include "ply-random.h"
 #include "ply-trigger.h"
 #include "ply-utils.h"
 #include "ply-console-viewer.h"
@@ -59,6 +60,13 @@
 #define FRAMES_PER_SECOND 30
 #endif
 
+/* Opacities are rounded to one of this many levels, so the faded images
+ * can be prepared ahead of time, and only redrawn when the level changes
+ */
+#ifndef NUMBER_OF_OPACITY_LEVELS
+#define NUMBER_OF_OPACITY_LEVELS 32
+#endif
+
 typedef enum
 {
         PLY_BOOT_SPLASH_DISPLAY_NORMAL,
@@ -72,7 +80,7 @@ typedef struct
         unsigned int y;
         double       start_time;
         double       speed;
-        double       opacity;
+        int          opacity_level;
 } star_t;
 
 typedef struct
@@ -84,7 +92,7 @@ typedef struct
         ply_label_t              *label;
         ply_label_t              *message_label;
         ply_rectangle_t           lock_area;
-        double                    logo_opacity;
+        int                       logo_opacity_level;
 
         ply_console_viewer_t     *console_viewer;
 } view_t;
@@ -97,7 +105,12 @@ struct _ply_boot_splash_plugin
         ply_image_t                   *star_image;
         ply_image_t                   *lock_image;
         char                          *image_dir;
+
+        uint32_t                      *star_data[NUMBER_OF_OPACITY_LEVELS];
+        uint32_t                      *logo_data;
+        int                            logo_data_opacity_level;
         ply_list_t                    *views;
+        ply_random_t                  *random;
 
         ply_boot_splash_display_type_t state;
 
@@ -232,6 +245,7 @@ create_plugin (ply_key_file_t *key_file)
 
         plugin = calloc (1, sizeof(ply_boot_splash_plugin_t));
         plugin->start_time = 0.0;
+        plugin->random = ply_random_new ();
 
         plugin->logo_image = ply_image_new (PLYMOUTH_LOGO_FILE);
         image_dir = ply_key_file_get_value (key_file, "fade-throbber", "ImageDir");
@@ -268,6 +282,99 @@ create_plugin (ply_key_file_t *key_file)
         return plugin;
 }
 
+static int
+get_opacity_level (double opacity)
+{
+        opacity = CLAMP (opacity, 0, 1.0);
+
+        return (int) (opacity * (NUMBER_OF_OPACITY_LEVELS - 1) + .5);
+}
+
+static uint32_t *
+create_image_data_at_opacity_level (ply_image_t *image,
+                                    int          opacity_level)
+{
+        uint32_t *data, *faded_data;
+        uint_least16_t opacity;
+        size_t i, number_of_pixels;
+
+        data = ply_image_get_data (image);
+        number_of_pixels = (size_t) ply_image_get_width (image) * ply_image_get_height (image);
+        opacity = (opacity_level * 255) / (NUMBER_OF_OPACITY_LEVELS - 1);
+
+        faded_data = malloc (number_of_pixels * sizeof(uint32_t));
+
+        /* Same rounding as the pixel buffer uses for translucent fills */
+        for (i = 0; i < number_of_pixels; i++) {
+                uint_least16_t alpha, red, green, blue;
+
+                alpha = (uint8_t) (data[i] >> 24) * opacity;
+                red = (uint8_t) (data[i] >> 16) * opacity;
+                green = (uint8_t) (data[i] >> 8) * opacity;
+                blue = (uint8_t) data[i] * opacity;
+
+                alpha = (uint8_t) ((alpha + (alpha >> 8) + 0x80) >> 8);
+                red = (uint8_t) ((red + (red >> 8) + 0x80) >> 8);
+                green = (uint8_t) ((green + (green >> 8) + 0x80) >> 8);
+                blue = (uint8_t) ((blue + (blue >> 8) + 0x80) >> 8);
+
+                faded_data[i] = (alpha << 24) | (red << 16) | (green << 8) | blue;
+        }
+
+        return faded_data;
+}
+
+static void
+free_star_data (ply_boot_splash_plugin_t *plugin)
+{
+        int level;
+
+        for (level = 0; level < NUMBER_OF_OPACITY_LEVELS; level++) {
+                free (plugin->star_data[level]);
+                plugin->star_data[level] = NULL;
+        }
+}
+
+static void
+load_star_data (ply_boot_splash_plugin_t *plugin)
+{
+        int level;
+
+        /* The splash gets shown again on mode changes */
+        free_star_data (plugin);
+
+        for (level = 1; level < NUMBER_OF_OPACITY_LEVELS - 1; level++) {
+                plugin->star_data[level] = create_image_data_at_opacity_level (plugin->star_image, level);
+        }
+}
+
+static uint32_t *
+get_star_data (ply_boot_splash_plugin_t *plugin,
+               int                       opacity_level)
+{
+        if (opacity_level == NUMBER_OF_OPACITY_LEVELS - 1)
+                return ply_image_get_data (plugin->star_image);
+
+        return plugin->star_data[opacity_level];
+}
+
+/* The logo can be large, so only the level being shown is kept around */
+static uint32_t *
+get_logo_data (ply_boot_splash_plugin_t *plugin,
+               int                       opacity_level)
+{
+        if (opacity_level == NUMBER_OF_OPACITY_LEVELS - 1)
+                return ply_image_get_data (plugin->logo_image);
+
+        if (plugin->logo_data == NULL || plugin->logo_data_opacity_level != opacity_level) {
+                free (plugin->logo_data);
+                plugin->logo_data = create_image_data_at_opacity_level (plugin->logo_image, opacity_level);
+                plugin->logo_data_opacity_level = opacity_level;
+        }
+
+        return plugin->logo_data;
+}
+
 static star_t *
 star_new (int    x,
           int    y,
@@ -516,10 +623,13 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
         }
 
         free_views (plugin);
+        free_star_data (plugin);
+        free (plugin->logo_data);
         ply_image_free (plugin->logo_image);
         ply_image_free (plugin->star_image);
         ply_image_free (plugin->lock_image);
         free (plugin->monospace_font);
+        ply_random_free (plugin->random);
         free (plugin);
 }
 
@@ -530,6 +640,7 @@ view_animate_at_time (view_t *view,
         ply_boot_splash_plugin_t *plugin;
         ply_list_node_t *node;
         double logo_opacity;
+        int logo_opacity_level;
         long logo_x, logo_y;
         long logo_width, logo_height;
         unsigned long screen_width, screen_height;
@@ -553,30 +664,34 @@ view_animate_at_time (view_t *view,
         while (node != NULL) {
                 ply_list_node_t *next_node;
                 star_t *star;
+                int opacity_level;
 
                 star = (star_t *) ply_list_node_get_data (node);
                 next_node = ply_list_get_next_node (view->stars, node);
 
-                star->opacity = .5 * sin (((plugin->now - star->start_time) / star->speed) * (2 * M_PI)) + .5;
-                star->opacity = CLAMP (star->opacity, 0, 1.0);
+                opacity_level = get_opacity_level (.5 * sin (((plugin->now - star->start_time) / star->speed) * (2 * M_PI)) + .5);
 
-                ply_pixel_display_draw_area (view->display,
-                                             star->x, star->y,
-                                             star_width, star_height);
+                if (opacity_level != star->opacity_level) {
+                        star->opacity_level = opacity_level;
+                        ply_pixel_display_draw_area (view->display,
+                                                     star->x, star->y,
+                                                     star_width, star_height);
+                }
                 node = next_node;
         }
 
         logo_opacity = .5 * sin ((time / 5) * (2 * M_PI)) + .8;
-        logo_opacity = CLAMP (logo_opacity, 0, 1.0);
 
         if (plugin->mode == PLY_BOOT_SPLASH_MODE_SHUTDOWN ||
             plugin->mode == PLY_BOOT_SPLASH_MODE_REBOOT)
                 logo_opacity = 1.0;
 
-        if (fabs (logo_opacity - view->logo_opacity) <= DBL_MIN)
+        logo_opacity_level = get_opacity_level (logo_opacity);
+
+        if (logo_opacity_level == view->logo_opacity_level)
                 return;
 
-        view->logo_opacity = logo_opacity;
+        view->logo_opacity_level = logo_opacity_level;
 
         ply_pixel_display_draw_area (view->display,
                                      logo_x, logo_y,
@@ -755,7 +870,6 @@ draw_normal_view (view_t             *view,
         ply_list_node_t *node;
         ply_rectangle_t logo_area;
         ply_rectangle_t star_area;
-        uint32_t *logo_data, *star_data;
         unsigned long screen_width, screen_height;
 
         plugin = view->plugin;
@@ -765,7 +879,6 @@ draw_normal_view (view_t             *view,
 
         logo_area.width = ply_image_get_width (plugin->logo_image);
         logo_area.height = ply_image_get_height (plugin->logo_image);
-        logo_data = ply_image_get_data (plugin->logo_image);
 
         screen_width = ply_pixel_display_get_width (view->display);
         screen_height = ply_pixel_display_get_height (view->display);
@@ -773,7 +886,6 @@ draw_normal_view (view_t             *view,
         logo_area.x = (screen_width / 2) - (logo_area.width / 2);
         logo_area.y = (screen_height / 2) - (logo_area.height / 2);
 
-        star_data = ply_image_get_data (plugin->star_image);
         star_area.width = ply_image_get_width (plugin->star_image);
         star_area.height = ply_image_get_height (plugin->star_image);
 
@@ -785,19 +897,20 @@ draw_normal_view (view_t             *view,
                 star = (star_t *) ply_list_node_get_data (node);
                 next_node = ply_list_get_next_node (view->stars, node);
 
-                star_area.x = star->x;
-                star_area.y = star->y;
-                ply_pixel_buffer_fill_with_argb32_data_at_opacity (pixel_buffer,
-                                                                   &star_area,
-                                                                   star_data,
-                                                                   star->opacity);
+                if (star->opacity_level > 0) {
+                        star_area.x = star->x;
+                        star_area.y = star->y;
+                        ply_pixel_buffer_fill_with_argb32_data (pixel_buffer,
+                                                                &star_area,
+                                                                get_star_data (plugin, star->opacity_level));
+                }
                 node = next_node;
         }
 
-        ply_pixel_buffer_fill_with_argb32_data_at_opacity (pixel_buffer,
-                                                           &logo_area,
-                                                           logo_data,
-                                                           view->logo_opacity);
+        if (view->logo_opacity_level > 0)
+                ply_pixel_buffer_fill_with_argb32_data (pixel_buffer,
+                                                        &logo_area,
+                                                        get_logo_data (plugin, view->logo_opacity_level));
 }
 
 static void
@@ -941,6 +1054,8 @@ show_splash_screen (ply_boot_splash_plugin_t *plugin,
         if (!ply_image_load (plugin->star_image))
                 return false;
 
+        load_star_data (plugin);
+
         ply_trace ("loading lock image");
         if (!ply_image_load (plugin->lock_image))
                 return false;
@@ -991,8 +1106,8 @@ view_add_star (view_t *view)
 
         node = NULL;
         do {
-                x = ply_get_random_number (0, screen_width);
-                y = ply_get_random_number (0, screen_height);
+                x = ply_random_get_number (plugin->random, 0, screen_width);
+                y = ply_random_get_number (plugin->random, 0, screen_height);
 
                 if ((x <= logo_area.x + logo_area.width)
                     && (x >= logo_area.x)
@@ -1029,7 +1144,7 @@ view_add_star (view_t *view)
                 }
         } while (node != NULL);
 
-        star = star_new (x, y, (double) ((ply_get_random_number (0, 50)) + 1));
+        star = star_new (x, y, (double) ((ply_random_get_number (plugin->random, 0, 50)) + 1));
         ply_list_append_data (view->stars, star);
 }
 
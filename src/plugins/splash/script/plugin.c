@@ -68,6 +68,24 @@
 #define FRAMES_PER_SECOND 50
 #endif
 
+/* Number of consecutive frames in which the script changed nothing before
+ * the refresh loop backs off */
+#ifndef IDLE_FRAMES_BEFORE_SLEEP
+#define IDLE_FRAMES_BEFORE_SLEEP FRAMES_PER_SECOND
+#endif
+
+/* While idle the refresh function still runs this often (in seconds), for
+ * scripts that poll state such as Plymouth.GetCapslockState. That's also
+ * how late such a script can be to notice a change. */
+#ifndef IDLE_REFRESH_INTERVAL
+#define IDLE_REFRESH_INTERVAL 0.1
+#endif
+
+/* How many frames go by between script memory reports in the debug log */
+#ifndef SCRIPT_STATS_REPORT_INTERVAL
+#define SCRIPT_STATS_REPORT_INTERVAL (FRAMES_PER_SECOND * 10)
+#endif
+
 struct _ply_boot_splash_plugin
 {
         ply_event_loop_t           *loop;
@@ -88,7 +106,10 @@ struct _ply_boot_splash_plugin
         script_lib_math_data_t     *script_math_lib;
         script_lib_string_data_t   *script_string_lib;
 
+        int                         idle_frames;
+
         uint32_t                    is_animating : 1;
+        uint32_t                    is_idle : 1;
 };
 
 typedef struct
@@ -217,20 +238,72 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
 static void
 on_timeout (ply_boot_splash_plugin_t *plugin)
 {
+        unsigned long assignment_count;
+        bool screen_changed;
         double sleep_time;
 
-        sleep_time = 1.0 / plugin->script_plymouth_lib->refresh_rate;
+        assignment_count = script_execute_get_assignment_count ();
+        script_lib_plymouth_on_refresh (plugin->script_state,
+                                        plugin->script_plymouth_lib);
+
+        pause_displays (plugin);
+        screen_changed = script_lib_sprite_refresh (plugin->script_sprite_lib);
+        unpause_displays (plugin);
+
+        script_obj_stats_end_frame ();
+        if (ply_is_tracing () &&
+            script_obj_get_stats ()->frame_count % SCRIPT_STATS_REPORT_INTERVAL == 0)
+                script_obj_stats_dump ();
+
+        /* A frame that neither drew anything nor touched a script variable
+         * would be followed by an identical one, so once enough of them
+         * have gone by only wake up occasionally until an event comes in.
+         */
+        if (screen_changed || assignment_count != script_execute_get_assignment_count ()) {
+                if (plugin->is_idle)
+                        ply_trace ("script changed the screen, leaving idle mode");
+                plugin->idle_frames = 0;
+                plugin->is_idle = false;
+        } else if (!plugin->is_idle && ++plugin->idle_frames >= IDLE_FRAMES_BEFORE_SLEEP) {
+                ply_trace ("nothing changed in %d frames, entering idle mode",
+                           plugin->idle_frames);
+                plugin->is_idle = true;
+        }
+
+        if (plugin->is_idle)
+                sleep_time = IDLE_REFRESH_INTERVAL;
+        else
+                sleep_time = 1.0 / plugin->script_plymouth_lib->refresh_rate;
+
         ply_event_loop_watch_for_timeout (plugin->loop,
                                           sleep_time,
                                           (ply_event_loop_timeout_handler_t)
                                           on_timeout, plugin);
+}
 
-        script_lib_plymouth_on_refresh (plugin->script_state,
-                                        plugin->script_plymouth_lib);
+/* Called whenever something happens that the script may react to, so an
+ * idle refresh loop picks up the change at the next frame */
+static void
+wake_up_refresh (ply_boot_splash_plugin_t *plugin)
+{
+        plugin->idle_frames = 0;
 
-        pause_displays (plugin);
-        script_lib_sprite_refresh (plugin->script_sprite_lib);
-        unpause_displays (plugin);
+        if (!plugin->is_idle)
+                return;
+
+        plugin->is_idle = false;
+
+        if (plugin->loop == NULL || !plugin->is_animating)
+                return;
+
+        ply_trace ("woken up, leaving idle mode");
+        ply_event_loop_stop_watching_for_timeout (plugin->loop,
+                                                  (ply_event_loop_timeout_handler_t)
+                                                  on_timeout, plugin);
+        ply_event_loop_watch_for_timeout (plugin->loop,
+                                          1.0 / plugin->script_plymouth_lib->refresh_rate,
+                                          (ply_event_loop_timeout_handler_t)
+                                          on_timeout, plugin);
 }
 
 static void
@@ -238,6 +311,8 @@ on_boot_progress (ply_boot_splash_plugin_t *plugin,
                   double                    duration,
                   double                    fraction_done)
 {
+        wake_up_refresh (plugin);
+
         script_lib_plymouth_on_boot_progress (plugin->script_state,
                                               plugin->script_plymouth_lib,
                                               duration,
@@ -254,6 +329,7 @@ start_script_animation (ply_boot_splash_plugin_t *plugin)
 
         assert (plugin != NULL);
 
+        script_execute_track_allocation_sites (ply_is_tracing ());
         plugin->script_state = script_state_new (plugin);
 
         for (node = ply_list_get_first_node (plugin->script_env_vars);
@@ -286,6 +362,8 @@ start_script_animation (ply_boot_splash_plugin_t *plugin)
                 ply_keyboard_add_input_handler (plugin->keyboard,
                                                 (ply_keyboard_input_handler_t)
                                                 on_keyboard_input, plugin);
+        plugin->idle_frames = 0;
+        plugin->is_idle = false;
         on_timeout (plugin);
 
         return true;
@@ -328,6 +406,10 @@ stop_script_animation (ply_boot_splash_plugin_t *plugin)
                 plugin->keyboard = NULL;
         }
 
+        if (ply_is_tracing ())
+                script_obj_stats_dump ();
+        script_execute_track_allocation_sites (false);
+
         script_state_destroy (plugin->script_state);
         script_lib_sprite_destroy (plugin->script_sprite_lib);
         plugin->script_sprite_lib = NULL;
@@ -365,6 +447,8 @@ on_keyboard_input (ply_boot_splash_plugin_t *plugin,
 {
         char keyboard_string[character_size + 1];
 
+        wake_up_refresh (plugin);
+
         memcpy (keyboard_string, keyboard_input, character_size);
         keyboard_string[character_size] = '\0';
 
@@ -391,6 +475,8 @@ static void
 add_pixel_display (ply_boot_splash_plugin_t *plugin,
                    ply_pixel_display_t      *display)
 {
+        wake_up_refresh (plugin);
+
         ply_list_append_data (plugin->displays, display);
 
         if (plugin->script_sprite_lib != NULL) {
@@ -403,6 +489,8 @@ static void
 remove_pixel_display (ply_boot_splash_plugin_t *plugin,
                       ply_pixel_display_t      *display)
 {
+        wake_up_refresh (plugin);
+
         if (plugin->script_sprite_lib != NULL) {
                 script_lib_sprite_pixel_display_removed (plugin->script_sprite_lib, display);
                 script_lib_plymouth_on_display_hotplug (plugin->script_state, plugin->script_plymouth_lib);
@@ -439,6 +527,8 @@ static void
 system_update (ply_boot_splash_plugin_t *plugin,
                int                       progress)
 {
+        wake_up_refresh (plugin);
+
         script_lib_plymouth_on_system_update (plugin->script_state,
                                               plugin->script_plymouth_lib,
                                               progress);
@@ -448,6 +538,8 @@ static void
 update_status (ply_boot_splash_plugin_t *plugin,
                const char               *status)
 {
+        wake_up_refresh (plugin);
+
         script_lib_plymouth_on_update_status (plugin->script_state,
                                               plugin->script_plymouth_lib,
                                               status);
@@ -473,6 +565,8 @@ hide_splash_screen (ply_boot_splash_plugin_t *plugin,
 static void
 on_root_mounted (ply_boot_splash_plugin_t *plugin)
 {
+        wake_up_refresh (plugin);
+
         script_lib_plymouth_on_root_mounted (plugin->script_state,
                                              plugin->script_plymouth_lib);
 }
@@ -487,6 +581,8 @@ become_idle (ply_boot_splash_plugin_t *plugin,
 static void
 display_normal (ply_boot_splash_plugin_t *plugin)
 {
+        wake_up_refresh (plugin);
+
         pause_displays (plugin);
         script_lib_plymouth_on_display_normal (plugin->script_state,
                                                plugin->script_plymouth_lib);
@@ -498,6 +594,8 @@ display_password (ply_boot_splash_plugin_t *plugin,
                   const char               *prompt,
                   int                       bullets)
 {
+        wake_up_refresh (plugin);
+
         pause_displays (plugin);
         script_lib_plymouth_on_display_password (plugin->script_state,
                                                  plugin->script_plymouth_lib,
@@ -511,6 +609,8 @@ display_question (ply_boot_splash_plugin_t *plugin,
                   const char               *prompt,
                   const char               *entry_text)
 {
+        wake_up_refresh (plugin);
+
         pause_displays (plugin);
         script_lib_plymouth_on_display_question (plugin->script_state,
                                                  plugin->script_plymouth_lib,
@@ -524,6 +624,8 @@ validate_input (ply_boot_splash_plugin_t *plugin,
                 const char               *entry_text,
                 const char               *add_text)
 {
+        wake_up_refresh (plugin);
+
         return script_lib_plymouth_on_validate_input (plugin->script_state,
                                                       plugin->script_plymouth_lib,
                                                       entry_text,
@@ -536,6 +638,8 @@ display_prompt (ply_boot_splash_plugin_t *plugin,
                 const char               *entry_text,
                 bool                      is_secret)
 {
+        wake_up_refresh (plugin);
+
         pause_displays (plugin);
         script_lib_plymouth_on_display_prompt (plugin->script_state,
                                                plugin->script_plymouth_lib,
@@ -549,6 +653,8 @@ static void
 display_message (ply_boot_splash_plugin_t *plugin,
                  const char               *message)
 {
+        wake_up_refresh (plugin);
+
         pause_displays (plugin);
         script_lib_plymouth_on_display_message (plugin->script_state,
                                                 plugin->script_plymouth_lib,
@@ -560,6 +666,8 @@ static void
 hide_message (ply_boot_splash_plugin_t *plugin,
               const char               *message)
 {
+        wake_up_refresh (plugin);
+
         pause_displays (plugin);
         script_lib_plymouth_on_hide_message (plugin->script_state,
                                              plugin->script_plymouth_lib,
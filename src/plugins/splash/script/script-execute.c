@@ -48,6 +48,11 @@ static script_return_t script_execute_function_with_parlist (script_state_t    *
                                                              script_obj_t      *this,
                                                              ply_list_t        *parameter_data);
 
+/* Bumped whenever a script assigns to a variable, so callers can tell
+ * whether running a callback changed any script state */
+static unsigned long assignment_count = 0;
+
+static bool track_allocation_sites = false;
 
 static void script_execute_error (void       *element,
                                   const char *message)
@@ -65,6 +70,12 @@ static void script_execute_error (void       *element,
         }
 }
 
+static void script_execute_assign (script_obj_t *obj_a,
+                                   script_obj_t *obj_b)
+{
+        assignment_count++;
+        script_obj_assign (obj_a, obj_b);
+}
 
 static script_obj_t *script_evaluate_apply_function (script_state_t *state,
                                                      script_exp_t   *exp,
@@ -89,7 +100,7 @@ static script_obj_t *script_evaluate_apply_function_and_assign (script_state_t *
         script_obj_t *script_obj_b = script_evaluate (state, exp->data.dual.sub_b);
         script_obj_t *obj = function (script_obj_a, script_obj_b);
 
-        script_obj_assign (script_obj_a, obj);
+        script_execute_assign (script_obj_a, obj);
         script_obj_unref (script_obj_a);
         script_obj_unref (script_obj_b);
         return obj;
@@ -105,7 +116,7 @@ static script_obj_t *script_evaluate_hash (script_state_t *state,
 
         if (!script_obj_is_hash (hash)) {
                 script_obj_t *newhash = script_obj_new_hash ();
-                script_obj_assign (hash, newhash);
+                script_execute_assign (hash, newhash);
                 script_obj_unref (newhash);
         }
 
@@ -143,12 +154,11 @@ static script_obj_t *script_evaluate_set (script_state_t *state,
         while (node_data) {
                 script_exp_t *data_exp = ply_list_node_get_data (node_data);
                 script_obj_t *data_obj = script_evaluate (state, data_exp);
-                char *name;
-                asprintf (&name, "%d", index);
+                char name[32];
+                snprintf (name, sizeof(name), "%d", index);
                 index++;
                 script_obj_hash_add_element (obj, data_obj, name);
                 script_obj_unref (data_obj);
-                free (name);
 
                 node_data = ply_list_get_next_node (parameter_data, node_data);
         }
@@ -161,7 +171,7 @@ static script_obj_t *script_evaluate_assign (script_state_t *state,
         script_obj_t *script_obj_a = script_evaluate (state, exp->data.dual.sub_a);
         script_obj_t *script_obj_b = script_evaluate (state, exp->data.dual.sub_b);
 
-        script_obj_assign (script_obj_a, script_obj_b);
+        script_execute_assign (script_obj_a, script_obj_b);
 
         script_obj_unref (script_obj_b);
         return script_obj_a;
@@ -233,12 +243,12 @@ static script_obj_t *script_evaluate_unary (script_state_t *state,
         if (script_obj_is_number (obj)) {
                 if (change_pre) {
                         new_obj = script_obj_new_number (script_obj_as_number (obj) + change);
-                        script_obj_assign (obj, new_obj);
+                        script_execute_assign (obj, new_obj);
                 } else {
                         new_obj = script_obj_deref_direct (obj);
                         script_obj_ref (new_obj);
                         script_obj_t *new_obj2 = script_obj_new_number (script_obj_as_number (obj) + change);
-                        script_obj_assign (obj, new_obj2);
+                        script_execute_assign (obj, new_obj2);
                         script_obj_unref (new_obj2);
                 }
         } else {
@@ -361,8 +371,8 @@ static script_obj_t *script_evaluate_func (script_state_t *state,
         return reply.object ? reply.object : script_obj_new_null ();
 }
 
-static script_obj_t *script_evaluate (script_state_t *state,
-                                      script_exp_t   *exp)
+static script_obj_t *script_evaluate_expression (script_state_t *state,
+                                                 script_exp_t   *exp)
 {
         switch (exp->type) {
         case SCRIPT_EXP_TYPE_PLUS:
@@ -545,6 +555,24 @@ static script_obj_t *script_evaluate (script_state_t *state,
         return script_obj_new_null ();
 }
 
+/* Evaluates an expression, charging any objects it creates to it when
+ * allocation sites are being tracked */
+static script_obj_t *script_evaluate (script_state_t *state,
+                                      script_exp_t   *exp)
+{
+        void *parent_site;
+        script_obj_t *obj;
+
+        if (!track_allocation_sites)
+                return script_evaluate_expression (state, exp);
+
+        parent_site = script_obj_stats_set_allocation_site (exp);
+        obj = script_evaluate_expression (state, exp);
+
+        script_obj_stats_set_allocation_site (parent_site);
+        return obj;
+}
+
 static script_return_t script_execute_list (script_state_t *state,
                                             ply_list_t     *op_list)                      /* FIXME script_execute returns the return obj */
 {
@@ -758,3 +786,14 @@ script_return_t script_execute (script_state_t *state,
         }
         return reply;
 }
+
+unsigned long script_execute_get_assignment_count (void)
+{
+        return assignment_count;
+}
+
+void script_execute_track_allocation_sites (bool track)
+{
+        track_allocation_sites = track;
+        script_obj_stats_track_allocation_sites (track);
+}
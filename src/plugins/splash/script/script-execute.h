@@ -31,5 +31,7 @@ script_return_t script_execute_object (script_state_t * state,
                                        script_obj_t * this,
                                        script_obj_t * first_arg,
                                        ...);
+unsigned long script_execute_get_assignment_count (void);
+void script_execute_track_allocation_sites (bool track);
 
 #endif /* SCRIPT_EXECUTE_H */
@@ -39,6 +39,26 @@
 
 #include "script-lib-image.script.h"
 
+#ifndef IMAGE_TEXT_CACHE_SIZE
+#define IMAGE_TEXT_CACHE_SIZE 32
+#endif
+
+#ifndef IMAGE_TEXT_CACHE_REPORT_INTERVAL
+#define IMAGE_TEXT_CACHE_REPORT_INTERVAL 256
+#endif
+
+typedef struct
+{
+        char         *text;
+        char         *font;
+        float         red;
+        float         green;
+        float         blue;
+        float         alpha;
+        int           align;
+        script_obj_t *image;
+} image_text_cache_entry_t;
+
 static void image_free (script_obj_t *obj)
 {
         ply_pixel_buffer_t *image = obj->data.native.object_data;
@@ -180,13 +200,131 @@ static script_return_t image_tile (script_state_t *state,
         return script_return_obj_null ();
 }
 
+static void image_text_cache_entry_free (image_text_cache_entry_t *entry)
+{
+        script_obj_unref (entry->image);
+        free (entry->text);
+        free (entry->font);
+        free (entry);
+}
+
+static bool image_text_cache_entry_matches (image_text_cache_entry_t *entry,
+                                            const char               *text,
+                                            const char               *font,
+                                            float                     red,
+                                            float                     green,
+                                            float                     blue,
+                                            float                     alpha,
+                                            int                       align)
+{
+        if (entry->red != red || entry->green != green ||
+            entry->blue != blue || entry->alpha != alpha ||
+            entry->align != align)
+                return false;
+
+        if ((entry->font == NULL) != (font == NULL))
+                return false;
+
+        if (font != NULL && strcmp (entry->font, font) != 0)
+                return false;
+
+        return strcmp (entry->text, text) == 0;
+}
+
+static void image_text_cache_report (script_lib_image_data_t *data)
+{
+        ply_trace ("Image.Text cache: %lu hits, %lu misses, %d entries",
+                   data->text_cache_hits, data->text_cache_misses,
+                   ply_list_get_length (data->text_cache));
+}
+
+/* Cached text images are handed out wrapped in a new ref object.  Scripts
+ * can reset an object in place (e.g. Image.Text ("a").foo = 1 turns it into
+ * a hash), which then only hits the throwaway wrapper and not the cache.
+ */
+static script_obj_t *image_text_cache_lookup (script_lib_image_data_t *data,
+                                              const char              *text,
+                                              const char              *font,
+                                              float                    red,
+                                              float                    green,
+                                              float                    blue,
+                                              float                    alpha,
+                                              int                      align)
+{
+        ply_list_node_t *node;
+        image_text_cache_entry_t *entry = NULL;
+
+        if ((data->text_cache_hits + data->text_cache_misses) % IMAGE_TEXT_CACHE_REPORT_INTERVAL == 0 &&
+            data->text_cache_hits + data->text_cache_misses > 0)
+                image_text_cache_report (data);
+
+        for (node = ply_list_get_first_node (data->text_cache);
+             node != NULL;
+             node = ply_list_get_next_node (data->text_cache, node)) {
+                image_text_cache_entry_t *candidate = ply_list_node_get_data (node);
+
+                if (image_text_cache_entry_matches (candidate, text, font,
+                                                    red, green, blue, alpha, align)) {
+                        entry = candidate;
+                        break;
+                }
+        }
+
+        if (entry == NULL) {
+                data->text_cache_misses++;
+                return NULL;
+        }
+
+        data->text_cache_hits++;
+
+        if (node != ply_list_get_first_node (data->text_cache)) {
+                ply_list_remove_node (data->text_cache, node);
+                ply_list_prepend_data (data->text_cache, entry);
+        }
+
+        return script_obj_new_ref (entry->image);
+}
+
+static void image_text_cache_add (script_lib_image_data_t *data,
+                                  const char              *text,
+                                  const char              *font,
+                                  float                    red,
+                                  float                    green,
+                                  float                    blue,
+                                  float                    alpha,
+                                  int                      align,
+                                  script_obj_t            *image)
+{
+        image_text_cache_entry_t *entry;
+        ply_list_node_t *node;
+
+        if (ply_list_get_length (data->text_cache) >= IMAGE_TEXT_CACHE_SIZE) {
+                node = ply_list_get_last_node (data->text_cache);
+                image_text_cache_entry_free (ply_list_node_get_data (node));
+                ply_list_remove_node (data->text_cache, node);
+        }
+
+        entry = calloc (1, sizeof(image_text_cache_entry_t));
+        entry->text = strdup (text);
+        entry->font = font != NULL ? strdup (font) : NULL;
+        entry->red = red;
+        entry->green = green;
+        entry->blue = blue;
+        entry->alpha = alpha;
+        entry->align = align;
+        entry->image = image;
+        script_obj_ref (image);
+
+        ply_list_prepend_data (data->text_cache, entry);
+}
+
 static script_return_t image_text (script_state_t *state,
                                    void           *user_data)
 {
         script_lib_image_data_t *data = user_data;
         ply_pixel_buffer_t *image;
         ply_label_t *label;
-        script_obj_t *alpha_obj, *font_obj, *align_obj;
+        script_obj_t *alpha_obj, *font_obj, *align_obj, *image_obj, *reply_obj;
         int width, height;
         int align = PLY_LABEL_ALIGN_LEFT;
         char *font;
@@ -239,6 +377,14 @@ static script_return_t image_text (script_state_t *state,
                 return script_return_obj_null ();
         }
 
+        image_obj = image_text_cache_lookup (data, text, font,
+                                             red, green, blue, alpha, align);
+        if (image_obj != NULL) {
+                free (text);
+                free (font);
+                return script_return_obj (image_obj);
+        }
+
         label = ply_label_new ();
         ply_label_set_text (label, text);
         if (font)
@@ -252,12 +398,18 @@ static script_return_t image_text (script_state_t *state,
 
         image = ply_pixel_buffer_new (width, height);
         ply_label_draw_area (label, image, 0, 0, width, height);
+        ply_label_free (label);
+
+        image_obj = script_obj_new_native (image, data->class);
+        image_text_cache_add (data, text, font, red, green, blue, alpha, align,
+                              image_obj);
 
         free (text);
         free (font);
-        ply_label_free (label);
 
-        return script_return_obj (script_obj_new_native (image, data->class));
+        reply_obj = script_obj_new_ref (image_obj);
+        script_obj_unref (image_obj);
+        return script_return_obj (reply_obj);
 }
 
 script_lib_image_data_t *script_lib_image_setup (script_state_t *state,
@@ -267,6 +419,9 @@ script_lib_image_data_t *script_lib_image_setup (script_state_t *state,
 
         data->class = script_obj_native_class_new (image_free, "image", data);
         data->image_dir = strdup (image_dir);
+        data->text_cache = ply_list_new ();
+        data->text_cache_hits = 0;
+        data->text_cache_misses = 0;
 
         script_obj_t *image_hash = script_obj_hash_get_element (state->global, "Image");
 
@@ -338,6 +493,18 @@ script_lib_image_data_t *script_lib_image_setup (script_state_t *state,
 
 void script_lib_image_destroy (script_lib_image_data_t *data)
 {
+        ply_list_node_t *node;
+
+        image_text_cache_report (data);
+
+        /* Drop the cached images before the class they belong to */
+        for (node = ply_list_get_first_node (data->text_cache);
+             node != NULL;
+             node = ply_list_get_next_node (data->text_cache, node)) {
+                image_text_cache_entry_free (ply_list_node_get_data (node));
+        }
+        ply_list_free (data->text_cache);
+
         script_obj_native_class_destroy (data->class);
         free (data->image_dir);
         script_parse_op_free (data->script_main_op);
@@ -22,6 +22,7 @@
 #ifndef SCRIPT_LIB_IMAGE_H
 #define SCRIPT_LIB_IMAGE_H
 
+#include "ply-list.h"
 #include "script.h"
 
 typedef struct
@@ -29,6 +30,11 @@ typedef struct
         script_obj_native_class_t *class;
         script_op_t               *script_main_op;
         char                      *image_dir;
+
+        /* Recently rendered Image.Text results, most recently used first */
+        ply_list_t                *text_cache;
+        unsigned long              text_cache_hits;
+        unsigned long              text_cache_misses;
 } script_lib_image_data_t;
 
 script_lib_image_data_t *script_lib_image_setup (script_state_t *state,
@@ -60,7 +60,8 @@ static script_return_t script_lib_math_double_from_double_double_function (scrip
 static script_return_t script_lib_math_random (script_state_t *state,
                                                void           *user_data)
 {
-        double reply_double = ply_get_random_number (0, LONG_MAX) / ((double) LONG_MAX);
+        script_lib_math_data_t *data = user_data;
+        double reply_double = ply_random_get_double (data->random);
 
         return script_return_obj (script_obj_new_number (reply_double));
 }
@@ -69,6 +70,7 @@ script_lib_math_data_t *script_lib_math_setup (script_state_t *state)
 {
         script_lib_math_data_t *data = malloc (sizeof(script_lib_math_data_t));
 
+        data->random = ply_random_new ();
 
         script_obj_t *math_hash = script_obj_hash_get_element (state->global, "Math");
 
@@ -112,7 +114,7 @@ script_lib_math_data_t *script_lib_math_setup (script_state_t *state)
         script_add_native_function (math_hash,
                                     "Random",
                                     script_lib_math_random,
-                                    NULL,
+                                    data,
                                     NULL);
         script_obj_unref (math_hash);
 
@@ -127,5 +129,6 @@ script_lib_math_data_t *script_lib_math_setup (script_state_t *state)
 void script_lib_math_destroy (script_lib_math_data_t *data)
 {
         script_parse_op_free (data->script_main_op);
+        ply_random_free (data->random);
         free (data);
 }
@@ -22,11 +22,13 @@
 #ifndef SCRIPT_LIB_MATH_H
 #define SCRIPT_LIB_MATH_H
 
+#include "ply-random.h"
 #include "script.h"
 
 typedef struct
 {
-        script_op_t *script_main_op;
+        script_op_t  *script_main_op;
+        ply_random_t *random;
 } script_lib_math_data_t;
 
 script_lib_math_data_t *script_lib_math_setup (script_state_t *state);
@@ -754,15 +754,16 @@ void script_lib_sprite_pixel_display_removed (script_lib_sprite_data_t *data,
                 update_displays (data);
 }
 
-void
+bool
 script_lib_sprite_refresh (script_lib_sprite_data_t *data)
 {
         ply_list_node_t *node;
         ply_region_t *region;
         ply_list_t *rectable_list;
+        bool drew_area;
 
         if (!data)
-                return;
+                return false;
 
         region = ply_region_new ();
 
@@ -837,6 +838,7 @@ script_lib_sprite_refresh (script_lib_sprite_data_t *data)
         }
 
         rectable_list = ply_region_get_rectangle_list (region);
+        drew_area = ply_list_get_length (rectable_list) > 0;
 
         for (node = ply_list_get_first_node (rectable_list);
              node;
@@ -850,6 +852,8 @@ script_lib_sprite_refresh (script_lib_sprite_data_t *data)
         }
 
         ply_region_free (region);
+
+        return drew_area;
 }
 
 void script_lib_sprite_destroy (script_lib_sprite_data_t *data)
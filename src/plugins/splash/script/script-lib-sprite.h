@@ -71,7 +71,8 @@ void script_lib_sprite_pixel_display_added (script_lib_sprite_data_t *data,
                                             ply_pixel_display_t      *pixel_display);
 void script_lib_sprite_pixel_display_removed (script_lib_sprite_data_t *data,
                                               ply_pixel_display_t      *pixel_display);
-void script_lib_sprite_refresh (script_lib_sprite_data_t *data);
+/* Returns true if any part of the screen had to be redrawn */
+bool script_lib_sprite_refresh (script_lib_sprite_data_t *data);
 void script_lib_sprite_destroy (script_lib_sprite_data_t *data);
 
 #endif /* SCRIPT_LIB_SPRITE_H */
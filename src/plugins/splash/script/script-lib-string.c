@@ -35,85 +35,109 @@
 #include "script-lib-string.script.h"
 
 
+/* Returns a new reference to the string "this" refers to.  Only the odd
+ * case of calling a string method on something else needs a conversion.
+ */
+static script_string_t *script_lib_string_get_this (script_state_t *state)
+{
+        script_string_t *string = script_obj_peek_string (state->this);
+        char *text;
+
+        if (string)
+                return script_string_ref (string);
+
+        text = script_obj_as_string (state->this);
+        string = script_string_new (text, strlen (text));
+        free (text);
+        return string;
+}
+
+static script_string_t *script_lib_string_get_byte_string (script_lib_string_data_t *data,
+                                                           unsigned char             byte)
+{
+        if (!data->byte_strings[byte])
+                data->byte_strings[byte] = script_string_new ((char *) &byte, byte ? 1 : 0);
+
+        return script_string_ref (data->byte_strings[byte]);
+}
+
 static script_return_t script_lib_string_char_at (script_state_t *state,
                                                   void           *user_data)
 {
-        char *text = script_obj_as_string (state->this);
+        script_lib_string_data_t *data = user_data;
+        script_string_t *text = script_lib_string_get_this (state);
         int index = script_obj_hash_get_number (state->local, "index");
-        int count;
-        char charstring[2];
+        script_string_t *charstring;
 
-        if (!text || index < 0) {
-                free (text);
+        if (index < 0) {
+                script_string_unref (text);
                 return script_return_obj_null ();
         }
-        for (count = 0; count < index; count++) {
-                if (text[count] == '\0') {
-                        free (text);
-                        return script_return_obj (script_obj_new_string (""));
-                }
-        }
-        charstring[0] = text[index];
-        charstring[1] = '\0';
-        free (text);
-        return script_return_obj (script_obj_new_string (charstring));
+        if ((size_t) index >= text->length)
+                charstring = script_lib_string_get_byte_string (data, '\0');
+        else
+                charstring = script_lib_string_get_byte_string (data, text->text[index]);
+
+        script_string_unref (text);
+        return script_return_obj (script_obj_new_shared_string (charstring));
 }
 
 static script_return_t script_lib_string_sub_string (script_state_t *state,
                                                      void           *user_data)
 {
-        char *text = script_obj_as_string (state->this);
+        script_lib_string_data_t *data = user_data;
+        script_string_t *text = script_lib_string_get_this (state);
         int start = script_obj_hash_get_number (state->local, "start");
         int end = script_obj_hash_get_number (state->local, "end");
-        int text_count;
-        char *substring;
-        script_obj_t *substring_obj;
+        script_string_t *substring;
 
-        if (!text || start < 0 || end < start) {
-                free (text);
+        if (start < 0 || end < start) {
+                script_string_unref (text);
                 return script_return_obj_null ();
         }
 
-        for (text_count = 0; text_count < start; text_count++) {
-                if (text[text_count] == '\0') {
-                        free (text);
-                        return script_return_obj (script_obj_new_string (""));
-                }
+        if ((size_t) start >= text->length) {
+                substring = script_lib_string_get_byte_string (data, '\0');
+        } else {
+                if ((size_t) end > text->length)
+                        end = text->length;
+
+                if (start == 0 && (size_t) end == text->length)
+                        substring = script_string_ref (text);
+                else
+                        substring = script_string_new (&text->text[start], end - start);
         }
 
-        substring = strndup (&text[text_count], end - start);
-        substring_obj = script_obj_new_string (substring);
-        free (substring);
-        free (text);
-        return script_return_obj (substring_obj);
+        script_string_unref (text);
+        return script_return_obj (script_obj_new_shared_string (substring));
 }
 
 static script_return_t script_lib_string_length (script_state_t *state,
                                                  void           *user_data)
 {
-        char *text = script_obj_as_string (state->this);
-        size_t text_length = strlen (text);
+        script_string_t *text = script_lib_string_get_this (state);
+        size_t text_length = text->length;
 
-        free (text);
+        script_string_unref (text);
         return script_return_obj (script_obj_new_number (text_length));
 }
 
 script_lib_string_data_t *script_lib_string_setup (script_state_t *state)
 {
-        script_lib_string_data_t *data = malloc (sizeof(script_lib_string_data_t));
+        script_lib_string_data_t *data = calloc (1, sizeof(script_lib_string_data_t));
 
         script_obj_t *string_hash = script_obj_hash_get_element (state->global, "String");
 
         script_add_native_function (string_hash,
                                     "CharAt",
                                     script_lib_string_char_at,
-                                    NULL,
+                                    data,
                                     "index",
                                     NULL);
         script_add_native_function (string_hash,
                                     "SubString",
                                     script_lib_string_sub_string,
-                                    NULL,
+                                    data,
                                     "start",
                                     "end",
                                     NULL);
@@ -133,6 +157,11 @@ script_lib_string_data_t *script_lib_string_setup (script_state_t *state)
 
 void script_lib_string_destroy (script_lib_string_data_t *data)
 {
+        int i;
+
+        for (i = 0; i < 256; i++) {
+                script_string_unref (data->byte_strings[i]);
+        }
         script_parse_op_free (data->script_main_op);
         free (data);
 }
@@ -26,7 +26,10 @@
 
 typedef struct
 {
-        script_op_t *script_main_op;
+        script_op_t     *script_main_op;
+
+        /* Shared results of CharAt, indexed by the byte value */
+        script_string_t *byte_strings[256];
 } script_lib_string_data_t;
 
 script_lib_string_data_t *script_lib_string_setup (script_state_t *state);
@@ -26,6 +26,7 @@
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include "ply-bitarray.h"
+#include "ply-logger.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -37,14 +38,118 @@
 #include <values.h>
 
 #include "script.h"
+#include "script-debug.h"
 #include "script-object.h"
 
+#ifndef SCRIPT_OBJ_STATS_TOP_SITES
+#define SCRIPT_OBJ_STATS_TOP_SITES 10
+#endif
+
+typedef struct
+{
+        char         *name;
+        unsigned long allocations;
+        uint64_t      bytes;
+} script_obj_allocation_site_t;
+
+static script_obj_stats_t stats;
+static void *allocation_site = NULL;
+static ply_hashtable_t *allocation_sites = NULL;   /* only while tracking */
+
 void script_obj_reset (script_obj_t *obj);
 
+static void script_obj_stats_record_site (size_t size)
+{
+        script_obj_allocation_site_t *site;
+
+        site = ply_hashtable_lookup (allocation_sites, allocation_site);
+        if (!site) {
+                site = calloc (1, sizeof(script_obj_allocation_site_t));
+                ply_hashtable_insert (allocation_sites, allocation_site, site);
+        }
+        site->allocations++;
+        site->bytes += size;
+}
+
+static void script_obj_stats_allocated (size_t size)
+{
+        stats.bytes_allocated += size;
+        stats.bytes_in_use += size;
+        if (stats.bytes_in_use > stats.peak_bytes_in_use)
+                stats.peak_bytes_in_use = stats.bytes_in_use;
+        if (allocation_sites)
+                script_obj_stats_record_site (size);
+}
+
+static void script_obj_stats_freed (size_t size)
+{
+        stats.bytes_in_use -= size;
+}
+
+static script_obj_t *script_obj_alloc (script_obj_type_t type)
+{
+        script_obj_t *obj = malloc (sizeof(script_obj_t));
+
+        obj->type = type;
+        obj->refcount = 1;
+        stats.live_objects[type]++;
+        script_obj_stats_allocated (sizeof(script_obj_t));
+        return obj;
+}
+
+static void script_obj_set_type (script_obj_t     *obj,
+                                 script_obj_type_t type)
+{
+        stats.live_objects[obj->type]--;
+        stats.live_objects[type]++;
+        obj->type = type;
+}
+
+static script_string_t *script_string_alloc (size_t length)
+{
+        script_string_t *string = malloc (sizeof(script_string_t) + length + 1);
+
+        string->refcount = 1;
+        string->length = length;
+        stats.live_strings++;
+        script_obj_stats_allocated (sizeof(script_string_t) + length + 1);
+        return string;
+}
+
+script_string_t *script_string_new (const char *text,
+                                    size_t      length)
+{
+        script_string_t *string = script_string_alloc (length);
+
+        memcpy (string->text, text, length);
+        string->text[length] = '\0';
+        return string;
+}
+
+script_string_t *script_string_ref (script_string_t *string)
+{
+        string->refcount++;
+        return string;
+}
+
+void script_string_unref (script_string_t *string)
+{
+        if (!string) return;
+        assert (string->refcount > 0);
+        string->refcount--;
+        if (string->refcount <= 0) {
+                stats.live_strings--;
+                script_obj_stats_freed (sizeof(script_string_t) + string->length + 1);
+                free (string);
+        }
+}
+
 void script_obj_free (script_obj_t *obj)
 {
         assert (!obj->refcount);
         script_obj_reset (obj);
+        stats.live_objects[obj->type]--;
+        script_obj_stats_freed (sizeof(script_obj_t));
         free (obj);
 }
 
@@ -69,6 +174,8 @@ static void foreach_free_variable (void *key,
         script_variable_t *variable = data;
 
         script_obj_unref (variable->object);
+        stats.live_variables--;
+        script_obj_stats_freed (sizeof(script_variable_t) + strlen (variable->name) + 1);
         free (variable->name);
         free (variable);
 }
@@ -89,7 +196,7 @@ void script_obj_reset (script_obj_t *obj)
                 break;
 
         case SCRIPT_OBJ_TYPE_STRING:
-                free (obj->data.string);
+                script_string_unref (obj->data.string);
                 break;
 
         case SCRIPT_OBJ_TYPE_HASH:              /* FIXME nightmare */
@@ -124,7 +231,7 @@ void script_obj_reset (script_obj_t *obj)
         case SCRIPT_OBJ_TYPE_NULL:
                 break;
         }
-        obj->type = SCRIPT_OBJ_TYPE_NULL;
+        script_obj_set_type (obj, SCRIPT_OBJ_TYPE_NULL);
 }
 
 script_obj_t *script_obj_deref_direct (script_obj_t *obj)
@@ -147,19 +254,13 @@ void script_obj_deref (script_obj_t **obj_ptr)
 
 script_obj_t *script_obj_new_null (void)
 {
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
-
-        obj->type = SCRIPT_OBJ_TYPE_NULL;
-        obj->refcount = 1;
-        return obj;
+        return script_obj_alloc (SCRIPT_OBJ_TYPE_NULL);
 }
 
 script_obj_t *script_obj_new_number (script_number_t number)
 {
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_NUMBER);
 
-        obj->type = SCRIPT_OBJ_TYPE_NUMBER;
-        obj->refcount = 1;
         obj->data.number = number;
         return obj;
 }
@@ -167,59 +268,57 @@ script_obj_t *script_obj_new_number (script_number_t number)
 script_obj_t *script_obj_new_string (const char *string)
 {
         if (!string) return script_obj_new_null ();
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
-        obj->type = SCRIPT_OBJ_TYPE_STRING;
-        obj->refcount = 1;
-        obj->data.string = strdup (string);
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_STRING);
+        obj->data.string = script_string_new (string, strlen (string));
+        return obj;
+}
+
+script_obj_t *script_obj_new_shared_string (script_string_t *string)   /* takes over the reference */
+{
+        if (!string) return script_obj_new_null ();
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_STRING);
+        obj->data.string = string;
         return obj;
 }
 
 script_obj_t *script_obj_new_hash (void)
 {
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_HASH);
 
-        obj->type = SCRIPT_OBJ_TYPE_HASH;
         obj->data.hash = ply_hashtable_new (ply_hashtable_string_hash,
                                             ply_hashtable_string_compare);
-        obj->refcount = 1;
         return obj;
 }
 
 script_obj_t *script_obj_new_function (script_function_t *function)
 {
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_FUNCTION);
 
-        obj->type = SCRIPT_OBJ_TYPE_FUNCTION;
         obj->data.function = function;
-        obj->refcount = 1;
         return obj;
 }
 
 script_obj_t *script_obj_new_ref (script_obj_t *sub_obj)
 {
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_REF);
 
         sub_obj = script_obj_deref_direct (sub_obj);
         script_obj_ref (sub_obj);
-        obj->type = SCRIPT_OBJ_TYPE_REF;
         obj->data.obj = sub_obj;
-        obj->refcount = 1;
         return obj;
 }
 
 script_obj_t *script_obj_new_extend (script_obj_t *obj_a,
                                      script_obj_t *obj_b)
 {
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_EXTEND);
 
         obj_a = script_obj_deref_direct (obj_a);
         obj_b = script_obj_deref_direct (obj_b);
         script_obj_ref (obj_a);
         script_obj_ref (obj_b);
-        obj->type = SCRIPT_OBJ_TYPE_EXTEND;
         obj->data.dual_obj.obj_a = obj_a;
         obj->data.dual_obj.obj_b = obj_b;
-        obj->refcount = 1;
         return obj;
 }
 
@@ -227,11 +326,9 @@ script_obj_t *script_obj_new_native (void                      *object_data,
                                      script_obj_native_class_t *class)
 {
         if (!object_data) return script_obj_new_null ();
-        script_obj_t *obj = malloc (sizeof(script_obj_t));
-        obj->type = SCRIPT_OBJ_TYPE_NATIVE;
+        script_obj_t *obj = script_obj_alloc (SCRIPT_OBJ_TYPE_NATIVE);
         obj->data.native.class = class;
         obj->data.native.object_data = object_data;
-        obj->refcount = 1;
         return obj;
 }
 
@@ -292,7 +389,7 @@ static void *script_obj_direct_as_bool (script_obj_t *obj,
         case SCRIPT_OBJ_TYPE_NATIVE:
                 return obj;
         case SCRIPT_OBJ_TYPE_STRING:
-                if (*obj->data.string) return obj;
+                if (obj->data.string->length > 0) return obj;
                 return NULL;
         }
         return NULL;
@@ -308,7 +405,7 @@ char *script_obj_as_string (script_obj_t *obj)              /* reply is strduppe
         char *reply;
         script_obj_t *string_obj = script_obj_as_obj_type (obj, SCRIPT_OBJ_TYPE_STRING);
 
-        if (string_obj) return strdup (string_obj->data.string);
+        if (string_obj) return strdup (string_obj->data.string->text);
         string_obj = script_obj_as_obj_type (obj, SCRIPT_OBJ_TYPE_NUMBER);
         if (string_obj) {
                 asprintf (&reply, "%g", string_obj->data.number);
@@ -320,6 +417,14 @@ char *script_obj_as_string (script_obj_t *obj)              /* reply is strduppe
         return reply;
 }
 
+script_string_t *script_obj_peek_string (script_obj_t *obj)       /* reply is not referenced and may be NULL */
+{
+        script_obj_t *string_obj = script_obj_as_obj_type (obj, SCRIPT_OBJ_TYPE_STRING);
+
+        if (string_obj) return string_obj->data.string;
+        return NULL;
+}
+
 static void *script_obj_direct_as_native_of_class (script_obj_t *obj,
                                                    void         *user_data)
 {
@@ -402,7 +507,7 @@ void script_obj_assign (script_obj_t *obj_a,
         obj_b = script_obj_deref_direct (obj_b);
         script_obj_ref (obj_b);
         script_obj_reset (obj_a);
-        obj_a->type = SCRIPT_OBJ_TYPE_REF;
+        script_obj_set_type (obj_a, SCRIPT_OBJ_TYPE_REF);
         obj_a->data.obj = obj_b;
 }
 
@@ -447,6 +552,8 @@ script_obj_t *script_obj_hash_get_element (script_obj_t *hash,
         script_variable_t *variable = malloc (sizeof(script_variable_t));
 
         variable->name = strdup (name);
+        stats.live_variables++;
+        script_obj_stats_allocated (sizeof(script_variable_t) + strlen (name) + 1);
         variable->object = script_obj_new_null ();
         ply_hashtable_insert (realhash->data.hash, variable->name, variable);
         script_obj_ref (variable->object);
@@ -523,20 +630,32 @@ script_obj_t *script_obj_plus (script_obj_t *script_obj_a,
                 return script_obj_new_number (value);
         }
         if (script_obj_is_string (script_obj_a) || script_obj_is_string (script_obj_b)) {
-                script_obj_t *obj;
-                char *string_a = script_obj_as_string (script_obj_a);
-                char *string_b = script_obj_as_string (script_obj_b);
-                if (string_a && string_b) {
-                        char *newstring;
-                        asprintf (&newstring, "%s%s", string_a, string_b);
-                        obj = script_obj_new_string (newstring);
-                        free (newstring);
-                } else {
-                        obj = script_obj_new_null ();
+                script_string_t *shared_a = script_obj_peek_string (script_obj_a);
+                script_string_t *shared_b = script_obj_peek_string (script_obj_b);
+                script_string_t *newstring;
+                char *string_a, *string_b;
+                size_t length_a, length_b;
+
+                /* Appending to an empty string gives the same string back */
+                if (shared_a && shared_b) {
+                        if (shared_b->length == 0)
+                                return script_obj_new_shared_string (script_string_ref (shared_a));
+                        if (shared_a->length == 0)
+                                return script_obj_new_shared_string (script_string_ref (shared_b));
                 }
-                free (string_a);
-                free (string_b);
-                return obj;
+
+                string_a = shared_a ? shared_a->text : script_obj_as_string (script_obj_a);
+                string_b = shared_b ? shared_b->text : script_obj_as_string (script_obj_b);
+                length_a = shared_a ? shared_a->length : strlen (string_a);
+                length_b = shared_b ? shared_b->length : strlen (string_b);
+
+                newstring = script_string_alloc (length_a + length_b);
+                memcpy (newstring->text, string_a, length_a);
+                memcpy (newstring->text + length_a, string_b, length_b + 1);
+
+                if (!shared_a) free (string_a);
+                if (!shared_b) free (string_b);
+                return script_obj_new_shared_string (newstring);
         }
         return script_obj_new_null ();
 }
@@ -599,11 +718,9 @@ script_obj_cmp_result_t script_obj_cmp (script_obj_t *script_obj_a,
                 }
         } else if (script_obj_is_string (script_obj_a)) {
                 if (script_obj_is_string (script_obj_b)) {
-                        char *string_a = script_obj_as_string (script_obj_a);
-                        char *string_b = script_obj_as_string (script_obj_b);
-                        int diff = strcmp (string_a, string_b);
-                        free (string_a);
-                        free (string_b);
+                        script_string_t *string_a = script_obj_peek_string (script_obj_a);
+                        script_string_t *string_b = script_obj_peek_string (script_obj_b);
+                        int diff = strcmp (string_a->text, string_b->text);
                         if (diff < 0) return SCRIPT_OBJ_CMP_RESULT_LT;
                         if (diff > 0) return SCRIPT_OBJ_CMP_RESULT_GT;
                         return SCRIPT_OBJ_CMP_RESULT_EQ;
@@ -613,3 +730,151 @@ script_obj_cmp_result_t script_obj_cmp (script_obj_t *script_obj_a,
         }
         return SCRIPT_OBJ_CMP_RESULT_NE;
 }
+
+const script_obj_stats_t *script_obj_get_stats (void)
+{
+        return &stats;
+}
+
+void script_obj_stats_end_frame (void)
+{
+        stats.last_frame_bytes = stats.bytes_allocated - stats.frame_start_bytes_allocated;
+        if (stats.last_frame_bytes > stats.peak_frame_bytes)
+                stats.peak_frame_bytes = stats.last_frame_bytes;
+        stats.frame_start_bytes_allocated = stats.bytes_allocated;
+        stats.frame_count++;
+}
+
+/* Allocations are charged to the site set here, an expression being
+ * evaluated; returns the previous one so callers can nest */
+void *script_obj_stats_set_allocation_site (void *site)
+{
+        void *previous_site = allocation_site;
+
+        allocation_site = site;
+        return previous_site;
+}
+
+static void foreach_free_site (void *key,
+                               void *data,
+                               void *user_data)
+{
+        script_obj_allocation_site_t *site = data;
+
+        free (site->name);
+        free (site);
+}
+
+void script_obj_stats_track_allocation_sites (bool track)
+{
+        if (track && !allocation_sites) {
+                allocation_sites = ply_hashtable_new (NULL, NULL);
+        } else if (!track && allocation_sites) {
+                ply_hashtable_foreach (allocation_sites, foreach_free_site, NULL);
+                ply_hashtable_free (allocation_sites);
+                allocation_sites = NULL;
+        }
+}
+
+/* Folds the per expression counts into per source line ones */
+static void foreach_merge_site (void *key,
+                                void *data,
+                                void *user_data)
+{
+        ply_hashtable_t *lines = user_data;
+        script_obj_allocation_site_t *site = data;
+        script_obj_allocation_site_t *line;
+        script_debug_location_t *location = NULL;
+        char *name;
+
+        if (key)
+                location = script_debug_lookup_element (key);
+        if (location)
+                asprintf (&name, "%s:%d", location->name, location->line_index);
+        else
+                name = strdup ("(native)");
+
+        line = ply_hashtable_lookup (lines, name);
+        if (!line) {
+                line = calloc (1, sizeof(script_obj_allocation_site_t));
+                line->name = name;
+                ply_hashtable_insert (lines, line->name, line);
+        } else {
+                free (name);
+        }
+        line->allocations += site->allocations;
+        line->bytes += site->bytes;
+}
+
+static void foreach_add_site_to_list (void *key,
+                                      void *data,
+                                      void *user_data)
+{
+        ply_list_append_data (user_data, data);
+}
+
+static int compare_sites_by_bytes (void *element_a,
+                                   void *element_b)
+{
+        script_obj_allocation_site_t *site_a = element_a;
+        script_obj_allocation_site_t *site_b = element_b;
+
+        if (site_a->bytes > site_b->bytes) return -1;
+        if (site_a->bytes < site_b->bytes) return 1;
+        return 0;
+}
+
+void script_obj_stats_dump (void)
+{
+        ply_hashtable_t *lines;
+        ply_list_t *sorted_lines;
+        ply_list_node_t *node;
+        int count;
+
+        ply_trace ("script memory: %zu bytes in use, %zu peak, %llu allocated over %lu frames, "
+                   "%llu in the last frame, %llu in the busiest",
+                   stats.bytes_in_use,
+                   stats.peak_bytes_in_use,
+                   (unsigned long long) stats.bytes_allocated,
+                   stats.frame_count,
+                   (unsigned long long) stats.last_frame_bytes,
+                   (unsigned long long) stats.peak_frame_bytes);
+        ply_trace ("script objects: %lu null, %lu ref, %lu extend, %lu number, %lu string, "
+                   "%lu hash, %lu function, %lu native; %lu strings, %lu variables",
+                   stats.live_objects[SCRIPT_OBJ_TYPE_NULL],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_REF],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_EXTEND],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_NUMBER],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_STRING],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_HASH],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_FUNCTION],
+                   stats.live_objects[SCRIPT_OBJ_TYPE_NATIVE],
+                   stats.live_strings,
+                   stats.live_variables);
+
+        if (!allocation_sites)
+                return;
+
+        lines = ply_hashtable_new (ply_hashtable_string_hash,
+                                   ply_hashtable_string_compare);
+        ply_hashtable_foreach (allocation_sites, foreach_merge_site, lines);
+
+        sorted_lines = ply_list_new ();
+        ply_hashtable_foreach (lines, foreach_add_site_to_list, sorted_lines);
+        ply_list_sort_stable (sorted_lines, compare_sites_by_bytes);
+
+        count = 0;
+        for (node = ply_list_get_first_node (sorted_lines);
+             node && count < SCRIPT_OBJ_STATS_TOP_SITES;
+             node = ply_list_get_next_node (sorted_lines, node), count++) {
+                script_obj_allocation_site_t *line = ply_list_node_get_data (node);
+                ply_trace ("script allocations at %s: %lu, %llu bytes",
+                           line->name,
+                           line->allocations,
+                           (unsigned long long) line->bytes);
+        }
+
+        ply_list_free (sorted_lines);
+        ply_hashtable_foreach (lines, foreach_free_site, NULL);
+        ply_hashtable_free (lines);
+}
@@ -24,6 +24,7 @@
 
 #include "script.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 
 typedef enum
@@ -38,6 +39,31 @@ typedef enum
 typedef void *(*script_obj_direct_func_t)(script_obj_t *,
                                           void *);
 
+#define SCRIPT_OBJ_TYPE_COUNT (SCRIPT_OBJ_TYPE_NATIVE + 1)
+
+/* Memory used by script objects, strings and hash variables.  Kept up to
+ * date all the time; hashtable internals and native object data are not
+ * counted.
+ */
+typedef struct
+{
+        unsigned long live_objects[SCRIPT_OBJ_TYPE_COUNT];
+        unsigned long live_strings;
+        unsigned long live_variables;
+        size_t        bytes_in_use;
+        size_t        peak_bytes_in_use;
+        uint64_t      bytes_allocated;
+        uint64_t      frame_start_bytes_allocated;
+        uint64_t      last_frame_bytes;
+        uint64_t      peak_frame_bytes;
+        unsigned long frame_count;
+} script_obj_stats_t;
+
+
+script_string_t *script_string_new (const char *text,
+                                    size_t      length);
+script_string_t *script_string_ref (script_string_t *string);
+void script_string_unref (script_string_t *string);
 
 void script_obj_free (script_obj_t *obj);
 void script_obj_ref (script_obj_t *obj);
@@ -47,6 +73,7 @@ script_obj_t *script_obj_deref_direct (script_obj_t *obj);
 void script_obj_deref (script_obj_t **obj_ptr);
 script_obj_t *script_obj_new_number (script_number_t number);
 script_obj_t *script_obj_new_string (const char *string);
+script_obj_t *script_obj_new_shared_string (script_string_t *string);
 script_obj_t *script_obj_new_null (void);
 script_obj_t *script_obj_new_hash (void);
 script_obj_t *script_obj_new_function (script_function_t *function);
@@ -64,6 +91,7 @@ script_obj_t *script_obj_as_obj_type (script_obj_t     *obj,
 script_number_t script_obj_as_number (script_obj_t *obj);
 bool script_obj_as_bool (script_obj_t *obj);
 char *script_obj_as_string (script_obj_t *obj);
+script_string_t *script_obj_peek_string (script_obj_t *obj);
 void *script_obj_as_native_of_class (script_obj_t              *obj,
                                      script_obj_native_class_t *class);
 void *script_obj_as_native_of_class_name (script_obj_t *obj,
@@ -111,4 +139,10 @@ script_obj_t *script_obj_mod (script_obj_t *script_obj_a_in,
                               script_obj_t *script_obj_b_in);
 script_obj_cmp_result_t script_obj_cmp (script_obj_t *script_obj_a,
                                         script_obj_t *script_obj_b);
+
+const script_obj_stats_t *script_obj_get_stats (void);
+void script_obj_stats_end_frame (void);
+void *script_obj_stats_set_allocation_site (void *site);
+void script_obj_stats_track_allocation_sites (bool track);
+void script_obj_stats_dump (void);
 #endif /* SCRIPT_OBJECT_H */
@@ -25,6 +25,7 @@
 #include "ply-hashtable.h"
 #include "ply-list.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef enum                        /* FIXME add _t to all types */
 {
@@ -84,6 +85,14 @@ typedef struct
 
 typedef double script_number_t;
 
+/* Strings are immutable once created, so objects share them by reference */
+typedef struct
+{
+        int    refcount;
+        size_t length;
+        char   text[];
+} script_string_t;
+
 typedef struct
 {
         void                      *object_data;
@@ -109,7 +118,7 @@ typedef struct script_obj_t
         union
         {
                 script_number_t      number;
-                char                *string;
+                script_string_t     *string;
                 struct script_obj_t *obj;
                 struct
                 {
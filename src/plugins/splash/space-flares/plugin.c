@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -51,6 +52,7 @@
 #include "ply-image.h"
 #include "ply-pixel-buffer.h"
 #include "ply-pixel-display.h"
+#include "ply-random.h"
 #include "ply-trigger.h"
 #include "ply-utils.h"
 #include "ply-console-viewer.h"
@@ -66,6 +68,14 @@
 #define HALO_BLUR 4
 #define STAR_HZ 0.08
 
+/* Number of entries in the star twinkle table, must be a power of two */
+#ifndef STAR_PHASE_STEPS
+#define STAR_PHASE_STEPS 1024
+#endif
+
+/* Angle the flare outlines advance by on each step */
+#define FLARE_THETA_STEP 0.05
+
 /*you can comment one or both of these out*/
 /*#define SHOW_PLANETS */
 /*#define SHOW_COMETS */
@@ -106,16 +116,17 @@ typedef struct
 
 typedef struct
 {
-        float        stretch[FLARE_COUNT];
-        float        rotate_yz[FLARE_COUNT];
-        float        rotate_xy[FLARE_COUNT];
-        float        rotate_xz[FLARE_COUNT];
-        float        increase_speed[FLARE_COUNT];
-        float        z_offset_strength[FLARE_COUNT];
-        float        y_size[FLARE_COUNT];
-        ply_image_t *image_a;
-        ply_image_t *image_b;
-        int          frame_count;
+        float         stretch[FLARE_COUNT];
+        float         rotate_yz[FLARE_COUNT];
+        float         rotate_xy[FLARE_COUNT];
+        float         rotate_xz[FLARE_COUNT];
+        float         increase_speed[FLARE_COUNT];
+        float         z_offset_strength[FLARE_COUNT];
+        float         y_size[FLARE_COUNT];
+        ply_image_t  *image_a;
+        ply_image_t  *image_b;
+        ply_random_t *random;
+        int           frame_count;
 } flare_t;
 
 typedef enum
@@ -135,6 +146,10 @@ typedef struct
         double           theta;
         ply_image_t     *image;
         ply_image_t     *image_altered;
+        int              cresent_x;
+        int              cresent_y;
+        int              cresent_z;
+        bool             cresent_is_current;
 } satellite_t;
 
 
@@ -151,11 +166,14 @@ typedef struct
 
 typedef struct
 {
-        int  star_count;
-        int *star_x;
-        int *star_y;
-        int *star_refresh;
-        int  frame_count;
+        int       star_count;
+        int      *star_x;
+        int      *star_y;
+        int      *star_refresh;
+        int      *star_phase;
+        uint32_t *star_colour;
+        uint8_t   star_glow[STAR_PHASE_STEPS];
+        int       frame_count;
 } star_bg_t;
 
 typedef struct
@@ -168,6 +186,13 @@ typedef struct
         ply_list_t               *sprites;
         ply_rectangle_t           box_area, lock_area, logo_area;
         ply_image_t              *scaled_background_image;
+        uint32_t                 *gradient_data;
+        unsigned long             gradient_width, gradient_height;
+        sprite_t                 *star_field_to_draw;
+
+        int                       frames_since_report;
+        unsigned long             draw_calls_since_report;
+        unsigned long             flushes_at_last_report;
 
         ply_console_viewer_t     *console_viewer;
 } view_t;
@@ -195,6 +220,7 @@ struct _ply_boot_splash_plugin
         char                          *image_dir;
         ply_boot_splash_display_type_t state;
         ply_list_t                    *views;
+        ply_random_t                  *random;
 
         double                         now;
 
@@ -268,6 +294,7 @@ view_free (view_t *view)
         ply_console_viewer_free (view->console_viewer);
 
         ply_image_free (view->scaled_background_image);
+        free (view->gradient_data);
 
         free (view);
 }
@@ -445,6 +472,10 @@ view_start_animation (view_t *view)
 
         view_setup_scene (view);
 
+        view->frames_since_report = 0;
+        view->draw_calls_since_report = 0;
+        view->flushes_at_last_report = ply_pixel_display_get_number_of_frames_drawn (view->display);
+
         screen_width = ply_pixel_display_get_width (view->display);
         screen_height = ply_pixel_display_get_height (view->display);
 
@@ -576,6 +607,7 @@ create_plugin (ply_key_file_t *key_file)
         char *image_dir, *image_path;
 
         plugin = calloc (1, sizeof(ply_boot_splash_plugin_t));
+        plugin->random = ply_random_new ();
 
         plugin->logo_image = ply_image_new (PLYMOUTH_LOGO_FILE);
 
@@ -686,6 +718,7 @@ destroy_plugin (ply_boot_splash_plugin_t *plugin)
 
         free_views (plugin);
 
+        ply_random_free (plugin->random);
         free (plugin);
 }
 
@@ -723,6 +756,8 @@ free_sprite (sprite_t *sprite)
                         free (star_bg->star_x);
                         free (star_bg->star_y);
                         free (star_bg->star_refresh);
+                        free (star_bg->star_phase);
+                        free (star_bg->star_colour);
                         break;
                 }
                 }
@@ -797,16 +832,11 @@ progress_update (view_t   *view,
 
 
 static inline uint32_t
-star_bg_gradient_colour (int   x,
-                         int   y,
-                         int   width,
-                         int   height,
-                         bool  star,
-                         float time)
+star_bg_gradient_colour (int x,
+                         int y,
+                         int full_dist)
 {
-        int full_dist = sqrt (width * width + height * height);
         int my_dist = sqrt (x * x + y * y);
-        float val;
 
         uint16_t r0 = 0x0000;  /* start colour:033c73 */
         uint16_t g0 = 0x3c00;
@@ -834,25 +864,75 @@ star_bg_gradient_colour (int   x,
         g >>= 8;
         b >>= 8;
 
-        if (!star)
+        return 0xff000000 | r << 16 | g << 8 | b;
+}
+
+static void
+star_bg_render_gradient (ply_image_t *image)
+{
+        int width = ply_image_get_width (image);
+        int height = ply_image_get_height (image);
+        uint32_t *image_data = ply_image_get_data (image);
+        int full_dist = sqrt (width * width + height * height);
+        int x, y;
+
+        for (y = 0; y < height; y++) {
+                for (x = 0; x < width; x++) {
+                        image_data[x + y * width] = star_bg_gradient_colour (x, y, full_dist);
+                }
+        }
+}
+
+static void
+star_bg_fill_glow_table (star_bg_t *star_bg)
+{
+        int i;
+
+        for (i = 0; i < STAR_PHASE_STEPS; i++) {
+                double val = (sin (i * (2 * M_PI) / STAR_PHASE_STEPS) + 1) / 2;
+                star_bg->star_glow[i] = val * 0.3 * 256;
+        }
+}
 
-                return 0xff000000 | r << 16 | g << 8 | b;
+/* Position of a pixel in the twinkle wave, in table steps */
+static int
+star_bg_get_phase (int x,
+                   int y,
+                   int width,
+                   int height)
+{
+        double phase;
 
         x -= width + 720 - 800;
         y -= height + 300 - 480;
-        val = sqrt (x * x + y * y) / 100;
-        val = (sin (val - time * (2 * M_PI) * STAR_HZ + atan2 (y, x) * 2) + 1) / 2;
+        phase = sqrt (x * x + y * y) / 100 + atan2 (y, x) * 2;
+        phase *= STAR_PHASE_STEPS / (2 * M_PI);
 
-        val = val * 0.3;
-
-        r = r * (1 - val) + val * 0xff;
-        g = g * (1 - val) + val * 0xff;
-        b = b * (1 - val) + val * 0xff;
+        return ((int) lround (phase) % STAR_PHASE_STEPS + STAR_PHASE_STEPS) % STAR_PHASE_STEPS;
+}
 
-        return 0xff000000 | r << 16 | g << 8 | b;
+static int
+star_bg_get_time_phase (double time)
+{
+        return (int) (fmod (time * STAR_HZ, 1.0) * STAR_PHASE_STEPS) % STAR_PHASE_STEPS;
 }
 
+static inline uint32_t
+star_bg_star_colour (star_bg_t *star_bg,
+                     uint32_t   colour,
+                     int        phase)
+{
+        uint32_t glow = star_bg->star_glow[phase & (STAR_PHASE_STEPS - 1)];
+        uint32_t r = (colour >> 16) & 0xff;
+        uint32_t g = (colour >> 8) & 0xff;
+        uint32_t b = colour & 0xff;
+
+        r += ((0xff - r) * glow) >> 8;
+        g += ((0xff - g) * glow) >> 8;
+        b += ((0xff - b) * glow) >> 8;
 
+        return 0xff000000 | r << 16 | g << 8 | b;
+}
 
 static void
 star_bg_update (view_t   *view,
@@ -861,8 +941,8 @@ star_bg_update (view_t   *view,
 {
         star_bg_t *star_bg = sprite->data;
         int width = ply_image_get_width (sprite->image);
-        int height = ply_image_get_height (sprite->image);
         uint32_t *image_data = ply_image_get_data (sprite->image);
+        int time_phase = star_bg_get_time_phase (time);
         int i, x, y;
 
         star_bg->frame_count++;
@@ -871,7 +951,7 @@ star_bg_update (view_t   *view,
         for (i = star_bg->frame_count; i < star_bg->star_count; i += FRAMES_PER_SECOND / BG_STARS_FRAMES_PER_SECOND) {
                 x = star_bg->star_x[i];
                 y = star_bg->star_y[i];
-                uint32_t pixel_colour = star_bg_gradient_colour (x, y, width, height, true, time);
+                uint32_t pixel_colour = star_bg_star_colour (star_bg, star_bg->star_colour[i], star_bg->star_phase[i] - time_phase);
                 if (abs ((int) ((image_data[x + y * width] >> 16) & 0xff) - (int) ((pixel_colour >> 16) & 0xff)) > 8) {
                         image_data[x + y * width] = pixel_colour;
                         star_bg->star_refresh[i] = 1;
@@ -893,19 +973,22 @@ satellite_move (view_t   *view,
         int width = ply_image_get_width (sprite->image);
         int height = ply_image_get_height (sprite->image);
         unsigned long screen_width, screen_height;
+        double orbit_angle = satellite->theta + (1 - plugin->progress) * 2000 / (satellite->distance);
+        int orbit_x, orbit_y, orbit_z;
 
-        sprite->x = cos (satellite->theta + (1 - plugin->progress) * 2000 / (satellite->distance)) * satellite->distance;
-        sprite->y = sin (satellite->theta + (1 - plugin->progress) * 2000 / (satellite->distance)) * satellite->distance;
+        sprite->x = cos (orbit_angle) * satellite->distance;
+        sprite->y = sin (orbit_angle) * satellite->distance;
         sprite->z = 0;
 
-        float distance = sqrt (sprite->z * sprite->z + sprite->y * sprite->y);
-        float angle_zy = atan2 (sprite->y, sprite->z) - M_PI * 0.4;
-
-        sprite->z = distance * cos (angle_zy);
-        sprite->y = distance * sin (angle_zy);
+        /* Tilt the orbit by rotating it M_PI * 0.4 about the x axis */
+        orbit_x = sprite->x;
+        orbit_y = sprite->y;
+        orbit_z = sprite->y * sin (M_PI * 0.4);
+        orbit_y = sprite->y * cos (M_PI * 0.4);
 
-        float angle_offset = atan2 (sprite->x, sprite->y);
-        float cresent_angle = atan2 (sqrt (sprite->x * sprite->x + sprite->y * sprite->y), sprite->z);
+        sprite->x = orbit_x;
+        sprite->y = orbit_y;
+        sprite->z = orbit_z;
 
         screen_width = ply_pixel_display_get_width (view->display);
         screen_height = ply_pixel_display_get_height (view->display);
@@ -918,6 +1001,35 @@ satellite_move (view_t   *view,
 
         if (satellite->type == SATELLITE_TYPE_PLANET) {
                 int x, y;
+                float orbit_radius, offset_cos, offset_sin, cresent_cos;
+
+                /* The crescent only depends on where the planet is along its orbit */
+                if (satellite->cresent_is_current &&
+                    satellite->cresent_x == orbit_x &&
+                    satellite->cresent_y == orbit_y &&
+                    satellite->cresent_z == orbit_z)
+                        return;
+
+                satellite->cresent_x = orbit_x;
+                satellite->cresent_y = orbit_y;
+                satellite->cresent_z = orbit_z;
+                satellite->cresent_is_current = true;
+
+                /* Rotating each pixel by atan2 (x, y) and comparing against
+                 * cos (atan2 (sqrt (x * x + y * y), z)) reduces to these ratios
+                 */
+                orbit_radius = sqrt (orbit_x * orbit_x + orbit_y * orbit_y);
+                if (orbit_radius > 0) {
+                        offset_cos = orbit_y / orbit_radius;
+                        offset_sin = orbit_x / orbit_radius;
+                } else {
+                        offset_cos = 1;
+                        offset_sin = 0;
+                }
+                if (orbit_radius > 0 || orbit_z != 0)
+                        cresent_cos = orbit_z / sqrt (orbit_radius * orbit_radius + orbit_z * orbit_z);
+                else
+                        cresent_cos = 1;
 
                 uint32_t *image_data = ply_image_get_data (satellite->image);
                 uint32_t *cresent_data = ply_image_get_data (satellite->image_altered);
@@ -926,16 +1038,14 @@ satellite_move (view_t   *view,
                         for (x = 0; x < width; x++) {
                                 float fx = x - (float) width / 2;
                                 float fy = y - (float) height / 2;
-                                float angle = atan2 (fy, fx) + angle_offset;
-                                float distance = sqrt (fy * fy + fx * fx);
-                                fx = cos (angle) * (distance / (width / 2));
-                                fy = sin (angle) * (distance / (height / 2));
-                                float want_y = sqrt (1 - fx * fx);
-                                want_y *= -cos (cresent_angle);
-                                if (fy < want_y) {
+                                float rx = (fx * offset_cos - fy * offset_sin) / (width / 2);
+                                float ry = (fx * offset_sin + fy * offset_cos) / (height / 2);
+                                float want_y = sqrt (1 - rx * rx);
+                                want_y *= -cresent_cos;
+                                if (ry < want_y) {
                                         cresent_data[x + y * width] = image_data[x + y * width];
                                 } else {
-                                        int strength = (fy - want_y) * 16 + 2;
+                                        int strength = (ry - want_y) * 16 + 2;
                                         uint32_t val = 0;
                                         int alpha = ((image_data[x + y * width] >> 24) & 0xFF);
                                         if (strength <= 0) strength = 1;
@@ -952,6 +1062,9 @@ satellite_move (view_t   *view,
 
         if (satellite->type == SATELLITE_TYPE_COMET) {
                 int x, y;
+                float scale = cos (M_PI * 0.4);
+                float tail_cos = cos (orbit_angle);
+                float tail_sin = sin (orbit_angle);
 
                 uint32_t *image_data = ply_image_get_data (satellite->image);
                 uint32_t *comet_data = ply_image_get_data (satellite->image_altered);
@@ -980,21 +1093,15 @@ satellite_move (view_t   *view,
                 }
                 for (y = 0; y < height; y++) {
                         for (x = 0; x < width; x++) {
-                                float scale = cos (M_PI * 0.4);
-                                float fx = x;
-                                float fy = y;
-                                fx -= (float) width / 2;
-                                fy -= (float) height / 2;
-                                fy /= scale;
-                                float angle = atan2 (fy, fx) - (satellite->theta + (1 - plugin->progress) * 2000 / (satellite->distance)) + M_PI / 2 * 0.0;
-                                float distance = sqrt (fy * fy + fx * fx);
-                                fx = cos (angle) * distance;
-                                fy = sin (angle) * distance;
-                                fx += (fy * fy * 2) / (satellite->distance);
-                                fx += (float) width / 2;
-                                fy += (float) height / 2;
-                                int ix = fx;
-                                int iy = fy;
+                                float fx = x - (float) width / 2;
+                                float fy = (y - (float) height / 2) / scale;
+                                float rx = fx * tail_cos + fy * tail_sin;
+                                float ry = fy * tail_cos - fx * tail_sin;
+                                rx += (ry * ry * 2) / (satellite->distance);
+                                rx += (float) width / 2;
+                                ry += (float) height / 2;
+                                int ix = rx;
+                                int iy = ry;
                                 if (ix < 0 || iy < 0 || ix >= width || iy >= height)
                                         comet_data[x + y * width] = 0;
                                 else
@@ -1012,16 +1119,28 @@ sprite_list_sort (view_t *view)
         ply_list_sort_stable (view->sprites, &sprite_compare_z);
 }
 
+static inline void
+rotate_point (double *x,
+              double *y,
+              double  angle_cos,
+              double  angle_sin)
+{
+        double rotated_x = *x * angle_cos - *y * angle_sin;
+
+        *y = *x * angle_sin + *y * angle_cos;
+        *x = rotated_x;
+}
+
 static void
 flare_reset (flare_t *flare,
              int      index)
 {
-        flare->rotate_yz[index] = ((float) (ply_get_random_number (0, 1000)) / 1000) * 2 * M_PI;
-        flare->rotate_xy[index] = ((float) (ply_get_random_number (0, 1000)) / 1000) * 2 * M_PI;
-        flare->rotate_xz[index] = ((float) (ply_get_random_number (0, 1000)) / 1000) * 2 * M_PI;
-        flare->y_size[index] = ((float) (ply_get_random_number (0, 1000)) / 1000) * 0.8 + 0.2;
-        flare->increase_speed[index] = ((float) (ply_get_random_number (0, 1000)) / 1000) * 0.08 + 0.08;
-        flare->stretch[index] = (((float) (ply_get_random_number (0, 1000)) / 1000) * 0.1 + 0.3) * flare->y_size[index];
+        flare->rotate_yz[index] = ((float) (ply_random_get_number (flare->random, 0, 1000)) / 1000) * 2 * M_PI;
+        flare->rotate_xy[index] = ((float) (ply_random_get_number (flare->random, 0, 1000)) / 1000) * 2 * M_PI;
+        flare->rotate_xz[index] = ((float) (ply_random_get_number (flare->random, 0, 1000)) / 1000) * 2 * M_PI;
+        flare->y_size[index] = ((float) (ply_random_get_number (flare->random, 0, 1000)) / 1000) * 0.8 + 0.2;
+        flare->increase_speed[index] = ((float) (ply_random_get_number (flare->random, 0, 1000)) / 1000) * 0.08 + 0.08;
+        flare->stretch[index] = (((float) (ply_random_get_number (flare->random, 0, 1000)) / 1000) * 0.1 + 0.3) * flare->y_size[index];
         flare->z_offset_strength[index] = 0.1;
 }
 
@@ -1052,6 +1171,8 @@ flare_update (sprite_t *sprite,
 
 
         int b;
+        double step_cos = cos (FLARE_THETA_STEP);
+        double step_sin = sin (FLARE_THETA_STEP);
 
         for (b = 0; b < FLARE_COUNT; b++) {
                 int flare_line;
@@ -1063,15 +1184,36 @@ flare_update (sprite_t *sprite,
                         flare_reset (flare, b);
                 for (flare_line = 0; flare_line < FLARE_LINE_COUNT; flare_line++) {
                         double x, y, z;
-                        double angle, distance;
-                        float theta;
-                        for (theta = -M_PI + (0.05 * cos (flare->increase_speed[b] * 1000 + flare_line)); theta < M_PI; theta += 0.05) {
+                        float theta = -M_PI + (0.05 * cos (flare->increase_speed[b] * 1000 + flare_line));
+                        double z_skew = sin (b + flare_line * flare_line) * flare->z_offset_strength[b];
+                        double wobble_rate = 4 * sin (b + flare_line * 5);
+                        double xy_angle = flare->rotate_xy[b] + 0.02 * sin (b * flare_line);
+                        double yz_angle = flare->rotate_yz[b] + 0.02 * sin (3 * b * flare_line);
+                        double xz_angle = flare->rotate_xz[b] + 0.02 * sin (8 * b * flare_line);
+                        double xy_cos = cos (xy_angle), xy_sin = sin (xy_angle);
+                        double yz_cos = cos (yz_angle), yz_sin = sin (yz_angle);
+                        double xz_cos = cos (xz_angle), xz_sin = sin (xz_angle);
+
+                        /* Walk the outline by rotating fixed steps instead of
+                         * evaluating the trigonometry at every point
+                         */
+                        double theta_cos = cos (theta), theta_sin = sin (theta);
+                        double wobble_cos = cos (theta * wobble_rate), wobble_sin = sin (theta * wobble_rate);
+                        double wobble_step_cos = cos (FLARE_THETA_STEP * wobble_rate);
+                        double wobble_step_sin = sin (FLARE_THETA_STEP * wobble_rate);
+
+                        for (; theta < M_PI; theta += FLARE_THETA_STEP) {
                                 int ix;
                                 int iy;
+                                double point_cos = theta_cos, point_sin = theta_sin;
+                                double point_wobble_cos = wobble_cos, point_wobble_sin = wobble_sin;
 
-                                x = (cos (theta) + 0.5) * flare->stretch[b] * 0.8;
-                                y = (sin (theta)) * flare->y_size[b];
-                                z = x * (sin (b + flare_line * flare_line)) * flare->z_offset_strength[b];
+                                rotate_point (&theta_cos, &theta_sin, step_cos, step_sin);
+                                rotate_point (&wobble_cos, &wobble_sin, wobble_step_cos, wobble_step_sin);
+
+                                x = (point_cos + 0.5) * flare->stretch[b] * 0.8;
+                                y = point_sin * flare->y_size[b];
+                                z = x * z_skew;
 
                                 float strength = 1.1 - (x / 2) + flare->increase_speed[b] * 3;
                                 x += 4.5;
@@ -1080,25 +1222,13 @@ flare_update (sprite_t *sprite,
                                 strength = CLAMP (strength, 0, 1);
                                 strength *= 32;
 
-                                x += 0.05 * sin (4 * theta * (sin (b + flare_line * 5)));
-                                y += 0.05 * cos (4 * theta * (sin (b + flare_line * 5)));
-                                z += 0.05 * sin (4 * theta * (sin (b + flare_line * 5)));
-
-                                distance = sqrt (x * x + y * y);
-                                angle = atan2 (y, x) + flare->rotate_xy[b] + 0.02 * sin (b * flare_line);
-                                x = distance * cos (angle);
-                                y = distance * sin (angle);
-
-                                distance = sqrt (z * z + y * y);
-                                angle = atan2 (y, z) + flare->rotate_yz[b] + 0.02 * sin (3 * b * flare_line);
-                                z = distance * cos (angle);
-                                y = distance * sin (angle);
-
-                                distance = sqrt (x * x + z * z);
-                                angle = atan2 (z, x) + flare->rotate_xz[b] + 0.02 * sin (8 * b * flare_line);
-                                x = distance * cos (angle);
-                                z = distance * sin (angle);
+                                x += 0.05 * point_wobble_sin;
+                                y += 0.05 * point_wobble_cos;
+                                z += 0.05 * point_wobble_sin;
 
+                                rotate_point (&x, &y, xy_cos, xy_sin);
+                                rotate_point (&z, &y, yz_cos, yz_sin);
+                                rotate_point (&x, &z, xz_cos, xz_sin);
 
                                 x *= 41;
                                 y *= 41;
@@ -1132,7 +1262,7 @@ flare_update (sprite_t *sprite,
                                 value += (old_image_data[x + (y + 1) * width] >> 24) * 2;
                                 value += (old_image_data[(x + 1) + (y + 1) * width] >> 24) * 1;
                                 value /= 21;
-                                value = (value << 24) | ((int) (value * 0.7) << 16) | (value << 8) | (value << 0);
+                                value = (value << 24) | ((value * 7 / 10) << 16) | (value << 8) | (value << 0);
                                 new_image_data[x + y * width] = value;
                         }
                 }
@@ -1170,6 +1300,86 @@ sprite_move (view_t   *view,
         }
 }
 
+static void
+view_draw_area (view_t *view,
+                int     x,
+                int     y,
+                int     width,
+                int     height)
+{
+        view->draw_calls_since_report++;
+        ply_pixel_display_draw_area (view->display, x, y, width, height);
+}
+
+static void
+view_redraw_star_field (view_t   *view,
+                        sprite_t *sprite)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+        star_bg_t *star_bg = sprite->data;
+        int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+        int i;
+
+        /* Prompts and console messages cover the star field with other layers, so
+         * fall back to drawing each star through the full scene
+         */
+        if (plugin->state != PLY_BOOT_SPLASH_DISPLAY_NORMAL ||
+            plugin->should_show_console_messages) {
+                for (i = 0; i < star_bg->star_count; i++) {
+                        if (star_bg->star_refresh[i]) {
+                                view_draw_area (view,
+                                                sprite->x + star_bg->star_x[i], sprite->y + star_bg->star_y[i], 1, 1);
+                                star_bg->star_refresh[i] = 0;
+                        }
+                }
+                return;
+        }
+
+        for (i = 0; i < star_bg->star_count; i++) {
+                if (!star_bg->star_refresh[i])
+                        continue;
+
+                x1 = MIN (x1, star_bg->star_x[i]);
+                y1 = MIN (y1, star_bg->star_y[i]);
+                x2 = MAX (x2, star_bg->star_x[i]);
+                y2 = MAX (y2, star_bg->star_y[i]);
+        }
+
+        if (x1 > x2)
+                return;
+
+        /* Draw every changed star in one pass; on_draw only touches the star
+         * pixels while star_field_to_draw is set, so the damage stays limited
+         * to those pixels and gets flushed once
+         */
+        view->star_field_to_draw = sprite;
+        view_draw_area (view, sprite->x + x1, sprite->y + y1, x2 - x1 + 1, y2 - y1 + 1);
+        view->star_field_to_draw = NULL;
+
+        for (i = 0; i < star_bg->star_count; i++) {
+                star_bg->star_refresh[i] = 0;
+        }
+}
+
+static void
+view_report_frame_statistics (view_t *view)
+{
+        unsigned long flushes;
+
+        view->frames_since_report++;
+        if (view->frames_since_report < FRAMES_PER_SECOND)
+                return;
+
+        flushes = ply_pixel_display_get_number_of_frames_drawn (view->display);
+        ply_trace ("%.1f draw calls and %.1f flushes per frame",
+                   (double) view->draw_calls_since_report / view->frames_since_report,
+                   (double) (flushes - view->flushes_at_last_report) / view->frames_since_report);
+
+        view->frames_since_report = 0;
+        view->draw_calls_since_report = 0;
+        view->flushes_at_last_report = flushes;
+}
+
 static void
 view_animate_attime (view_t *view,
                      double  time)
@@ -1203,15 +1413,7 @@ view_animate_attime (view_t *view,
                         int height = ply_image_get_height (sprite->image);
 
                         if (sprite->type == SPRITE_TYPE_STAR_BG) {
-                                star_bg_t *star_bg = sprite->data;
-                                int i;
-                                for (i = 0; i < star_bg->star_count; i++) {
-                                        if (star_bg->star_refresh[i]) {
-                                                ply_pixel_display_draw_area (view->display,
-                                                                             sprite->x + star_bg->star_x[i], sprite->y + star_bg->star_y[i], 1, 1);
-                                                star_bg->star_refresh[i] = 0;
-                                        }
-                                }
+                                view_redraw_star_field (view, sprite);
                                 continue;
                         }
 
@@ -1225,16 +1427,15 @@ view_animate_attime (view_t *view,
                                 y = MIN (sprite->y, sprite->oldy);
                                 width = (MAX (sprite->x, sprite->oldx) - x) + ply_image_get_width (sprite->image);
                                 height = (MAX (sprite->y, sprite->oldy) - y) + ply_image_get_height (sprite->image);
-                                ply_pixel_display_draw_area (view->display,
-                                                             x, y, width, height);
+                                view_draw_area (view, x, y, width, height);
                         } else {
-                                ply_pixel_display_draw_area (view->display,
-                                                             sprite->x, sprite->y, width, height);
-                                ply_pixel_display_draw_area (view->display,
-                                                             sprite->oldx, sprite->oldy, width, height);
+                                view_draw_area (view, sprite->x, sprite->y, width, height);
+                                view_draw_area (view, sprite->oldx, sprite->oldy, width, height);
                         }
                 }
         }
+
+        view_report_frame_statistics (view);
 }
 
 static void
@@ -1361,6 +1562,75 @@ draw_background (view_t             *view,
                  int                 y,
                  int                 width,
                  int                 height);
+static void
+draw_sprites_at_pixel (view_t             *view,
+                       ply_pixel_buffer_t *pixel_buffer,
+                       int                 x,
+                       int                 y)
+{
+        ply_list_node_t *node;
+        ply_rectangle_t pixel_area;
+        float pixel_r = 0;
+        float pixel_g = 0;
+        float pixel_b = 0;
+
+        for (node = ply_list_get_first_node (view->sprites); node; node = ply_list_get_next_node (view->sprites, node)) {
+                sprite_t *sprite = ply_list_node_get_data (node);
+                int sprite_width, sprite_height;
+
+                if (sprite->x > x) continue;
+                if (sprite->y > y) continue;
+
+                sprite_width = ply_image_get_width (sprite->image);
+                sprite_height = ply_image_get_height (sprite->image);
+
+                if (sprite->x + sprite_width <= x) continue;
+                if (sprite->y + sprite_height <= y) continue;
+
+                uint32_t *image_data = ply_image_get_data (sprite->image);
+                uint32_t overlay_pixel = image_data[(x - sprite->x) + (y - sprite->y) * sprite_width];
+                float alpha = (float) ((overlay_pixel >> 24) & 0xff) / 255 * sprite->opacity;
+                float red = (float) ((overlay_pixel >> 16) & 0xff) / 255 * sprite->opacity;
+                float green = (float) ((overlay_pixel >> 8) & 0xff) / 255 * sprite->opacity;
+                float blue = (float) ((overlay_pixel >> 0) & 0xff) / 255 * sprite->opacity;
+                pixel_r = pixel_r * (1 - alpha) + red;
+                pixel_g = pixel_g * (1 - alpha) + green;
+                pixel_b = pixel_b * (1 - alpha) + blue;
+        }
+
+        pixel_area.x = x;
+        pixel_area.y = y;
+        pixel_area.width = 1;
+        pixel_area.height = 1;
+        ply_pixel_buffer_fill_with_color (pixel_buffer, &pixel_area, pixel_r, pixel_g, pixel_b, 1.0);
+}
+
+static void
+draw_star_field (view_t             *view,
+                 ply_pixel_buffer_t *pixel_buffer)
+{
+        ply_boot_splash_plugin_t *plugin = view->plugin;
+        sprite_t *sprite = view->star_field_to_draw;
+        star_bg_t *star_bg = sprite->data;
+        int i;
+
+        for (i = 0; i < star_bg->star_count; i++) {
+                int x, y;
+
+                if (!star_bg->star_refresh[i])
+                        continue;
+
+                x = sprite->x + star_bg->star_x[i];
+                y = sprite->y + star_bg->star_y[i];
+
+                draw_sprites_at_pixel (view, pixel_buffer, x, y);
+                ply_label_draw_area (view->message_label, pixel_buffer, x, y, 1, 1);
+
+                if (!plugin->plugin_console_messages_updating && view->console_viewer != NULL)
+                        ply_console_viewer_draw_area (view->console_viewer, pixel_buffer, x, y, 1, 1);
+        }
+}
+
 static void
 on_draw (view_t             *view,
          ply_pixel_buffer_t *pixel_buffer,
@@ -1378,12 +1648,14 @@ on_draw (view_t             *view,
         clip_area.height = height;
 
         bool single_pixel = 0;
-        float pixel_r = 0;
-        float pixel_g = 0;
-        float pixel_b = 0;
 
         plugin = view->plugin;
 
+        if (view->star_field_to_draw != NULL) {
+                draw_star_field (view, pixel_buffer);
+                return;
+        }
+
         if (width == 1 && height == 1)
                 single_pixel = true;
 
@@ -1408,42 +1680,32 @@ on_draw (view_t             *view,
                 ply_list_node_t *node;
 
 
-                for (node = ply_list_get_first_node (view->sprites); node; node = ply_list_get_next_node (view->sprites, node)) {
-                        sprite_t *sprite = ply_list_node_get_data (node);
-                        ply_rectangle_t sprite_area;
+                if (single_pixel) {
+                        draw_sprites_at_pixel (view, pixel_buffer, x, y);
+                } else {
+                        for (node = ply_list_get_first_node (view->sprites); node; node = ply_list_get_next_node (view->sprites, node)) {
+                                sprite_t *sprite = ply_list_node_get_data (node);
+                                ply_rectangle_t sprite_area;
 
 
-                        sprite_area.x = sprite->x;
-                        sprite_area.y = sprite->y;
+                                sprite_area.x = sprite->x;
+                                sprite_area.y = sprite->y;
 
-                        if (sprite_area.x >= (x + width)) continue;
-                        if (sprite_area.y >= (y + height)) continue;
+                                if (sprite_area.x >= (x + width)) continue;
+                                if (sprite_area.y >= (y + height)) continue;
 
-                        sprite_area.width = ply_image_get_width (sprite->image);
-                        sprite_area.height = ply_image_get_height (sprite->image);
+                                sprite_area.width = ply_image_get_width (sprite->image);
+                                sprite_area.height = ply_image_get_height (sprite->image);
 
-                        if ((int) (sprite_area.x + sprite_area.width) <= x) continue;
-                        if ((int) (sprite_area.y + sprite_area.height) <= y) continue;
+                                if ((int) (sprite_area.x + sprite_area.width) <= x) continue;
+                                if ((int) (sprite_area.y + sprite_area.height) <= y) continue;
 
-                        if (single_pixel) {
-                                uint32_t *image_data = ply_image_get_data (sprite->image);
-                                uint32_t overlay_pixel = image_data[(x - sprite_area.x) + (y - sprite_area.y) * sprite_area.width];
-                                float alpha = (float) ((overlay_pixel >> 24) & 0xff) / 255 * sprite->opacity;
-                                float red = (float) ((overlay_pixel >> 16) & 0xff) / 255 * sprite->opacity;
-                                float green = (float) ((overlay_pixel >> 8) & 0xff) / 255 * sprite->opacity;
-                                float blue = (float) ((overlay_pixel >> 0) & 0xff) / 255 * sprite->opacity;
-                                pixel_r = pixel_r * (1 - alpha) + red;
-                                pixel_g = pixel_g * (1 - alpha) + green;
-                                pixel_b = pixel_b * (1 - alpha) + blue;
-                        } else {
                                 ply_pixel_buffer_fill_with_argb32_data_at_opacity_with_clip (pixel_buffer,
                                                                                              &sprite_area, &clip_area,
                                                                                              ply_image_get_data (sprite->image), sprite->opacity);
                         }
                 }
         }
-        if (single_pixel)
-                ply_pixel_buffer_fill_with_color (pixel_buffer, &clip_area, pixel_r, pixel_g, pixel_b, 1.0);
 
         if (!plugin->should_show_console_messages)
                 ply_label_draw_area (view->message_label,
@@ -1573,44 +1835,62 @@ view_setup_scene (view_t *view)
 
         {
                 star_bg_t *star_bg;
-                if (view->scaled_background_image)
+                int time_phase;
+                /* The gradient only depends on the screen size, so render it once per view */
+                if (view->gradient_data == NULL ||
+                    view->gradient_width != screen_width ||
+                    view->gradient_height != screen_height) {
                         ply_image_free (view->scaled_background_image);
-                view->scaled_background_image = ply_image_resize (plugin->logo_image, screen_width, screen_height);
+                        view->scaled_background_image = ply_image_resize (plugin->logo_image, screen_width, screen_height);
+                        star_bg_render_gradient (view->scaled_background_image);
+
+                        free (view->gradient_data);
+                        view->gradient_data = malloc (screen_width * screen_height * sizeof(uint32_t));
+                        memcpy (view->gradient_data, ply_image_get_data (view->scaled_background_image),
+                                screen_width * screen_height * sizeof(uint32_t));
+                        view->gradient_width = screen_width;
+                        view->gradient_height = screen_height;
+                }
                 star_bg = malloc (sizeof(star_bg_t));
                 star_bg->star_count = (screen_width * screen_height) / 400;
                 star_bg->star_x = malloc (sizeof(int) * star_bg->star_count);
                 star_bg->star_y = malloc (sizeof(int) * star_bg->star_count);
                 star_bg->star_refresh = malloc (sizeof(int) * star_bg->star_count);
+                star_bg->star_phase = malloc (sizeof(int) * star_bg->star_count);
+                star_bg->star_colour = malloc (sizeof(uint32_t) * star_bg->star_count);
                 star_bg->frame_count = 0;
+                star_bg_fill_glow_table (star_bg);
                 sprite = add_sprite (view, view->scaled_background_image, SPRITE_TYPE_STAR_BG, star_bg);
                 sprite->z = -10000;
 
                 uint32_t *image_data = ply_image_get_data (view->scaled_background_image);
-                for (y = 0; y < (int) screen_height; y++) {
-                        for (x = 0; x < (int) screen_width; x++) {
-                                image_data[x + y * screen_width] = star_bg_gradient_colour (x, y, screen_width, screen_height, false, 0);
-                        }
-                }
+                memcpy (image_data, view->gradient_data,
+                        screen_width * screen_height * sizeof(uint32_t));
 
                 for (i = 0; i < star_bg->star_count; i++) {
                         do {
-                                x = ply_get_random_number (0, screen_width);
-                                y = ply_get_random_number (0, screen_height);
+                                x = ply_random_get_number (plugin->random, 0, screen_width);
+                                y = ply_random_get_number (plugin->random, 0, screen_height);
                         } while (image_data[x + y * screen_width] == 0xFFFFFFFF);
                         star_bg->star_refresh[i] = 0;
                         star_bg->star_x[i] = x;
                         star_bg->star_y[i] = y;
+                        star_bg->star_phase[i] = star_bg_get_phase (x, y, screen_width, screen_height);
+                        star_bg->star_colour[i] = image_data[x + y * screen_width];
                         image_data[x + y * screen_width] = 0xFFFFFFFF;
                 }
                 for (i = 0; i < (int) (screen_width * screen_height) / 400; i++) {
-                        x = ply_get_random_number (0, screen_width);
-                        y = ply_get_random_number (0, screen_height);
-                        image_data[x + y * screen_width] = star_bg_gradient_colour (x, y, screen_width, screen_height, true, ((float) x * y * 13 / 10000));
+                        x = ply_random_get_number (plugin->random, 0, screen_width);
+                        y = ply_random_get_number (plugin->random, 0, screen_height);
+                        time_phase = star_bg_get_time_phase ((float) x * y * 13 / 10000);
+                        image_data[x + y * screen_width] = star_bg_star_colour (star_bg,
+                                                                                view->gradient_data[x + y * screen_width],
+                                                                                star_bg_get_phase (x, y, screen_width, screen_height) - time_phase);
                 }
 
                 for (i = 0; i < star_bg->star_count; i++) {
                         image_data[star_bg->star_x[i] + star_bg->star_y[i] * screen_width] =
-                                star_bg_gradient_colour (star_bg->star_x[i], star_bg->star_y[i], screen_width, screen_height, true, 0.0);
+                                star_bg_star_colour (star_bg, star_bg->star_colour[i], star_bg->star_phase[i]);
                 }
         }
 
@@ -1641,6 +1921,7 @@ view_setup_scene (view_t *view)
 
                 satellite->distance = i * 100 + 280;
                 satellite->theta = M_PI * 0.8;
+                satellite->cresent_is_current = false;
                 satellite->image = plugin->planet_image[i];
                 satellite->image_altered = ply_image_resize (satellite->image, ply_image_get_width (satellite->image), ply_image_get_height (satellite->image));
                 sprite = add_sprite (view, satellite->image_altered, SPRITE_TYPE_SATELLITE, satellite);
@@ -1655,6 +1936,7 @@ view_setup_scene (view_t *view)
                 satellite->end_y = satellite->start_y = 300 - 480 + screen_height;
                 satellite->distance = 550 + i * 50;
                 satellite->theta = M_PI * 0.8;
+                satellite->cresent_is_current = false;
 #define COMET_SIZE 64
                 satellite->image = ply_image_resize (plugin->progress_barimage, COMET_SIZE, COMET_SIZE);
                 satellite->image_altered = ply_image_resize (satellite->image, COMET_SIZE, COMET_SIZE);
@@ -1702,6 +1984,7 @@ view_setup_scene (view_t *view)
 
         flare->image_a = ply_image_resize (plugin->star_image, width, height);
         flare->image_b = ply_image_resize (plugin->star_image, width, height);
+        flare->random = plugin->random;
 
         sprite = add_sprite (view, flare->image_a, SPRITE_TYPE_FLARE, flare);
         sprite->x = screen_width - width;
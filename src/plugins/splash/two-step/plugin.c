@@ -1155,9 +1155,9 @@ create_plugin (ply_key_file_t *key_file)
 {
         ply_boot_splash_plugin_t *plugin;
         char *image_dir, *image_path;
-        char *transition;
-        char *progress_function;
-        char *show_animation_fraction;
+        const char *transition;
+        const char *progress_function;
+        const char *show_animation_fraction;
 
         plugin = calloc (1, sizeof(ply_boot_splash_plugin_t));
 
@@ -1263,7 +1263,7 @@ create_plugin (ply_key_file_t *key_file)
                                          "TitleVerticalAlignment", 0.5);
 
         plugin->transition = PLY_PROGRESS_ANIMATION_TRANSITION_NONE;
-        transition = ply_key_file_get_value (key_file, "two-step", "Transition");
+        transition = ply_key_file_peek_value (key_file, "two-step", "Transition");
         if (transition != NULL) {
                 if (strcmp (transition, "fade-over") == 0)
                         plugin->transition = PLY_PROGRESS_ANIMATION_TRANSITION_FADE_OVER;
@@ -1272,7 +1272,6 @@ create_plugin (ply_key_file_t *key_file)
                 else if (strcmp (transition, "merge-fade") == 0)
                         plugin->transition = PLY_PROGRESS_ANIMATION_TRANSITION_MERGE_FADE;
         }
-        free (transition);
 
         plugin->plugin_console_messages_updating = false;
         plugin->should_show_console_messages = false;
@@ -1341,7 +1340,7 @@ create_plugin (ply_key_file_t *key_file)
         plugin->message_below_animation =
                 ply_key_file_get_bool (key_file, "two-step", "MessageBelowAnimation");
 
-        progress_function = ply_key_file_get_value (key_file, "two-step", "ProgressFunction");
+        progress_function = ply_key_file_peek_value (key_file, "two-step", "ProgressFunction");
 
         if (progress_function != NULL) {
                 if (strcmp (progress_function, "wwoods") == 0) {
@@ -1354,16 +1353,13 @@ create_plugin (ply_key_file_t *key_file)
                         ply_trace ("unknown progress function %s, defaulting to linear", progress_function);
                         plugin->progress_function = PROGRESS_FUNCTION_TYPE_LINEAR;
                 }
-
-                free (progress_function);
         }
 
-        show_animation_fraction = ply_key_file_get_value (key_file, "two-step", "ShowAnimationPercent");
+        show_animation_fraction = ply_key_file_peek_value (key_file, "two-step", "ShowAnimationPercent");
         if (show_animation_fraction != NULL)
                 plugin->show_animation_fraction = strtod (show_animation_fraction, NULL);
         else
                 plugin->show_animation_fraction = SHOW_ANIMATION_FRACTION;
-        free (show_animation_fraction);
 
         plugin->views = ply_list_new ();
 
@@ -47,6 +47,9 @@
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEWROOT "R"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT "V"
 #define PLY_BOOT_PROTOCOL_REQUEST_TYPE_ERROR "!"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION "v"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_PAGE "p"
+#define PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS "s"
 
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK "\x6"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK "\x15"
@@ -54,4 +57,26 @@
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS "\t"
 #define PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER "\x5"
 
+/* Version 1 frames a request as a command byte, an optional "\002" marker
+ * and a one byte argument length, and replies are matched to requests in
+ * the order they were sent.
+ *
+ * A client may switch a connection to version 2 by sending a version 1
+ * PROTOCOL_VERSION request with the argument "2". Daemons that don't know
+ * about version 2 reply with NAK and the connection stays on version 1.
+ * After an ACK, every frame in both directions looks like:
+ *
+ *   request: command (1), flags (1), request id (4), argument size (4), argument
+ *   reply:   response type (1), request id (4), payload size (4), payload
+ *
+ * with integers in little endian order. Replies carry the id of the request
+ * they answer and may arrive out of order, so clients can pipeline as many
+ * requests as they like without waiting for acknowledgements.
+ */
+#define PLY_BOOT_PROTOCOL_VERSION_2 "2"
+#define PLY_BOOT_PROTOCOL_V2_REQUEST_HEADER_SIZE 10
+#define PLY_BOOT_PROTOCOL_V2_REPLY_HEADER_SIZE 9
+#define PLY_BOOT_PROTOCOL_V2_REQUEST_FLAG_HAS_ARGUMENT 0x1
+#define PLY_BOOT_PROTOCOL_V2_MAX_PAYLOAD_SIZE (1024 * 1024)
+
 #endif /* PLY_BOOT_PROTOCOL_H */
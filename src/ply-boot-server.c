@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -46,12 +47,33 @@ typedef struct
         uid_t              uid;
         pid_t              pid;
 
+        ply_buffer_t      *input_buffer;
+        int                protocol_version;
+        int                received_fd;
+
         int                reference_count;
 
-        uint32_t           credentials_read : 1;
         uint32_t           disconnected : 1;
 } ply_boot_connection_t;
 
+typedef struct
+{
+        ply_boot_connection_t *connection;
+        uint32_t               id;
+        char                   command;
+        char                  *argument;
+} ply_boot_request_t;
+
+typedef const char *(*ply_boot_request_handler_t) (ply_boot_connection_t *connection,
+                                                   ply_boot_request_t    *request);
+
+typedef struct
+{
+        const char                *command;
+        ply_boot_request_handler_t handler;
+        bool                       allow_unprivileged;
+} ply_boot_request_dispatch_t;
+
 struct _ply_boot_server
 {
         ply_event_loop_t                             *loop;
@@ -80,11 +102,18 @@ struct _ply_boot_server
         ply_boot_server_quit_handler_t                quit_handler;
         ply_boot_server_has_active_vt_handler_t       has_active_vt_handler;
         ply_boot_server_reload_handler_t              reload_handler;
+        ply_boot_server_progress_page_handler_t       progress_page_handler;
+        ply_boot_server_statistics_handler_t          statistics_handler;
         void                                         *user_data;
 
+        const ply_boot_request_dispatch_t            *request_dispatch[UINT8_MAX + 1];
+        unsigned long                                 number_of_requests[UINT8_MAX + 1];
+
         uint32_t                                      is_listening : 1;
 };
 
+static void ply_boot_server_fill_request_dispatch (ply_boot_server_t *server);
+
 ply_boot_server_t *
 ply_boot_server_new (ply_boot_server_update_handler_t              update_handler,
                      ply_boot_server_change_mode_handler_t         change_mode_handler,
@@ -107,6 +136,8 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
                      ply_boot_server_quit_handler_t                quit_handler,
                      ply_boot_server_has_active_vt_handler_t       has_active_vt_handler,
                      ply_boot_server_reload_handler_t              reload_handler,
+                     ply_boot_server_progress_page_handler_t       progress_page_handler,
+                     ply_boot_server_statistics_handler_t          statistics_handler,
                      void                                         *user_data)
 {
         ply_boot_server_t *server;
@@ -137,8 +168,12 @@ ply_boot_server_new (ply_boot_server_update_handler_t              update_handle
         server->quit_handler = quit_handler;
         server->has_active_vt_handler = has_active_vt_handler;
         server->reload_handler = reload_handler;
+        server->progress_page_handler = progress_page_handler;
+        server->statistics_handler = statistics_handler;
         server->user_data = user_data;
 
+        ply_boot_server_fill_request_dispatch (server);
+
         return server;
 }
 
@@ -170,6 +205,9 @@ ply_boot_connection_new (ply_boot_server_t *server,
         connection->fd = fd;
         connection->server = server;
         connection->watch = NULL;
+        connection->input_buffer = ply_buffer_new ();
+        connection->protocol_version = 1;
+        connection->received_fd = -1;
         connection->reference_count = 1;
 
         return connection;
@@ -182,6 +220,9 @@ ply_boot_connection_free (ply_boot_connection_t *connection)
                 return;
 
         close (connection->fd);
+        if (connection->received_fd >= 0)
+                close (connection->received_fd);
+        ply_buffer_free (connection->input_buffer);
         free (connection);
 }
 
@@ -226,157 +267,406 @@ ply_boot_server_stop_listening (ply_boot_server_t *server)
         assert (server != NULL);
 }
 
+static ply_boot_request_t *
+ply_boot_request_new (ply_boot_connection_t *connection,
+                      uint32_t               id,
+                      char                   command,
+                      char                  *argument)
+{
+        ply_boot_request_t *request;
+
+        request = calloc (1, sizeof(ply_boot_request_t));
+        request->connection = connection;
+        request->id = id;
+        request->command = command;
+        request->argument = argument;
+
+        return request;
+}
+
+static void
+ply_boot_request_free (ply_boot_request_t *request)
+{
+        if (request == NULL)
+                return;
+
+        free (request->argument);
+        free (request);
+}
+
+static uint32_t
+read_uint32_from_bytes (const uint8_t *bytes)
+{
+        return (bytes[0] << 0) |
+               (bytes[1] << 8) |
+               (bytes[2] << 16) |
+               ((uint32_t) bytes[3] << 24);
+}
+
+static void
+write_uint32_to_bytes (uint8_t *bytes,
+                       uint32_t value)
+{
+        bytes[0] = (value >> 0) & 0xFF;
+        bytes[1] = (value >> 8) & 0xFF;
+        bytes[2] = (value >> 16) & 0xFF;
+        bytes[3] = (value >> 24) & 0xFF;
+}
+
 static bool
-ply_boot_connection_read_request (ply_boot_connection_t *connection,
-                                  char                 **command,
-                                  char                 **argument)
+ply_boot_connection_is_from_root (ply_boot_connection_t *connection)
+{
+        return connection->uid == 0;
+}
+
+static void
+close_received_fds (struct cmsghdr *control_message)
+{
+        size_t number_of_fds, i;
+        int fd;
+
+        number_of_fds = (control_message->cmsg_len - CMSG_LEN (0)) / sizeof(int);
+
+        for (i = 0; i < number_of_fds; i++) {
+                memcpy (&fd, CMSG_DATA (control_message) + i * sizeof(int), sizeof(int));
+                close (fd);
+        }
+}
+
+/* Like recv(), but also picks up a file descriptor passed along with
+ * the bytes.  Only one can be outstanding per connection; it stays there
+ * until a request claims it.  Only root may pass one; anything else that
+ * comes along (extra descriptors, or descriptors from other users) is
+ * closed straight away.
+ */
+static ssize_t
+ply_boot_connection_receive (ply_boot_connection_t *connection,
+                             void                  *bytes,
+                             size_t                 size,
+                             int                    flags)
+{
+        /* The socket has SO_PASSCRED set, so credentials come along
+         * with every message and need room too
+         */
+        union
+        {
+                struct cmsghdr header;
+                char           buffer[CMSG_SPACE (sizeof(struct ucred)) +
+                                      CMSG_SPACE (sizeof(int))];
+        } control;
+        struct iovec vector = { .iov_base = bytes, .iov_len = size };
+        struct msghdr message = { 0 };
+        struct cmsghdr *control_message;
+        ssize_t bytes_read;
+
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+
+        do {
+                bytes_read = recvmsg (connection->fd, &message, flags | MSG_CMSG_CLOEXEC);
+        } while (bytes_read < 0 && errno == EINTR);
+
+        if (bytes_read < 0)
+                return bytes_read;
+
+        for (control_message = CMSG_FIRSTHDR (&message);
+             control_message != NULL;
+             control_message = CMSG_NXTHDR (&message, control_message)) {
+                int fd;
+
+                if (control_message->cmsg_level != SOL_SOCKET ||
+                    control_message->cmsg_type != SCM_RIGHTS)
+                        continue;
+
+                if ((message.msg_flags & MSG_CTRUNC) ||
+                    control_message->cmsg_len != CMSG_LEN (sizeof(int)) ||
+                    !ply_boot_connection_is_from_root (connection)) {
+                        close_received_fds (control_message);
+                        continue;
+                }
+
+                memcpy (&fd, CMSG_DATA (control_message), sizeof(int));
+
+                if (connection->received_fd >= 0)
+                        close (connection->received_fd);
+                connection->received_fd = fd;
+        }
+
+        /* The kernel closes whatever didn't fit, but the request it came
+         * with can't be trusted to be complete any more */
+        if (message.msg_flags & MSG_CTRUNC) {
+                ply_trace ("ancillary data from client was truncated");
+                errno = EMSGSIZE;
+                return -1;
+        }
+
+        return bytes_read;
+}
+
+static ply_boot_request_t *
+ply_boot_connection_read_request (ply_boot_connection_t *connection)
 {
         uint8_t header[2];
+        char *argument;
 
         assert (connection != NULL);
         assert (connection->fd >= 0);
 
-        connection->credentials_read = false;
-
-        if (!ply_read (connection->fd, header, sizeof(header)))
-                return false;
+        if (ply_boot_connection_receive (connection, header, sizeof(header),
+                                         MSG_WAITALL) != sizeof(header))
+                return NULL;
 
-        *command = calloc (2, sizeof(char));
-        *command[0] = header[0];
-
-        *argument = NULL;
+        argument = NULL;
         if (header[1] == '\002') {
                 uint8_t argument_size;
 
-                if (!ply_read (connection->fd, &argument_size, sizeof(uint8_t))) {
-                        free (*command);
-                        return false;
+                if (!ply_read (connection->fd, &argument_size, sizeof(uint8_t)))
+                        return NULL;
+
+                argument = calloc (argument_size, sizeof(char));
+
+                if (!ply_read (connection->fd, argument, argument_size)) {
+                        free (argument);
+                        return NULL;
                 }
+        }
 
-                *argument = calloc (argument_size, sizeof(char));
+        return ply_boot_request_new (connection, 0, header[0], argument);
+}
 
-                if (!ply_read (connection->fd, *argument, argument_size)) {
-                        free (*argument);
-                        free (*command);
-                        return false;
+static bool
+ply_boot_connection_read_available_bytes (ply_boot_connection_t *connection)
+{
+        char bytes[4096];
+        ssize_t bytes_read;
+        bool read_some_bytes = false;
+
+        do {
+                bytes_read = ply_boot_connection_receive (connection, bytes,
+                                                          sizeof(bytes), MSG_DONTWAIT);
+
+                if (bytes_read > 0) {
+                        ply_buffer_append_bytes (connection->input_buffer, bytes, bytes_read);
+                        read_some_bytes = true;
                 }
+        } while (bytes_read == sizeof(bytes));
+
+        return read_some_bytes;
+}
+
+/* Pulls the next complete version 2 request out of the connection's input
+ * buffer, starting at *offset. Returns NULL if only part of a request has
+ * arrived so far.
+ */
+static ply_boot_request_t *
+ply_boot_connection_parse_request (ply_boot_connection_t *connection,
+                                   size_t                *offset,
+                                   bool                  *is_malformed)
+{
+        const uint8_t *bytes;
+        size_t size;
+        uint8_t flags;
+        uint32_t id, argument_size;
+        char *argument = NULL;
+        char command;
+
+        *is_malformed = false;
+
+        bytes = (const uint8_t *) ply_buffer_get_bytes (connection->input_buffer) + *offset;
+        size = ply_buffer_get_size (connection->input_buffer) - *offset;
+
+        if (size < PLY_BOOT_PROTOCOL_V2_REQUEST_HEADER_SIZE)
+                return NULL;
+
+        command = bytes[0];
+        flags = bytes[1];
+        id = read_uint32_from_bytes (bytes + 2);
+        argument_size = read_uint32_from_bytes (bytes + 6);
+
+        if (argument_size > PLY_BOOT_PROTOCOL_V2_MAX_PAYLOAD_SIZE) {
+                ply_error ("request from client has oversized argument (%u bytes)", argument_size);
+                *is_malformed = true;
+                return NULL;
         }
 
-        if (!ply_get_credentials_from_fd (connection->fd, &connection->pid, &connection->uid, NULL)) {
-                ply_trace ("couldn't read credentials from connection: %m");
-                free (*argument);
-                free (*command);
-                return false;
+        if (size < PLY_BOOT_PROTOCOL_V2_REQUEST_HEADER_SIZE + argument_size)
+                return NULL;
+
+        if (flags & PLY_BOOT_PROTOCOL_V2_REQUEST_FLAG_HAS_ARGUMENT) {
+                argument = calloc (argument_size + 1, sizeof(char));
+                memcpy (argument, bytes + PLY_BOOT_PROTOCOL_V2_REQUEST_HEADER_SIZE, argument_size);
         }
-        connection->credentials_read = true;
 
-        return true;
+        *offset += PLY_BOOT_PROTOCOL_V2_REQUEST_HEADER_SIZE + argument_size;
+
+        return ply_boot_request_new (connection, id, command, argument);
 }
 
 static bool
-ply_boot_connection_is_from_root (ply_boot_connection_t *connection)
+ply_boot_connection_send_reply (ply_boot_connection_t *connection,
+                                uint32_t               request_id,
+                                const char            *response_type,
+                                const void            *payload,
+                                size_t                 payload_size)
 {
-        if (!connection->credentials_read) {
-                ply_trace ("Asked if connection is from root, but haven't checked credentials yet");
-                return false;
+        ply_buffer_t *buffer;
+        uint8_t header[PLY_BOOT_PROTOCOL_V2_REPLY_HEADER_SIZE];
+        bool is_written;
+
+        buffer = ply_buffer_new ();
+
+        if (connection->protocol_version >= 2) {
+                header[0] = response_type[0];
+                write_uint32_to_bytes (header + 1, request_id);
+                write_uint32_to_bytes (header + 5, payload_size);
+                ply_buffer_append_bytes (buffer, header, sizeof(header));
+        } else {
+                ply_buffer_append_bytes (buffer, response_type, strlen (response_type));
+
+                if (payload != NULL) {
+                        write_uint32_to_bytes (header, payload_size);
+                        ply_buffer_append_bytes (buffer, header, sizeof(uint32_t));
+                }
         }
 
-        return connection->uid == 0;
+        if (payload_size > 0)
+                ply_buffer_append_bytes (buffer, payload, payload_size);
+
+        is_written = ply_write (connection->fd,
+                                ply_buffer_get_bytes (buffer),
+                                ply_buffer_get_size (buffer));
+        ply_buffer_free (buffer);
+
+        return is_written;
 }
 
 static void
 ply_boot_connection_send_answer (ply_boot_connection_t *connection,
+                                 uint32_t               request_id,
                                  const char            *answer)
 {
-        uint32_t size;
-
         /* splash plugin isn't able to ask for password,
          * punt to client
          */
         if (answer == NULL) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER)))
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing no answer reply: %m");
         } else {
-                size = strlen (answer);
-
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER)) ||
-                    !ply_write_uint32 (connection->fd,
-                                       size) ||
-                    !ply_write (connection->fd,
-                                answer, size))
+                if (!ply_boot_connection_send_reply (connection, request_id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ANSWER,
+                                                     answer, strlen (answer)))
                         ply_trace ("could not finish writing answer: %m");
         }
 }
 
+/* Returns a trigger that sends the reply to the request later. It holds
+ * its own copy of the request, since the trigger may fire before the
+ * request handler returns.
+ */
+static ply_trigger_t *
+ply_boot_request_defer (ply_boot_request_t    *request,
+                        ply_trigger_handler_t  handler)
+{
+        ply_boot_request_t *deferred_request;
+        ply_trigger_t *trigger;
+
+        deferred_request = ply_boot_request_new (request->connection,
+                                                 request->id,
+                                                 request->command,
+                                                 NULL);
+
+        trigger = ply_trigger_new (NULL);
+        ply_trigger_add_handler (trigger, handler, deferred_request);
+
+        ply_boot_connection_take_reference (request->connection);
+
+        return trigger;
+}
+
+static void
+ply_boot_request_finish (ply_boot_request_t *request)
+{
+        ply_boot_connection_t *connection = request->connection;
+
+        ply_boot_request_free (request);
+        ply_boot_connection_drop_reference (connection);
+}
+
 static void
-ply_boot_connection_on_password_answer (ply_boot_connection_t *connection,
-                                        const char            *password)
+ply_boot_request_on_password_answer (ply_boot_request_t *request,
+                                     const char         *password)
 {
+        ply_boot_connection_t *connection = request->connection;
+
         ply_trace ("got password answer");
 
         if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, password);
+                ply_boot_connection_send_answer (connection, request->id, password);
 
         if (password != NULL)
                 ply_list_append_data (connection->server->cached_passwords,
                                       strdup (password));
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_request_finish (request);
 }
 
 static void
-ply_boot_connection_on_deactivated (ply_boot_connection_t *connection)
+ply_boot_request_on_deactivated (ply_boot_request_t *request)
 {
+        ply_boot_connection_t *connection = request->connection;
+
         ply_trace ("deactivated");
 
         if (!connection->disconnected) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+                if (!ply_boot_connection_send_reply (connection, request->id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing deactivate reply: %m");
         }
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_request_finish (request);
 }
 
 static void
-ply_boot_connection_on_quit_complete (ply_boot_connection_t *connection)
+ply_boot_request_on_quit_complete (ply_boot_request_t *request)
 {
+        ply_boot_connection_t *connection = request->connection;
+
         ply_trace ("quit complete");
         if (!connection->disconnected) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
+                if (!ply_boot_connection_send_reply (connection, request->id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                                     NULL, 0))
                         ply_trace ("could not finish writing quit reply: %m");
         }
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_request_finish (request);
 }
 
 static void
-ply_boot_connection_on_question_answer (ply_boot_connection_t *connection,
-                                        const char            *answer)
+ply_boot_request_on_question_answer (ply_boot_request_t *request,
+                                     const char         *answer)
 {
         ply_trace ("got question answer: %s", answer);
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, answer);
+        if (!request->connection->disconnected)
+                ply_boot_connection_send_answer (request->connection, request->id, answer);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_request_finish (request);
 }
 
 static void
-ply_boot_connection_on_keystroke_answer (ply_boot_connection_t *connection,
-                                         const char            *key)
+ply_boot_request_on_keystroke_answer (ply_boot_request_t *request,
+                                      const char         *key)
 {
         ply_trace ("got key: %s", key);
-        if (!connection->disconnected)
-                ply_boot_connection_send_answer (connection, key);
+        if (!request->connection->disconnected)
+                ply_boot_connection_send_answer (request->connection, request->id, key);
 
-        ply_boot_connection_drop_reference (connection);
+        ply_boot_request_finish (request);
 }
 
 static void
@@ -402,354 +692,647 @@ print_connection_process_identity (ply_boot_connection_t *connection)
         free (command_line);
 }
 
-static void
-ply_boot_connection_on_request (ply_boot_connection_t *connection)
+static const char *
+handle_ping (ply_boot_connection_t *connection,
+             ply_boot_request_t    *request)
 {
-        ply_boot_server_t *server;
-        char *command, *argument;
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
 
-        assert (connection != NULL);
-        assert (connection->fd >= 0);
+static const char *
+handle_update (ply_boot_connection_t *connection,
+               ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
 
-        server = connection->server;
-        assert (server != NULL);
+        if (!ply_boot_connection_send_reply (connection, request->id,
+                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                             NULL, 0) &&
+            errno != EPIPE)
+                ply_trace ("could not finish writing update reply: %m");
 
-        if (!ply_boot_connection_read_request (connection,
-                                               &command, &argument)) {
-                ply_trace ("could not read connection request");
-                return;
-        }
+        ply_trace ("got update request");
+        if (server->update_handler != NULL)
+                server->update_handler (server->user_data, request->argument, server);
 
-        if (ply_is_tracing ())
-                print_connection_process_identity (connection);
+        return NULL;
+}
 
-        if (!ply_boot_connection_is_from_root (connection)) {
-                ply_error ("request came from non-root user");
+static const char *
+handle_change_mode (ply_boot_connection_t *connection,
+                    ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                        ply_trace ("could not finish writing is-not-root nak: %m");
+        if (!ply_boot_connection_send_reply (connection, request->id,
+                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                             NULL, 0))
+                ply_trace ("could not finish writing update reply: %m");
 
-                free (argument);
-                free (command);
-                return;
+        ply_trace ("got change mode notification");
+        if (server->change_mode_handler != NULL)
+                server->change_mode_handler (server->user_data, request->argument, server);
+
+        return NULL;
+}
+
+static const char *
+handle_system_update (ply_boot_connection_t *connection,
+                      ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        long int value = 0;
+        char *endptr = NULL;
+
+        if (request->argument != NULL)
+                value = strtol (request->argument, &endptr, 10);
+        if (endptr == NULL || *endptr != '\0' || value < 0 || value > 100) {
+                ply_error ("failed to parse percentage %s", request->argument);
+                value = 0;
         }
 
-        if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)) &&
-                    errno != EPIPE)
-                        ply_trace ("could not finish writing update reply: %m");
-
-                ply_trace ("got update request");
-                if (server->update_handler != NULL)
-                        server->update_handler (server->user_data, argument, server);
-                free (argument);
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_CHANGE_MODE) == 0) {
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing update reply: %m");
-
-                ply_trace ("got change mode notification");
-                if (server->change_mode_handler != NULL)
-                        server->change_mode_handler (server->user_data, argument, server);
-                free (argument);
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE) == 0) {
-                long int value;
-                char *endptr = NULL;
-
-                value = strtol (argument, &endptr, 10);
-                if (endptr == NULL || *endptr != '\0' || value < 0 || value > 100) {
-                        ply_error ("failed to parse percentage %s", argument);
-                        value = 0;
-                }
+        ply_trace ("got system-update notification %li%%", value);
+        if (!ply_boot_connection_send_reply (connection, request->id,
+                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                             NULL, 0))
+                ply_trace ("could not finish writing update reply: %m");
 
-                ply_trace ("got system-update notification %li%%", value);
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                        ply_trace ("could not finish writing update reply: %m");
+        if (server->system_update_handler != NULL)
+                server->system_update_handler (server->user_data, value, server);
 
-                if (server->system_update_handler != NULL)
-                        server->system_update_handler (server->user_data, value, server);
-                free (argument);
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_INITIALIZED) == 0) {
-                ply_trace ("got system initialized notification");
-                if (server->system_initialized_handler != NULL)
-                        server->system_initialized_handler (server->user_data, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_ERROR) == 0) {
-                ply_trace ("got error notification");
-                if (server->error_handler != NULL)
-                        server->error_handler (server->user_data, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_SHOW_SPLASH) == 0) {
-                ply_trace ("got show splash request");
-                if (server->show_splash_handler != NULL)
-                        server->show_splash_handler (server->user_data, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_HIDE_SPLASH) == 0) {
-                ply_trace ("got hide splash request");
-                if (server->hide_splash_handler != NULL)
-                        server->hide_splash_handler (server->user_data, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_DEACTIVATE) == 0) {
-                ply_trigger_t *deactivate_trigger;
-
-                ply_trace ("got deactivate request");
-
-                deactivate_trigger = ply_trigger_new (NULL);
-
-                ply_trigger_add_handler (deactivate_trigger,
-                                         (ply_trigger_handler_t)
-                                         ply_boot_connection_on_deactivated,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+        return NULL;
+}
 
-                if (server->deactivate_handler != NULL)
-                        server->deactivate_handler (server->user_data, deactivate_trigger, server);
-                else
-                        ply_trigger_free (deactivate_trigger);
+static const char *
+handle_system_initialized (ply_boot_connection_t *connection,
+                           ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
 
-                free (argument);
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_REACTIVATE) == 0) {
-                ply_trace ("got reactivate request");
-                if (server->reactivate_handler != NULL)
-                        server->reactivate_handler (server->user_data, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_QUIT) == 0) {
-                bool retain_splash;
-                ply_trigger_t *quit_trigger;
+        ply_trace ("got system initialized notification");
+        if (server->system_initialized_handler != NULL)
+                server->system_initialized_handler (server->user_data, server);
 
-                retain_splash = (bool) argument[0];
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
 
-                ply_trace ("got quit %srequest", retain_splash ? "--retain-splash " : "");
+static const char *
+handle_error (ply_boot_connection_t *connection,
+              ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
 
-                quit_trigger = ply_trigger_new (NULL);
+        ply_trace ("got error notification");
+        if (server->error_handler != NULL)
+                server->error_handler (server->user_data, server);
 
-                ply_trigger_add_handler (quit_trigger,
-                                         (ply_trigger_handler_t)
-                                         ply_boot_connection_on_quit_complete,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_show_splash (ply_boot_connection_t *connection,
+                    ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
 
-                if (server->quit_handler != NULL)
-                        server->quit_handler (server->user_data, retain_splash, quit_trigger, server);
-                else
-                        ply_trigger_free (quit_trigger);
+        ply_trace ("got show splash request");
+        if (server->show_splash_handler != NULL)
+                server->show_splash_handler (server->user_data, server);
 
-                free (argument);
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_RELOAD) == 0) {
-                ply_trace ("got reload request");
-                if (server->reload_handler != NULL)
-                        server->reload_handler (server->user_data, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PASSWORD) == 0) {
-                ply_trigger_t *answer;
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_hide_splash (ply_boot_connection_t *connection,
+                    ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got hide splash request");
+        if (server->hide_splash_handler != NULL)
+                server->hide_splash_handler (server->user_data, server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_deactivate (ply_boot_connection_t *connection,
+                   ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_trigger_t *deactivate_trigger;
+
+        ply_trace ("got deactivate request");
+
+        if (server->deactivate_handler == NULL)
+                return NULL;
+
+        deactivate_trigger = ply_boot_request_defer (request,
+                                                     (ply_trigger_handler_t)
+                                                     ply_boot_request_on_deactivated);
+        server->deactivate_handler (server->user_data, deactivate_trigger, server);
+
+        return NULL;
+}
+
+static const char *
+handle_reactivate (ply_boot_connection_t *connection,
+                   ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got reactivate request");
+        if (server->reactivate_handler != NULL)
+                server->reactivate_handler (server->user_data, server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_quit (ply_boot_connection_t *connection,
+             ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        bool retain_splash;
+        ply_trigger_t *quit_trigger;
+
+        retain_splash = request->argument != NULL && (bool) request->argument[0];
+
+        ply_trace ("got quit %srequest", retain_splash ? "--retain-splash " : "");
+
+        if (server->quit_handler == NULL)
+                return NULL;
+
+        quit_trigger = ply_boot_request_defer (request,
+                                               (ply_trigger_handler_t)
+                                               ply_boot_request_on_quit_complete);
+        server->quit_handler (server->user_data, retain_splash, quit_trigger, server);
+
+        return NULL;
+}
+
+static const char *
+handle_reload (ply_boot_connection_t *connection,
+               ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
 
-                ply_trace ("got password request");
+        ply_trace ("got reload request");
+        if (server->reload_handler != NULL)
+                server->reload_handler (server->user_data, server);
 
-                answer = ply_trigger_new (NULL);
-                ply_trigger_add_handler (answer,
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_password (ply_boot_connection_t *connection,
+                 ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_trigger_t *answer;
+
+        ply_trace ("got password request");
+
+        if (server->ask_for_password_handler == NULL)
+                return NULL;
+
+        answer = ply_boot_request_defer (request,
                                          (ply_trigger_handler_t)
-                                         ply_boot_connection_on_password_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
-
-                if (server->ask_for_password_handler != NULL) {
-                        server->ask_for_password_handler (server->user_data,
-                                                          argument,
-                                                          answer,
-                                                          server);
-                } else {
-                        ply_trigger_free (answer);
-                        free (argument);
-                }
-                /* will reply later
-                 */
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_CACHED_PASSWORD) == 0) {
-                ply_list_node_t *node;
-                ply_buffer_t *buffer;
-                size_t buffer_size;
-                uint32_t size;
+                                         ply_boot_request_on_password_answer);
 
-                ply_trace ("got cached password request");
+        /* the handler takes ownership of the prompt and will reply later
+         */
+        server->ask_for_password_handler (server->user_data,
+                                          request->argument,
+                                          answer,
+                                          server);
+        request->argument = NULL;
 
-                buffer = ply_buffer_new ();
+        return NULL;
+}
 
-                node = ply_list_get_first_node (server->cached_passwords);
+static const char *
+handle_cached_password (ply_boot_connection_t *connection,
+                        ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_list_node_t *node;
+        ply_buffer_t *buffer;
+        size_t buffer_size;
 
-                ply_trace ("There are %d cached passwords",
-                           ply_list_get_length (server->cached_passwords));
+        ply_trace ("got cached password request");
 
-                /* Add each answer separated by their NUL terminators into
-                 * a buffer that we write out to the client
-                 */
-                while (node != NULL) {
-                        ply_list_node_t *next_node;
-                        const char *password;
+        buffer = ply_buffer_new ();
 
-                        next_node = ply_list_get_next_node (server->cached_passwords, node);
-                        password = (const char *) ply_list_node_get_data (node);
+        node = ply_list_get_first_node (server->cached_passwords);
 
-                        ply_buffer_append_bytes (buffer,
-                                                 password,
-                                                 strlen (password) + 1);
-                        node = next_node;
-                }
+        ply_trace ("There are %d cached passwords",
+                   ply_list_get_length (server->cached_passwords));
 
-                buffer_size = ply_buffer_get_size (buffer);
-
-                /* splash plugin doesn't have any cached passwords
-                 */
-                if (buffer_size == 0) {
-                        ply_trace ("Responding with 'no answer' reply since there are currently "
-                                   "no cached answers");
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER)))
-                                ply_trace ("could not finish writing no answer reply: %m");
-                } else {
-                        size = buffer_size;
-
-                        ply_trace ("writing %d cached answers",
-                                   ply_list_get_length (server->cached_passwords));
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS)) ||
-                            !ply_write_uint32 (connection->fd,
-                                               size) ||
-                            !ply_write (connection->fd,
-                                        ply_buffer_get_bytes (buffer), size))
-                                ply_trace ("could not finish writing cached answer reply: %m");
-                }
+        /* Add each answer separated by their NUL terminators into
+         * a buffer that we write out to the client
+         */
+        while (node != NULL) {
+                ply_list_node_t *next_node;
+                const char *password;
 
-                ply_buffer_free (buffer);
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_QUESTION) == 0) {
-                ply_trigger_t *answer;
+                next_node = ply_list_get_next_node (server->cached_passwords, node);
+                password = (const char *) ply_list_node_get_data (node);
+
+                ply_buffer_append_bytes (buffer,
+                                         password,
+                                         strlen (password) + 1);
+                node = next_node;
+        }
 
-                ply_trace ("got question request");
+        buffer_size = ply_buffer_get_size (buffer);
 
-                answer = ply_trigger_new (NULL);
-                ply_trigger_add_handler (answer,
+        /* splash plugin doesn't have any cached passwords
+         */
+        if (buffer_size == 0) {
+                ply_trace ("Responding with 'no answer' reply since there are currently "
+                           "no cached answers");
+                if (!ply_boot_connection_send_reply (connection, request->id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NO_ANSWER,
+                                                     NULL, 0))
+                        ply_trace ("could not finish writing no answer reply: %m");
+        } else {
+                ply_trace ("writing %d cached answers",
+                           ply_list_get_length (server->cached_passwords));
+                if (!ply_boot_connection_send_reply (connection, request->id,
+                                                     PLY_BOOT_PROTOCOL_RESPONSE_TYPE_MULTIPLE_ANSWERS,
+                                                     ply_buffer_get_bytes (buffer), buffer_size))
+                        ply_trace ("could not finish writing cached answer reply: %m");
+        }
+
+        ply_buffer_free (buffer);
+        return NULL;
+}
+
+static const char *
+handle_question (ply_boot_connection_t *connection,
+                 ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_trigger_t *answer;
+
+        ply_trace ("got question request");
+
+        if (server->ask_question_handler == NULL)
+                return NULL;
+
+        answer = ply_boot_request_defer (request,
                                          (ply_trigger_handler_t)
-                                         ply_boot_connection_on_question_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
-
-                if (server->ask_question_handler != NULL) {
-                        server->ask_question_handler (server->user_data,
-                                                      argument,
-                                                      answer,
-                                                      server);
-                } else {
-                        ply_trigger_free (answer);
-                        free (argument);
-                }
-                /* will reply later
-                 */
-                free (command);
-                return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_SHOW_MESSAGE) == 0) {
-                ply_trace ("got show message request");
-                if (server->display_message_handler != NULL)
-                        server->display_message_handler (server->user_data, argument, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_HIDE_MESSAGE) == 0) {
-                ply_trace ("got hide message request");
-                if (server->hide_message_handler != NULL)
-                        server->hide_message_handler (server->user_data, argument, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_KEYSTROKE) == 0) {
-                ply_trigger_t *answer;
-
-                ply_trace ("got keystroke request");
-
-                answer = ply_trigger_new (NULL);
-                ply_trigger_add_handler (answer,
+                                         ply_boot_request_on_question_answer);
+
+        /* the handler takes ownership of the prompt and will reply later
+         */
+        server->ask_question_handler (server->user_data,
+                                      request->argument,
+                                      answer,
+                                      server);
+        request->argument = NULL;
+
+        return NULL;
+}
+
+static const char *
+handle_show_message (ply_boot_connection_t *connection,
+                     ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got show message request");
+        if (server->display_message_handler != NULL)
+                server->display_message_handler (server->user_data, request->argument, server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_hide_message (ply_boot_connection_t *connection,
+                     ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got hide message request");
+        if (server->hide_message_handler != NULL)
+                server->hide_message_handler (server->user_data, request->argument, server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_keystroke (ply_boot_connection_t *connection,
+                  ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_trigger_t *answer;
+
+        ply_trace ("got keystroke request");
+
+        if (server->watch_for_keystroke_handler == NULL)
+                return NULL;
+
+        answer = ply_boot_request_defer (request,
                                          (ply_trigger_handler_t)
-                                         ply_boot_connection_on_keystroke_answer,
-                                         connection);
-                ply_boot_connection_take_reference (connection);
-
-                if (server->watch_for_keystroke_handler != NULL) {
-                        server->watch_for_keystroke_handler (server->user_data,
-                                                             argument,
-                                                             answer,
-                                                             server);
-                } else {
-                        ply_trigger_free (answer);
-                        free (argument);
-                }
-                /* will reply later
-                 */
-                free (command);
+                                         ply_boot_request_on_keystroke_answer);
+
+        /* the handler takes ownership of the keys and will reply later
+         */
+        server->watch_for_keystroke_handler (server->user_data,
+                                             request->argument,
+                                             answer,
+                                             server);
+        request->argument = NULL;
+
+        return NULL;
+}
+
+static const char *
+handle_keystroke_remove (ply_boot_connection_t *connection,
+                         ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got keystroke remove request");
+        if (server->ignore_keystroke_handler != NULL)
+                server->ignore_keystroke_handler (server->user_data,
+                                                  request->argument,
+                                                  server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_progress_pause (ply_boot_connection_t *connection,
+                       ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got progress pause request");
+        if (server->progress_pause_handler != NULL)
+                server->progress_pause_handler (server->user_data,
+                                                server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_progress_unpause (ply_boot_connection_t *connection,
+                         ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got progress unpause request");
+        if (server->progress_unpause_handler != NULL)
+                server->progress_unpause_handler (server->user_data,
+                                                  server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_newroot (ply_boot_connection_t *connection,
+                ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+
+        ply_trace ("got newroot request");
+        if (server->newroot_handler != NULL)
+                server->newroot_handler (server->user_data, request->argument, server);
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_has_active_vt (ply_boot_connection_t *connection,
+                      ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        bool answer = false;
+
+        ply_trace ("got has_active vt? request");
+        if (server->has_active_vt_handler != NULL)
+                answer = server->has_active_vt_handler (server->user_data, server);
+
+        if (!answer)
+                return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_protocol_version (ply_boot_connection_t *connection,
+                         ply_boot_request_t    *request)
+{
+        if (connection->protocol_version != 1 ||
+            request->argument == NULL ||
+            strcmp (request->argument, PLY_BOOT_PROTOCOL_VERSION_2) != 0)
+                return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+
+        ply_trace ("switching connection to protocol version 2");
+
+        /* The acknowledgement still goes out in the old framing
+         */
+        if (!ply_boot_connection_send_reply (connection, request->id,
+                                             PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
+                                             NULL, 0)) {
+                ply_trace ("could not finish writing protocol version reply: %m");
+                return NULL;
+        }
+
+        connection->protocol_version = 2;
+        return NULL;
+}
+
+static const char *
+handle_progress_page (ply_boot_connection_t *connection,
+                      ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        int page_fd;
+
+        ply_trace ("got progress page request");
+
+        page_fd = connection->received_fd;
+        connection->received_fd = -1;
+
+        if (page_fd < 0) {
+                ply_trace ("progress page request came without a page");
+                return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+        }
+
+        if (server->progress_page_handler == NULL ||
+            !server->progress_page_handler (server->user_data, page_fd, server)) {
+                close (page_fd);
+                return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+        }
+
+        return PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK;
+}
+
+static const char *
+handle_statistics (ply_boot_connection_t *connection,
+                   ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        ply_buffer_t *statistics;
+        int i;
+
+        ply_trace ("got statistics request");
+
+        statistics = ply_buffer_new ();
+
+        if (server->statistics_handler != NULL)
+                server->statistics_handler (server->user_data, statistics, server);
+
+        ply_buffer_append (statistics, "connections: %d\n",
+                           ply_list_get_length (server->connections));
+
+        for (i = 0; i <= UINT8_MAX; i++) {
+                if (server->number_of_requests[i] == 0)
+                        continue;
+
+                ply_buffer_append (statistics, "requests '%c': %lu\n",
+                                   i, server->number_of_requests[i]);
+        }
+
+        ply_boot_connection_send_answer (connection, request->id,
+                                         ply_buffer_get_bytes (statistics));
+        ply_buffer_free (statistics);
+
+        return NULL;
+}
+
+/* Requests that don't change anything can come from any user, everything
+ * else is reserved for root
+ */
+static const ply_boot_request_dispatch_t request_dispatch_table[] = {
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING,               handle_ping,               true  },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_UPDATE,             handle_update,             false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_CHANGE_MODE,        handle_change_mode,        false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_UPDATE,      handle_system_update,      false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_SYSTEM_INITIALIZED, handle_system_initialized, false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_ERROR,              handle_error,              false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_SHOW_SPLASH,        handle_show_splash,        false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_HIDE_SPLASH,        handle_hide_splash,        false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_DEACTIVATE,         handle_deactivate,         false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_REACTIVATE,         handle_reactivate,         false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_QUIT,               handle_quit,               false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_RELOAD,             handle_reload,             false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_PASSWORD,           handle_password,           false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_CACHED_PASSWORD,    handle_cached_password,    false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_QUESTION,           handle_question,           false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_SHOW_MESSAGE,       handle_show_message,       false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_HIDE_MESSAGE,       handle_hide_message,       false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_KEYSTROKE,          handle_keystroke,          false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_KEYSTROKE_REMOVE,   handle_keystroke_remove,   false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_PAUSE,     handle_progress_pause,     false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_UNPAUSE,   handle_progress_unpause,   false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEWROOT,            handle_newroot,            false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT,      handle_has_active_vt,      true  },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROTOCOL_VERSION,   handle_protocol_version,   true  },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_PAGE,      handle_progress_page,      false },
+        { PLY_BOOT_PROTOCOL_REQUEST_TYPE_STATISTICS,         handle_statistics,         true  },
+};
+
+static void
+ply_boot_server_fill_request_dispatch (ply_boot_server_t *server)
+{
+        size_t i;
+
+        for (i = 0; i < PLY_NUMBER_OF_ELEMENTS (request_dispatch_table); i++) {
+                uint8_t command = request_dispatch_table[i].command[0];
+
+                assert (server->request_dispatch[command] == NULL);
+                server->request_dispatch[command] = &request_dispatch_table[i];
+        }
+}
+
+static void
+ply_boot_connection_dispatch_request (ply_boot_connection_t *connection,
+                                      ply_boot_request_t    *request)
+{
+        ply_boot_server_t *server = connection->server;
+        const ply_boot_request_dispatch_t *dispatch;
+        const char *response_type;
+
+        dispatch = server->request_dispatch[(uint8_t) request->command];
+
+        if (dispatch != NULL)
+                server->number_of_requests[(uint8_t) request->command]++;
+
+        if (dispatch == NULL) {
+                ply_error ("received unknown command '%c' from client", request->command);
+                response_type = PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+        } else if (!dispatch->allow_unprivileged && !ply_boot_connection_is_from_root (connection)) {
+                ply_error ("request came from non-root user");
+                response_type = PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK;
+        } else {
+                response_type = dispatch->handler (connection, request);
+        }
+
+        if (response_type != NULL) {
+                if (!ply_boot_connection_send_reply (connection, request->id,
+                                                     response_type, NULL, 0))
+                        ply_trace ("could not finish writing reply: %m");
+        }
+
+        ply_boot_request_free (request);
+}
+
+static void
+ply_boot_connection_process_pipelined_requests (ply_boot_connection_t *connection)
+{
+        ply_boot_request_t *request;
+        size_t offset = 0;
+        bool is_malformed;
+
+        if (!ply_boot_connection_read_available_bytes (connection)) {
+                ply_trace ("could not read connection request");
                 return;
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_KEYSTROKE_REMOVE) == 0) {
-                ply_trace ("got keystroke remove request");
-                if (server->ignore_keystroke_handler != NULL)
-                        server->ignore_keystroke_handler (server->user_data,
-                                                          argument,
-                                                          server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_PAUSE) == 0) {
-                ply_trace ("got progress pause request");
-                if (server->progress_pause_handler != NULL)
-                        server->progress_pause_handler (server->user_data,
-                                                        server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PROGRESS_UNPAUSE) == 0) {
-                ply_trace ("got progress unpause request");
-                if (server->progress_unpause_handler != NULL)
-                        server->progress_unpause_handler (server->user_data,
-                                                          server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_NEWROOT) == 0) {
-                ply_trace ("got newroot request");
-                if (server->newroot_handler != NULL)
-                        server->newroot_handler (server->user_data, argument, server);
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_HAS_ACTIVE_VT) == 0) {
-                bool answer = false;
-
-                ply_trace ("got has_active vt? request");
-                if (server->has_active_vt_handler != NULL)
-                        answer = server->has_active_vt_handler (server->user_data, server);
-
-                if (!answer) {
-                        if (!ply_write (connection->fd,
-                                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                                ply_trace ("could not finish writing nak: %m");
+        }
 
-                        free (argument);
-                        free (command);
-                        return;
-                }
-        } else if (strcmp (command, PLY_BOOT_PROTOCOL_REQUEST_TYPE_PING) != 0) {
-                ply_error ("received unknown command '%s' from client", command);
+        ply_boot_connection_take_reference (connection);
+        while ((request = ply_boot_connection_parse_request (connection, &offset, &is_malformed)) != NULL) {
+                ply_boot_connection_dispatch_request (connection, request);
+
+                if (connection->disconnected)
+                        break;
+        }
+
+        if (is_malformed) {
+                ply_buffer_clear (connection->input_buffer);
+                shutdown (connection->fd, SHUT_RDWR);
+        } else {
+                ply_buffer_remove_bytes (connection->input_buffer, offset);
+        }
+        ply_boot_connection_drop_reference (connection);
+}
+
+static void
+ply_boot_connection_on_request (ply_boot_connection_t *connection)
+{
+        ply_boot_request_t *request;
+
+        assert (connection != NULL);
+        assert (connection->fd >= 0);
+        assert (connection->server != NULL);
+
+        if (connection->protocol_version >= 2) {
+                ply_boot_connection_process_pipelined_requests (connection);
+                return;
+        }
 
-                if (!ply_write (connection->fd,
-                                PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK,
-                                strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_NAK)))
-                        ply_trace ("could not finish writing ping reply: %m");
+        request = ply_boot_connection_read_request (connection);
 
-                free (argument);
-                free (command);
+        if (request == NULL) {
+                ply_trace ("could not read connection request");
                 return;
         }
 
-        if (!ply_write (connection->fd,
-                        PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK,
-                        strlen (PLY_BOOT_PROTOCOL_RESPONSE_TYPE_ACK)))
-                ply_trace ("could not finish writing ack: %m");
-        free (argument);
-        free (command);
+        ply_boot_connection_dispatch_request (connection, request);
 }
 
 static void
@@ -788,6 +1371,18 @@ ply_boot_server_on_new_connection (ply_boot_server_t *server)
 
         connection = ply_boot_connection_new (server, fd);
 
+        /* The peer can't change once the connection is accepted, so its
+         * credentials only need to be looked up once
+         */
+        if (!ply_get_credentials_from_fd (fd, &connection->pid, &connection->uid, NULL)) {
+                ply_trace ("couldn't read credentials from connection: %m");
+                ply_boot_connection_free (connection);
+                return;
+        }
+
+        if (ply_is_tracing ())
+                print_connection_process_identity (connection);
+
         connection->watch =
                 ply_event_loop_watch_fd (server->loop, fd,
                                          PLY_EVENT_LOOP_FD_STATUS_HAS_DATA,
@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include "ply-buffer.h"
 #include "ply-trigger.h"
 #include "ply-boot-protocol.h"
 #include "ply-event-loop.h"
@@ -104,6 +105,12 @@ typedef bool (*ply_boot_server_has_active_vt_handler_t) (void              *user
                                                          ply_boot_server_t *server);
 typedef bool (*ply_boot_server_reload_handler_t) (void              *user_data,
                                                   ply_boot_server_t *server);
+typedef bool (*ply_boot_server_progress_page_handler_t) (void              *user_data,
+                                                         int                page_fd,
+                                                         ply_boot_server_t *server);
+typedef void (*ply_boot_server_statistics_handler_t) (void              *user_data,
+                                                      ply_buffer_t      *statistics,
+                                                      ply_boot_server_t *server);
 
 #ifndef PLY_HIDE_FUNCTION_DECLARATIONS
 ply_boot_server_t *ply_boot_server_new (ply_boot_server_update_handler_t              update_handler,
@@ -127,6 +134,8 @@ ply_boot_server_t *ply_boot_server_new (ply_boot_server_update_handler_t
                                         ply_boot_server_quit_handler_t                quit_handler,
                                         ply_boot_server_has_active_vt_handler_t       has_active_vt_handler,
                                         ply_boot_server_reload_handler_t              reload_handler,
+                                        ply_boot_server_progress_page_handler_t       progress_page_handler,
+                                        ply_boot_server_statistics_handler_t          statistics_handler,
                                         void                                         *user_data);
 
 void ply_boot_server_free (ply_boot_server_t *server);